@@ -24,10 +24,6 @@ using boost::scoped_ptr;
 using std::string;
 namespace db = caffe::db;
 
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
-
 const int kCIFARSize = 32;
 const int kCIFARImageNBytes = 3072;
 const int kCIFARBatchSize = 10000;
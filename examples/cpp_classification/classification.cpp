@@ -15,9 +15,6 @@
 #ifdef USE_OPENCV
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::string;
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
 /* Pair (label, confidence) representing a prediction. */
 typedef std::pair<string, float> Prediction;
 
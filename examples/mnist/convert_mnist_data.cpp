@@ -34,10 +34,6 @@ using namespace caffe;  // NOLINT(build/namespaces)
 using boost::scoped_ptr;
 using std::string;
 
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
-
 DEFINE_string(backend, "lmdb", "The backend for storing the result");
 
 uint32_t swap_endian(uint32_t val) {
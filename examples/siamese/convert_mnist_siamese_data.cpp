@@ -20,10 +20,6 @@
 #ifdef USE_LEVELDB
 #include "leveldb/db.h"
 
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
-
 uint32_t swap_endian(uint32_t val) {
     val = ((val << 8) & 0xFF00FF00) | ((val >> 8) & 0xFF00FF);
     return (val << 16) | (val >> 16);
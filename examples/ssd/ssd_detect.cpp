@@ -28,9 +28,6 @@
 
 #ifdef USE_OPENCV
 using namespace caffe;  // NOLINT(build/namespaces)
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
 
 class Detector {
  public:
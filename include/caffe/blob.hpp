@@ -9,8 +9,6 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/syncedmem.hpp"
 
-//DECLARE_string(step);
-
 const int kMaxBlobAxes = 32;
 
 namespace caffe {
@@ -26,7 +24,8 @@ namespace caffe {
 template <typename Dtype>
 class Blob {
  public:
-  Blob(): data_(),diff_(),mask_(),csrval_(),csrrowptr_(),csrcolind_(),sparse_(false), count_(0), capacity_(0),nnz_(0) {}
+  Blob(): data_(),diff_(),mask_(),csrval_(),csrrowptr_(),csrcolind_(),
+       sparsity_mode_(SparsityParameter::DENSE), count_(0), capacity_(0),nnz_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -51,7 +50,6 @@ class Blob {
    * propagate the new input shape to higher layers.
    */
   void Reshape(const vector<int>& shape);
-  void Addmask(const vector<int>& shape);
   void Reshape(const BlobShape& shape);
   void ReshapeLike(const Blob& other);
   inline string shape_string() const {
@@ -77,10 +75,29 @@ class Blob {
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
   inline int nnz() const { return nnz_; }
-  inline bool sparse() const {return sparse_;}
-  inline void setSparse(){sparse_=true;}
-  inline void clearSparse(){sparse_=false;}
+  inline SparsityParameter::Mode sparsity_mode() const {
+    return sparsity_mode_;
+  }
+  /// @brief True for PRUNE and SPARSE blobs, which are serialized as CSR.
+  inline bool sparse() const {
+    return sparsity_mode_ != SparsityParameter::DENSE;
+  }
+  /**
+   * @brief Sets how the blob is pruned. PRUNE allocates a mask keeping every
+   *        element unless a mask already exists; DENSE and SPARSE drop it.
+   */
+  void set_sparsity_mode(SparsityParameter::Mode mode);
   inline void setNnz(int num){nnz_=num;return;}
+  /// @brief Number of 32-bit words of the packed mask.
+  inline int mask_words() const { return (count_ + 31) / 32; }
+  /// @brief Number of elements the mask keeps (all of them without a mask).
+  int mask_nnz() const;
+  /**
+   * @brief Returns true if consumers should compute with the CSR copy of
+   *        the data instead of the dense one, i.e. the blob is in SPARSE
+   *        mode and the CSR arrays are loaded.
+   */
+  bool use_csr() const;
 
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
@@ -205,9 +222,10 @@ class Blob {
       const int w) const {
     return cpu_diff()[offset(n, c, h, w)];
   }
-  inline Dtype mask_at(const int n, const int c, const int h,
-  		const int w) const{
-  	return cpu_mask()[offset(n, c, h, w)];
+  inline bool mask_at(const int n, const int c, const int h,
+      const int w) const {
+    const int index = offset(n, c, h, w);
+    return (cpu_mask()[index >> 5] >> (index & 31)) & 1u;
   }
  
   inline Dtype data_at(const vector<int>& index) const {
@@ -217,8 +235,9 @@ class Blob {
   inline Dtype diff_at(const vector<int>& index) const {
     return cpu_diff()[offset(index)];
   }
-  inline Dtype mask_at(const vector<int>& index) const {
-    return cpu_mask()[offset(index)];
+  inline bool mask_at(const vector<int>& index) const {
+    const int i = offset(index);
+    return (cpu_mask()[i >> 5] >> (i & 31)) & 1u;
   }
     
   inline const shared_ptr<SyncedMemory>& data() const {
@@ -255,14 +274,15 @@ class Blob {
   const Dtype* gpu_data() const;
   const Dtype* cpu_diff() const;
   const Dtype* gpu_diff() const;
-  const Dtype* cpu_mask() const;
+  /// @brief The packed mask: bit i % 32 of word i / 32 keeps element i.
+  const uint32_t* cpu_mask() const;
 
   const Dtype* cpu_csrval() const;
   const int* cpu_csrrowptr() const;
   const int* cpu_csrcolind() const;
 
 
-  const Dtype* gpu_mask() const;
+  const uint32_t* gpu_mask() const;
 
   const Dtype* gpu_csrval() const;
   const int* gpu_csrrowptr() const;
@@ -274,35 +294,43 @@ class Blob {
   Dtype* mutable_gpu_data();
   Dtype* mutable_cpu_diff();
   Dtype* mutable_gpu_diff();
-  Dtype* mutable_cpu_mask();
+  uint32_t* mutable_cpu_mask();
   Dtype* mutable_cpu_csrval();
   int* mutable_cpu_csrrowptr();
   int* mutable_cpu_csrcolind();
-  Dtype* mutable_gpu_mask();
+  uint32_t* mutable_gpu_mask();
   Dtype* mutable_gpu_csrval();
   int* mutable_gpu_csrrowptr();
   int* mutable_gpu_csrcolind();
   void Update();
+  /**
+   * @brief Restores the blob from a BlobProto. CSR-stored sparse blobs are
+   *        only expanded to dense data (and mask) if use_csr() is false
+   *        after loading, i.e. if the layer will not consume the CSR form.
+   */
   void FromProto(const BlobProto& proto, bool reshape = true);
+  /**
+   * @brief Serializes the blob; sparse blobs are written as CSR only, with
+   *        delta-encoded column indices and no dense data or mask.
+   */
   void ToProto(BlobProto* proto,bool write_diff = false);
+  /// @brief Recomputes the CSR arrays (and nnz) from the dense data on host.
+  void ComputeCsr();
 
   /// @brief Compute the sum of absolute values (L1 norm) of the data.
   Dtype asum_data() const;
   /// @brief Compute the sum of absolute values (L1 norm) of the diff.
   Dtype asum_diff() const;
-  Dtype asum_mask() const;
   Dtype asum_csrval() const;
   /// @brief Compute the sum of squares (L2 norm squared) of the data.
   Dtype sumsq_data() const;
   /// @brief Compute the sum of squares (L2 norm squared) of the diff.
   Dtype sumsq_diff() const;
-  Dtype sumsq_mask() const;
   Dtype sumsq_csrval() const;
   /// @brief Scale the blob data by a constant factor.
   void scale_data(Dtype scale_factor);
   /// @brief Scale the blob diff by a constant factor.
   void scale_diff(Dtype scale_factor);
-  void scale_mask(Dtype scale_factor);
   void scale_csrval(Dtype scale_factor);
   void scale_csrrowptr(Dtype scale_factor);
   void scale_csrcolind(Dtype scale_factor);
@@ -325,6 +353,13 @@ class Blob {
    */
   void ShareDiff(const Blob& other);
 
+  /**
+   * @brief Allocate the host memory of data_ with allocator from now on.
+   *
+   * The current data are discarded, and reallocated on the next access.
+   */
+  void set_host_allocator(const shared_ptr<HostAllocator>& allocator);
+
   void ShareMask(const Blob& other);
   void ShareCsrval(const Blob& other);
   void ShareCsrrowptr(const Blob& other);
@@ -341,12 +376,16 @@ class Blob {
   shared_ptr<SyncedMemory> csrcolind_;
 
   shared_ptr<SyncedMemory> shape_data_;
+  shared_ptr<HostAllocator> host_allocator_;
   vector<int> shape_;
-  bool sparse_;
+  SparsityParameter::Mode sparsity_mode_;
   int count_;
   int capacity_;
   int nnz_;
 
+  /// @brief Allocates a mask for count_ elements with all of them kept.
+  void InitMask();
+
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
 
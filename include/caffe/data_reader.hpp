@@ -14,11 +14,13 @@ namespace caffe {
 
 /**
  * @brief Reads data from a source to queues available to data layers.
- * A single reading thread is created per source, even if multiple solvers
- * are running in parallel, e.g. for multi-GPU training. This makes sure
- * databases are read sequentially, and that each solver accesses a different
- * subset of the database. Data is distributed to solvers in a round-robin
- * way to keep parallel training deterministic.
+ * A single body is created per source, even if multiple solvers are running
+ * in parallel, e.g. for multi-GPU training. Each solver reads its own shard
+ * of the database, every solver_count-th record, so that each solver
+ * accesses a different subset of the database. Within a shard, num_readers
+ * threads parse interleaved records, which are merged back in the order of
+ * the database, and optionally go through a seeded shuffle buffer. This
+ * keeps parallel training deterministic.
  */
 template <typename T>
 class DataReader {
@@ -46,6 +48,50 @@ class DataReader {
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // Parses every stride-th record of the database, starting at offset,
+  // wrapping around at the end.
+  class Reader : public InternalThread {
+   public:
+    Reader(db::Cursor* cursor, int offset, int stride);
+    virtual ~Reader();
+
+    BlockingQueue<T*> free_;
+    BlockingQueue<T*> full_;
+
+   protected:
+    void InternalThreadEntry();
+    void advance(int n);
+
+    shared_ptr<db::Cursor> cursor_;
+    const int offset_;
+    const int stride_;
+    vector<shared_ptr<T> > items_;
+
+  DISABLE_COPY_AND_ASSIGN(Reader);
+  };
+
+  // The records of one solver, read by num_readers readers.
+  class Shard {
+   public:
+    Shard(const LayerParameter& param, db::DB* db, int solver_id,
+          int solver_count);
+
+    // Moves the next record of the shard to qp.
+    void read_one(QueuePair* qp);
+
+   protected:
+    // Moves the next record of the database order into t.
+    void next(T* t);
+
+    vector<shared_ptr<Reader> > readers_;
+    int next_reader_;
+    int shuffle_buffer_size_;
+    vector<shared_ptr<T> > shuffle_buffer_;
+    shared_ptr<Caffe::RNG> rng_;
+
+  DISABLE_COPY_AND_ASSIGN(Shard);
+  };
+
   // A single body is created per source
   class Body : public InternalThread {
    public:
@@ -54,7 +100,6 @@ class DataReader {
 
    protected:
     void InternalThreadEntry();
-    void read_one(db::Cursor* cursor, QueuePair* qp);
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
@@ -101,6 +101,16 @@ class DataTransformer {
       const NormalizedBBox& crop_bbox, const bool do_mirror,
       RepeatedPtrField<AnnotationGroup>* transformed_anno_group_all);
 
+  /**
+   * @brief Transform the bbox annotation of an image of img_height x
+   * img_width according to the transformation applied to the image.
+   */
+  void TransformAnnotation(
+      const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+      const int img_height, const int img_width, const bool do_resize,
+      const NormalizedBBox& crop_bbox, const bool do_mirror,
+      RepeatedPtrField<AnnotationGroup>* transformed_anno_group_all);
+
   /**
    * @brief Crops the datum according to bbox.
    */
@@ -158,18 +168,53 @@ class DataTransformer {
                  NormalizedBBox* crop_bbox, bool* do_mirror);
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation defined in the data layer's
+   * transform_param block to a cv::Mat and its bbox annotation.
+   */
+  void Transform(const cv::Mat& cv_img,
+                 const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+                 Blob<Dtype>* transformed_blob,
+                 RepeatedPtrField<AnnotationGroup>* transformed_anno_group_all);
+
+  /**
+   * @brief Decodes an encoded datum, following force_color and force_gray.
+   */
+  cv::Mat DecodeImage(const Datum& datum);
+
   /**
    * @brief Crops img according to bbox.
    */
   void CropImage(const cv::Mat& img, const NormalizedBBox& bbox,
                  cv::Mat* crop_img);
 
+  /**
+   * @brief Crops img and its bbox annotation according to bbox.
+   */
+  void CropImage(const cv::Mat& img,
+                 const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+                 const NormalizedBBox& bbox, cv::Mat* crop_img,
+                 RepeatedPtrField<AnnotationGroup>* cropped_anno_group_all);
+
   /**
    * @brief Expand img to include mean value as background.
    */
   void ExpandImage(const cv::Mat& img, const float expand_ratio,
                    NormalizedBBox* expand_bbox, cv::Mat* expand_img);
 
+  /**
+   * @brief Expand img and adjust its bbox annotation, as in expand_param.
+   */
+  void ExpandImage(const cv::Mat& img,
+                   const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+                   cv::Mat* expand_img,
+                   RepeatedPtrField<AnnotationGroup>* expanded_anno_group_all);
+
+  /**
+   * @brief Apply distortion to img.
+   */
+  void DistortImage(const cv::Mat& img, cv::Mat* distort_img);
+
   void TransformInv(const Blob<Dtype>* blob, vector<cv::Mat>* cv_imgs);
   void TransformInv(const Dtype* data, cv::Mat* cv_img, const int height,
                     const int width, const int channels);
@@ -315,6 +315,18 @@ class Layer {
     }
     param_propagate_down_[param_id] = value;
   }
+  /**
+   * @brief Returns the sparsity mode of the parameter at index param_id:
+   *        the sparsity_param of its ParamSpec if given, otherwise the
+   *        layer's.
+   */
+  inline SparsityParameter::Mode sparsity_mode(const int param_id) const {
+    if (param_id < layer_param_.param_size() &&
+        layer_param_.param(param_id).has_sparsity_param()) {
+      return layer_param_.param(param_id).sparsity_param().mode();
+    }
+    return layer_param_.sparsity_param().mode();
+  }
 
 
  protected:
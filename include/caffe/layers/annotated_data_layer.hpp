@@ -30,12 +30,46 @@ class AnnotatedDataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  virtual void transform_items(int worker_id);
+  virtual inline bool SupportsWorkers() const { return true; }
+  // Samples and transforms item item_id of the current batch with the
+  // transformer of worker worker_id.
+  void transform_item(int worker_id, int item_id);
+  // Points transformed_data at item item_id of batch, after checking that
+  // the item has the shape of the batch (or reshaping for FIT_SMALL_SIZE).
+  void SetUpTransformedData(const vector<int>& shape, const int item_id,
+                            Batch<Dtype>* batch, Blob<Dtype>* transformed_data);
+#ifdef USE_OPENCV
+  // Decodes an encoded anno_datum once, then distorts, expands and samples
+  // the image and its annotation as cv::Mat.
+  void SampleImage(DataTransformer<Dtype>* transformer,
+                   const AnnotatedDatum& anno_datum, cv::Mat* img,
+                   RepeatedPtrField<AnnotationGroup>* anno_group_all);
+#endif  // USE_OPENCV
 
   DataReader<AnnotatedDatum> reader_;
   bool has_anno_type_;
   AnnotatedDatum_AnnotationType anno_type_;
   vector<BatchSampler> batch_samplers_;
   string label_map_file_;
+  bool fixed_label_capacity_;
+  // Number of bbox rows of the label blob if fixed_label_capacity_.
+  int label_capacity_;
+
+  // The batch being loaded and its items, shared with the workers.
+  Batch<Dtype>* batch_;
+  vector<AnnotatedDatum*> items_;
+  // The bbox label rows of each item, written by the workers as
+  // [item_id, group_label, instance_id, xmin, ymin, xmax, ymax, diff].
+  vector<vector<Dtype> > item_labels_;
+  // Where each worker writes its items into the batch.
+  vector<shared_ptr<Blob<Dtype> > > worker_transformed_data_;
+  // Transformed annotation of each worker, reused across items.
+  vector<RepeatedPtrField<AnnotationGroup> > worker_anno_;
+  // Outputs of ExpandImage and CropImage of each worker, reused across items
+  // so that their buffers are not reallocated.
+  vector<shared_ptr<AnnotatedDatum> > expand_datums_;
+  vector<shared_ptr<AnnotatedDatum> > sampled_datums_;
 };
 
 }  // namespace caffe
@@ -40,6 +40,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Sparse counterparts of forward_cpu_gemm/backward_cpu_gemm, multiplying
+  // the CSR form of the pruned filters (blobs_[0]) with the column buffer.
+  void forward_cpu_csrmm(const Dtype* input, Dtype* output);
+  void backward_cpu_csrmm(const Dtype* input, Dtype* output);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -67,18 +67,52 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
-
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  // Calls transform_items(worker_id) for each of the num_workers_ workers and
+  // waits until they are all done. Worker 0 is the calling prefetch thread.
+  void RunWorkers();
+  // Transforms the share of the current batch assigned to worker_id. It may
+  // only use data_transformers_[worker_id] and caffe_rng, which is local to
+  // the thread, so that each worker has its own deterministic random stream.
+  virtual void transform_items(int worker_id) {}
+  // Whether load_batch calls RunWorkers, i.e. the layer implements
+  // transform_items. Otherwise a single worker is used.
+  virtual inline bool SupportsWorkers() const { return false; }
+
+  // Prefetches batches (asynchronously if to GPU memory)
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // Allocates the host memory of the prefetched batches.
+  shared_ptr<HostAllocator> host_allocator_;
 
   Blob<Dtype> transformed_data_;
+
+  int num_workers_;
+  // One data transformer per worker; the first one is data_transformer_.
+  vector<shared_ptr<DataTransformer<Dtype> > > data_transformers_;
+
+ private:
+  // Thread of a worker other than worker 0.
+  class Worker : public InternalThread {
+   public:
+    Worker(BasePrefetchingDataLayer<Dtype>* layer, int worker_id);
+    virtual ~Worker();
+
+    BlockingQueue<int> start_;
+
+   protected:
+    virtual void InternalThreadEntry();
+
+    BasePrefetchingDataLayer<Dtype>* layer_;
+    int worker_id_;
+  };
+
+  vector<shared_ptr<Worker> > workers_;
+  BlockingQueue<int> workers_done_;
 };
 
 }  // namespace caffe
@@ -1,10 +1,6 @@
 #ifndef CAFFE_DETECTION_OUTPUT_LAYER_HPP_
 #define CAFFE_DETECTION_OUTPUT_LAYER_HPP_
 
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/regex.hpp>
-
 #include <map>
 #include <string>
 #include <utility>
@@ -15,8 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/bbox_util.hpp"
-
-using namespace boost::property_tree;  // NOLINT(build/namespaces)
+#include "caffe/util/detection_writer.hpp"
 
 namespace caffe {
 
@@ -84,7 +79,11 @@ class DetectionOutputLayer : public Layer<Dtype> {
 
   int num_;
   int num_priors_;
+  // The decoded priors of bottom[2], held so that they are only computed once
+  // while the priors stay the same.
+  shared_ptr<const PriorBBoxes> priors_;
 
+  NonMaximumSuppressionParameter nms_param_;
   float nms_threshold_;
   int top_k_;
   float eta_;
@@ -102,7 +101,7 @@ class DetectionOutputLayer : public Layer<Dtype> {
   bool has_resize_;
   ResizeParameter resize_param_;
 
-  ptree detections_;
+  shared_ptr<DetectionWriter> writer_;
 
   bool visualize_;
   float visualize_threshold_;
@@ -111,6 +110,17 @@ class DetectionOutputLayer : public Layer<Dtype> {
   Blob<Dtype> bbox_preds_;
   Blob<Dtype> bbox_permute_;
   Blob<Dtype> conf_permute_;
+
+  // Scratch space of Forward_cpu, kept across calls to avoid reallocation.
+  // nms_buffers_ has one entry per thread.
+  vector<NMSBuffer<Dtype> > nms_buffers_;
+  // Indices kept by nms for each (image, class) pair, and their scores.
+  vector<vector<int> > nms_indices_;
+  vector<vector<Dtype> > nms_scores_;
+  // (score, (label, prior index)) of the kept detections of each image, and
+  // the position of the first detection of each image in top.
+  vector<vector<pair<Dtype, pair<int, int> > > > kept_;
+  vector<int> kept_start_;
 };
 
 }  // namespace caffe
@@ -45,6 +45,9 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// scratch for the batched CSR path: K_ x M_ and N_ x M_ transposes
+  Blob<Dtype> csr_bottom_buffer_;
+  Blob<Dtype> csr_top_buffer_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,56 @@
+#ifndef CAFFE_MULTIBOX_HEAD_LAYER_HPP_
+#define CAFFE_MULTIBOX_HEAD_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Gathers the predictions of the multibox heads, i.e. Permute with
+ *        order [0, 2, 3, 1], Flatten and Concat along axis 1 in one layer.
+ *
+ * Each head is transposed from NCHW straight into its NHWC ordered slice of
+ * the top, instead of being copied once by Permute and again by Concat.
+ */
+template <typename Dtype>
+class MultiBoxHeadLayer : public Layer<Dtype> {
+ public:
+  explicit MultiBoxHeadLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "MultiBoxHead"; }
+  virtual inline int MinBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  /**
+   * @param bottom input Blob vector (length 1+)
+   *   -# @f$ (N \times C_k \times H_k \times W_k) @f$
+   *      the predictions of the k-th head
+   * @param top output Blob vector (length 1)
+   *   -# @f$ (N \times \sum_k H_k W_k C_k) @f$
+   *      the predictions of all the heads, each in H x W x C order
+   */
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  int num_;
+  // The count of an item of the top.
+  int top_dim_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_MULTIBOX_HEAD_LAYER_HPP_
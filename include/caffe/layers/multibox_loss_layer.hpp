@@ -74,6 +74,12 @@ class MultiBoxLossLayer : public LossLayer<Dtype> {
   Blob<Dtype> conf_gt_;
   // confidence loss.
   Blob<Dtype> conf_loss_;
+  // Whether the hard negatives are mined on the softmax loss of every prior,
+  // which then also gives the confidence loss instead of conf_loss_layer_.
+  bool fuse_conf_loss_;
+  // The softmax probabilities and loss of every prior when fuse_conf_loss_.
+  Blob<Dtype> conf_prob_;
+  Blob<Dtype> prior_conf_loss_;
 
   MultiBoxLossParameter multibox_loss_param_;
   int num_classes_;
@@ -103,6 +109,19 @@ class MultiBoxLossLayer : public LossLayer<Dtype> {
   vector<map<int, vector<int> > > all_match_indices_;
   vector<vector<int> > all_neg_indices_;
 
+  // The ground truth of the batch as flat arrays, and the scratch space of
+  // the matching, kept across calls to avoid reallocation.
+  vector<float> gt_bboxes_;
+  vector<int> gt_labels_;
+  vector<int> gt_start_;
+  vector<vector<float> > match_buffers_;
+
+  // The priors of bottom[2], and the same as NormalizedBBox which are only
+  // rebuilt when the priors change.
+  shared_ptr<const PriorBBoxes> priors_;
+  vector<NormalizedBBox> prior_bboxes_;
+  vector<vector<float> > prior_variances_;
+
   // How to normalize the loss.
   LossParameter_NormalizationMode normalization_;
 };
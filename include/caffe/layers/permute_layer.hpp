@@ -15,7 +15,8 @@ namespace caffe {
  * TODO(weiliu89): thorough documentation for Forward, Backward, and proto params.
  */
 
-// The main function which does the permute.
+// The main function which does the permute, element by element. PermuteLayer
+// uses faster paths on CPU.
 template <typename Dtype>
 void Permute(const int count, Dtype* bottom_data, const bool forward,
     const int* permute_order, const int* old_steps, const int* new_steps,
@@ -52,6 +53,22 @@ class PermuteLayer : public Layer<Dtype> {
   Blob<int> permute_order_;
   Blob<int> old_steps_;
   Blob<int> new_steps_;
+
+  // When the order swaps the axes [transpose_axis_, transpose_split_) with
+  // the following ones, e.g. [0, 2, 3, 1] (NCHW to NHWC) and its inverse
+  // [0, 3, 1, 2], the permute transposes each of transpose_num_ matrices of
+  // transpose_rows_ x transpose_cols_. Otherwise transpose_axis_ is -1.
+  int transpose_axis_;
+  int transpose_split_;
+  int transpose_num_;
+  int transpose_rows_;
+  int transpose_cols_;
+  // Otherwise, the top is permuted row by row along its last axis, which is
+  // strided by inner_step_ in the bottom: row_offsets_ holds the offset in
+  // the bottom of each row of the top.
+  vector<int> row_offsets_;
+  int inner_dim_;
+  int inner_step_;
 };
 
 }  // namespace caffe
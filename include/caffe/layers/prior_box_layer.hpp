@@ -1,8 +1,12 @@
 #ifndef CAFFE_PRIORBOX_LAYER_HPP_
 #define CAFFE_PRIORBOX_LAYER_HPP_
 
+#include <map>
+#include <string>
 #include <vector>
 
+#include "boost/weak_ptr.hpp"
+
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -41,6 +45,9 @@ class PriorBoxLayer : public Layer<Dtype> {
   virtual inline int ExactBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  /// @brief Returns the priors and variances of the current shapes.
+  inline const vector<Dtype>& priors() const { return *priors_; }
+
  protected:
   /**
    * @brief Generates prior boxes for a layer with specified parameters.
@@ -63,6 +70,11 @@ class PriorBoxLayer : public Layer<Dtype> {
     return;
   }
 
+  // Generates the priors of a layer_height x layer_width feature map of an
+  // img_height x img_width image, followed by their variances.
+  void GeneratePriors(const int layer_height, const int layer_width,
+      const int img_height, const int img_width, Dtype* prior_data) const;
+
   vector<float> min_sizes_;
   vector<float> max_sizes_;
   vector<float> aspect_ratios_;
@@ -77,6 +89,21 @@ class PriorBoxLayer : public Layer<Dtype> {
   float step_h_;
 
   float offset_;
+
+  // The priors of the current shapes. They only depend on the parameters and
+  // the shapes, so they are generated once and shared by all the layers with
+  // the same ones, e.g. those of the nets built from the same prototxt.
+  shared_ptr<const vector<Dtype> > priors_;
+  // layer_height, layer_width, img_height and img_width of priors_.
+  vector<int> priors_shape_;
+  // The priors last copied to the top, and the memory they were copied to.
+  // Nothing else writes the top, so it is only copied again when either
+  // changes.
+  shared_ptr<const vector<Dtype> > top_priors_;
+  shared_ptr<SyncedMemory> top_data_;
+
+  static map<const string, boost::weak_ptr<const vector<Dtype> > >
+      all_priors_;
 };
 
 }  // namespace caffe
@@ -11,12 +11,15 @@
 #include <string>
 #include <vector>
 
+#include "boost/date_time/posix_time/posix_time.hpp"
+
 #include "caffe/blob.hpp"
 #include "caffe/data_transformer.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe {
@@ -24,12 +27,24 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from webcam or video files.
  *
- * TODO(weiliu89): thorough documentation for Forward and proto params.
+ * Frames are decoded by a capture thread into a ring buffer of
+ * frame_buffer_size frames, ahead of the prefetch thread that transforms
+ * them. A video is decoded as far ahead as the buffer allows. A webcam never
+ * waits for the net: when the buffer is full its oldest frame is dropped, and
+ * each item of a batch is the latest frame captured.
+ *
+ * The second top, if any, holds the timestamp of each frame in milliseconds:
+ * its position in the video, or the time since setup it was captured by the
+ * webcam. Items past the end of a video are zero with a timestamp of -1.
+ * With float, timestamps are exact to the millisecond for the first 2^24 ms,
+ * i.e. about 4.6 hours; after that they are rounded to 2 ms, 4 ms and so on.
  */
 template <typename Dtype>
 class VideoDataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit VideoDataLayer(const LayerParameter& param);
+  // Stops the prefetch thread, then the capture thread, before releasing the
+  // video that the capture thread reads.
   virtual ~VideoDataLayer();
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -40,6 +55,12 @@ class VideoDataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  // Called on the capture thread. Decodes the next frame to process into a
+  // free slot of the ring buffer, and returns false at the end of the video.
+  bool capture_frame();
+  // Milliseconds since setup, on a clock that is not moved by time zone or
+  // daylight saving changes.
+  double elapsed_ms() const;
 
   VideoDataParameter_VideoType video_type_;
   cv::VideoCapture cap_;
@@ -49,6 +70,34 @@ class VideoDataLayer : public BasePrefetchingDataLayer<Dtype> {
   int total_frames_;
   int processed_frames_;
   vector<int> top_shape_;
+
+  // A decoded frame. An empty image marks the end of the video.
+  struct Frame {
+    cv::Mat image;
+    double timestamp;
+  };
+  // The ring buffer; free_frames_ and full_frames_ hold indices in frames_.
+  vector<Frame> frames_;
+  BlockingQueue<int> free_frames_;
+  BlockingQueue<int> full_frames_;
+  bool finished_;
+  int dropped_frames_;
+  boost::posix_time::ptime start_time_;
+
+ private:
+  // Thread calling capture_frame until the end of the video.
+  class Capture : public InternalThread {
+   public:
+    explicit Capture(VideoDataLayer<Dtype>* layer);
+    virtual ~Capture();
+
+   protected:
+    virtual void InternalThreadEntry();
+
+    VideoDataLayer<Dtype>* layer_;
+  };
+
+  shared_ptr<Capture> capture_;
 };
 
 }  // namespace caffe
@@ -111,6 +111,11 @@ class Solver {
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
   /// Harmonize solver class type with configured proto type.
   void CheckType(SolverParameter* param);
+  /// Resolve the weights of the layers pruned by param_.pruning().
+  void InitPruning();
+  /// Recompute the masks whose schedule is due at iter_ (all of them if
+  /// force is set, e.g. after restoring a snapshot).
+  void PruneWeights(const bool force);
 
   SolverParameter param_;
   int iter_;
@@ -118,6 +123,8 @@ class Solver {
   shared_ptr<Net<Dtype> > net_;
   vector<shared_ptr<Net<Dtype> > > test_nets_;
   vector<Callback*> callbacks_;
+  // The weights pruned by each entry of param_.pruning().
+  vector<Blob<Dtype>*> pruned_blobs_;
   vector<Dtype> losses_;
   Dtype smoothed_loss_;
 
@@ -2,6 +2,7 @@
 #define CAFFE_SYNCEDMEM_HPP_
 
 #include <cstdlib>
+#include <map>
 
 #include "caffe/common.hpp"
 
@@ -35,6 +36,51 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
   free(ptr);
 }
 
+/**
+ * @brief Allocates the host memory of a SyncedMemory in place of
+ *        CaffeMallocHost. It may be shared by several SyncedMemory, and used
+ *        from several threads.
+ */
+class HostAllocator {
+ public:
+  virtual ~HostAllocator() {}
+  virtual void* Allocate(size_t size) = 0;
+  // Frees ptr, returned by Allocate(size).
+  virtual void Free(void* ptr, size_t size) = 0;
+};
+
+/**
+ * @brief Allocates whole pages with mmap.
+ *
+ * With huge_pages, the pages are taken from the reserved huge pages
+ * (MAP_HUGETLB), or else are advised to become transparent huge pages. With
+ * numa_node >= 0, the pages are bound to that NUMA node (mbind). Both only
+ * apply on Linux. In GPU mode the pages are also pinned for DMA transfers, as
+ * CaffeMallocHost does.
+ */
+class PageAllocator : public HostAllocator {
+ public:
+  PageAllocator(bool huge_pages, int numa_node);
+  virtual ~PageAllocator();
+  virtual void* Allocate(size_t size);
+  virtual void Free(void* ptr, size_t size);
+
+ protected:
+  struct Mapping {
+    size_t size;
+    bool pinned;
+  };
+  class sync;
+
+  const bool huge_pages_;
+  const int numa_node_;
+  // The mappings made by Allocate, by address.
+  map<void*, Mapping> mappings_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(PageAllocator);
+};
+
 
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
@@ -53,6 +99,9 @@ class SyncedMemory {
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
         gpu_device_(-1) {}
   ~SyncedMemory();
+  // Allocate the host memory with allocator instead of CaffeMallocHost. Must
+  // be called before the host memory is allocated.
+  void set_host_allocator(const shared_ptr<HostAllocator>& allocator);
   const void* cpu_data();
   void set_cpu_data(void* data);
   const void* gpu_data();
@@ -70,6 +119,8 @@ class SyncedMemory {
  private:
   void to_cpu();
   void to_gpu();
+  void malloc_host();
+  void free_host();
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
@@ -78,6 +129,7 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int gpu_device_;
+  shared_ptr<HostAllocator> host_allocator_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -29,6 +29,27 @@ typedef MultiBoxLossParameter_MiningType MiningType;
 
 typedef map<int, vector<NormalizedBBox> > LabelBBox;
 
+// Prior bounding boxes in flat arrays, pre-decoded for bbox decoding and
+// matching. Each coordinate is stored over num_priors contiguous values.
+struct PriorBBoxes {
+  int num_priors;
+  // The prior data as float: num_priors x 4 corners followed by num_priors x 4
+  // variances.
+  vector<float> data;
+  vector<float> xmin, ymin, xmax, ymax;
+  // The area of each prior, as BBoxSize.
+  vector<float> size;
+  vector<float> center_x, center_y, width, height;
+
+  inline const float* variances() const { return &data[num_priors * 4]; }
+};
+
+// Item id of the header row of a ground truth blob with a fixed capacity (see
+// AnnotatedDataParameter.fixed_label_capacity). The header is
+// [kLabelHeaderId, num_gt, capacity, -1, -1, -1, -1, -1], and is followed by
+// capacity rows of which the first num_gt hold ground truth.
+const int kLabelHeaderId = -2;
+
 // Function used to sort NormalizedBBox, stored in STL container (e.g. vector),
 // in ascend order based on the score value.
 bool SortBBoxAscend(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2);
@@ -49,6 +70,13 @@ template <typename T>
 bool SortScorePairDescend(const pair<float, T>& pair1,
                           const pair<float, T>& pair2);
 
+// Function used to sort pair<Dtype, T> in descend order based on the score
+// (first) value, breaking ties by the index (second) value in ascend order so
+// that the order does not depend on the sort algorithm.
+template <typename Dtype, typename T>
+bool SortScoreIndexDescend(const pair<Dtype, T>& pair1,
+                           const pair<Dtype, T>& pair2);
+
 // Generate unit bbox [0, 0, 1, 1]
 NormalizedBBox UnitBBox();
 
@@ -136,6 +164,27 @@ void DecodeBBoxesAll(const vector<LabelBBox>& all_loc_pred,
     const CodeType code_type, const bool variance_encoded_in_target,
     const bool clip, vector<LabelBBox>* all_decode_bboxes);
 
+// Decode all bboxes in a batch from raw data.
+//    loc_data: num x num_priors x num_loc_classes x 4 location predictions.
+//    prior_data: 2 x num_priors * 4 prior bboxes followed by their variances,
+//      as output by PriorBoxLayer.
+//    bbox_data: stores the decoded bboxes as num x num_loc_classes x
+//      num_priors x 4, so that the bboxes of a class are contiguous. Entries
+//      of the background class are left untouched if !share_location.
+template <typename Dtype>
+void DecodeBBoxesAll(const Dtype* loc_data, const Dtype* prior_data,
+    const int num, const int num_priors, const bool share_location,
+    const int num_loc_classes, const int background_label_id,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip, Dtype* bbox_data);
+
+// Decode all bboxes in a batch as above, with the priors from GetPriorBBoxes.
+template <typename Dtype>
+void DecodeBBoxesAll(const Dtype* loc_data, const PriorBBoxes& priors,
+    const int num, const bool share_location, const int num_loc_classes,
+    const int background_label_id, const CodeType code_type,
+    const bool variance_encoded_in_target, const bool clip, Dtype* bbox_data);
+
 // Match prediction bboxes with ground truth bboxes.
 void MatchBBox(const vector<NormalizedBBox>& gt,
     const vector<NormalizedBBox>& pred_bboxes, const int label,
@@ -160,6 +209,32 @@ void FindMatches(const vector<LabelBBox>& all_loc_preds,
       vector<map<int, vector<float> > >* all_match_overlaps,
       vector<map<int, vector<int> > >* all_match_indices);
 
+// Find the same matches as above with use_prior_for_matching, on flat arrays.
+// The overlaps of each image are computed as one num_gt x num_priors matrix,
+// and the images are matched in parallel.
+//    prior_data: 2 x num_priors * 4 prior bboxes followed by their variances,
+//      as output by PriorBoxLayer.
+//    gt_bboxes, gt_labels, gt_start: the ground truth of the batch, as
+//      retrieved by the flat GetGroundTruth.
+//    overlaps: scratch space, one overlap matrix per thread.
+template <typename Dtype>
+void FindMatches(const Dtype* prior_data, const int num_priors,
+      const vector<float>& gt_bboxes, const vector<int>& gt_labels,
+      const vector<int>& gt_start,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<vector<float> >* overlaps,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices);
+
+// Find matches as above, with the priors from GetPriorBBoxes.
+void FindMatches(const PriorBBoxes& priors,
+      const vector<float>& gt_bboxes, const vector<int>& gt_labels,
+      const vector<int>& gt_start,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<vector<float> >* overlaps,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices);
+
 // Count the number of matches from the match indices.
 int CountNumMatches(const vector<map<int, vector<int> > >& all_match_indices,
                     const int num);
@@ -187,9 +262,15 @@ void MineHardExamples(const Blob<Dtype>& conf_blob,
     vector<map<int, vector<int> > >* all_match_indices,
     vector<vector<int> >* all_neg_indices);
 
+// Skip the header of a ground truth blob with a fixed capacity, if gt_data
+// has one, and return the number of rows holding ground truth. Otherwise
+// return num_gt and leave gt_data unchanged.
+template <typename Dtype>
+int SkipLabelHeader(const int num_gt, const Dtype** gt_data);
+
 // Retrieve bounding box ground truth from gt_data.
-//    gt_data: 1 x 1 x num_gt x 7 blob.
-//    num_gt: the number of ground truth.
+//    gt_data: 1 x 1 x num_gt x 8 blob, with or without a header.
+//    num_gt: the number of rows of gt_data.
 //    background_label_id: the label for background class which is used to do
 //      santity check so that no ground truth contains it.
 //    all_gt_bboxes: stores ground truth for each image. Label of each bbox is
@@ -203,6 +284,18 @@ template <typename Dtype>
 void GetGroundTruth(const Dtype* gt_data, const int num_gt,
       const int background_label_id, const bool use_difficult_gt,
       map<int, LabelBBox>* all_gt_bboxes);
+// Retrieve the same ground truth as above into flat arrays, without going
+// through NormalizedBBox.
+//    num: the number of images.
+//    gt_bboxes: [xmin, ymin, xmax, ymax] of each ground truth, grouped by
+//      image in the order of gt_data.
+//    gt_labels: the label of each ground truth.
+//    gt_start: num + 1 offsets; the ground truth of image i are the ones from
+//      gt_start[i] to gt_start[i + 1] - 1.
+template <typename Dtype>
+void GetGroundTruth(const Dtype* gt_data, const int num_gt, const int num,
+      const int background_label_id, const bool use_difficult_gt,
+      vector<float>* gt_bboxes, vector<int>* gt_labels, vector<int>* gt_start);
 
 // Get location predictions from loc_data.
 //    loc_data: num x num_preds_per_class * num_loc_classes * 4 blob.
@@ -278,6 +371,13 @@ void GetConfidenceScores(const Dtype* conf_data, const int num,
       const int num_preds_per_class, const int num_classes,
       const bool class_major, vector<map<int, vector<float> > >* conf_scores);
 
+// Permute data from num x num_data x num_classes x num_dim to
+// num x num_classes x num_data x num_dim, e.g. to make the confidences of a
+// class contiguous. count is the total number of elements.
+template <typename Dtype>
+void PermuteData(const int count, const Dtype* data, const int num_classes,
+      const int num_data, const int num_dim, Dtype* new_data);
+
 // Compute the confidence loss for each prior from conf_data.
 //    conf_data: num x num_preds_per_class * num_classes blob.
 //    num: the number of images.
@@ -312,6 +412,42 @@ void ComputeConfLoss(const Dtype* conf_data, const int num,
       const int background_label_id, const ConfLossType loss_type,
       vector<vector<float> >* all_conf_loss);
 
+// Compute the softmax probabilities of every prior from conf_data in one
+// pass, and the softmax loss of each prior for the label of its matched
+// ground truth, or background_label_id if it is not matched. The loss is the
+// one SoftmaxWithLoss computes from the probabilities, so that it can also be
+// used as the confidence loss of the matched and mined priors. Images are
+// processed in parallel.
+//    conf_data: num x num_priors * num_classes blob.
+//    all_match_indices: the matches of the priors, with shared location.
+//    gt_labels, gt_start: the ground truth labels, as retrieved by the flat
+//      GetGroundTruth.
+//    prob_data: stores the num x num_priors x num_classes probabilities.
+//    conf_loss: stores the num x num_priors losses.
+template <typename Dtype>
+void ComputeConfLossSoftmax(const Dtype* conf_data, const int num,
+      const int num_priors, const int num_classes,
+      const int background_label_id,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const vector<int>& gt_labels, const vector<int>& gt_start,
+      Dtype* prob_data, Dtype* conf_loss);
+
+// Mine hard negatives like MineHardExamples with MAX_NEGATIVE and no nms,
+// from the losses of ComputeConfLossSoftmax: the num_pos * neg_pos_ratio
+// eligible priors of each image with the highest loss are selected with
+// nth_element, the lowest index first among equal losses. Images are
+// processed in parallel.
+//    conf_loss: num x num_priors losses.
+//    all_neg_indices: stores the ascending indices of the negatives of each
+//      image.
+template <typename Dtype>
+void MineHardNegatives(const Dtype* conf_loss, const int num,
+      const int num_priors,
+      const vector<map<int, vector<float> > >& all_match_overlaps,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const MultiBoxLossParameter& multibox_loss_param, int* num_negs,
+      vector<vector<int> >* all_neg_indices);
+
 // Encode the confidence predictions and ground truth for each matched prior.
 //    conf_data: num x num_priors * num_classes blob.
 //    num: number of images.
@@ -340,6 +476,18 @@ void GetPriorBBoxes(const Dtype* prior_data, const int num_priors,
       vector<NormalizedBBox>* prior_bboxes,
       vector<vector<float> >* prior_variances);
 
+// Get prior bounding boxes from prior_data in flat arrays. They are computed
+// once per distinct prior data and shared by all the callers which hold them,
+// e.g. the layers of the train and test nets.
+//    prior_data: 1 x 2 x num_priors * 4 x 1 blob.
+//    last: the prior bboxes the caller got last time, if any. They are
+//      returned without locking when prior_data has not changed.
+template <typename Dtype>
+shared_ptr<const PriorBBoxes> GetPriorBBoxes(const Dtype* prior_data,
+      const int num_priors,
+      const shared_ptr<const PriorBBoxes>& last =
+          shared_ptr<const PriorBBoxes>());
+
 // Get detection results from det_data.
 //    det_data: 1 x 1 x num_det x 7 blob.
 //    num_det: the number of detections.
@@ -435,6 +583,71 @@ void ApplyNMSFast(const Dtype* bboxes, const Dtype* scores, const int num,
       const float score_threshold, const float nms_threshold,
       const float eta, const int top_k, vector<int>* indices);
 
+// Same as above, but uses score_index_vec as scratch space so that repeated
+// calls do not allocate memory.
+template <typename Dtype>
+void ApplyNMSFast(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const float nms_threshold,
+      const float eta, const int top_k,
+      vector<pair<Dtype, int> >* score_index_vec, vector<int>* indices);
+
+// Scratch space of the raw data nms functions below, reused across calls.
+template <typename Dtype>
+struct NMSBuffer {
+  // Sorted (score, index) pairs of the candidate bboxes.
+  vector<pair<Dtype, int> > score_index;
+  // Per candidate values, e.g. the compensating overlaps of matrix nms.
+  vector<Dtype> values;
+  // Bitmask of the pairwise overlaps above the threshold.
+  vector<uint32_t> mask;
+};
+
+// Do greedy non maximum suppression on raw data like ApplyNMSFast with
+// eta = 1. It first computes a bitmask of which candidate pairs overlap more
+// than nms_threshold, one row of 32-bit words per candidate, in blocks of 32
+// columns so that the column bboxes stay in cache, and then sweeps the rows.
+//    bboxes, scores, num, score_threshold, top_k, indices: see ApplyNMSFast.
+//    buffer: scratch space.
+template <typename Dtype>
+void ApplyNMSBitmask(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const float nms_threshold, const int top_k,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices);
+
+// Do Soft-NMS (Bodla et al.) on raw data: repeatedly keep the bbox with the
+// highest score and decay the scores of the remaining bboxes by their
+// overlap with it, dropping those that fall to score_threshold.
+//    decay, sigma: see NonMaximumSuppressionParameter.
+//    indices: the kept indices in the order they were picked, which is
+//      descending order of the new scores.
+//    new_scores: the decayed scores of the kept bboxes.
+template <typename Dtype>
+void ApplySoftNMS(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const float nms_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices,
+      vector<Dtype>* new_scores);
+
+// Do Matrix NMS (Wang et al., SOLOv2) on raw data: the score of each bbox is
+// decayed by its overlaps with all the higher scored bboxes, compensated by
+// how much these were suppressed themselves. All bboxes are processed in
+// parallel. The kept indices are sorted by descending new score.
+template <typename Dtype>
+void ApplyMatrixNMS(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices,
+      vector<Dtype>* new_scores);
+
+// Do non maximum suppression on raw data with the algorithm selected in
+// nms_param. new_scores stores the scores of the kept bboxes, which are only
+// changed by SOFT and MATRIX.
+template <typename Dtype>
+void ApplyNMS(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold,
+      const NonMaximumSuppressionParameter& nms_param,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices,
+      vector<Dtype>* new_scores);
+
 // Compute cumsum of a set of pairs.
 void CumSum(const vector<pair<float, int> >& pairs, vector<int>* cumsum);
 
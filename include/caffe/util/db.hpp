@@ -18,8 +18,17 @@ class Cursor {
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  // The value in the memory of the db, without the copy made by value(). It
+  // is only valid until the cursor is moved.
+  virtual const char* value_data() = 0;
+  virtual size_t value_size() = 0;
   virtual bool valid() = 0;
 
+  // Parses the value straight from the memory of the db.
+  bool ParseValue(google::protobuf::MessageLite* message) {
+    return message->ParseFromArray(value_data(), value_size());
+  }
+
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
 
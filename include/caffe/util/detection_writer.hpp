@@ -0,0 +1,84 @@
+#ifndef CAFFE_UTIL_DETECTION_WRITER_H_
+#define CAFFE_UTIL_DETECTION_WRITER_H_
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Writes detection results in the VOC, COCO or ILSVRC format from a
+ * background thread.
+ *
+ * Detections are appended to the output files as they are committed, so the
+ * memory use does not grow with the size of the test set. A pass over the
+ * test set is ended by Commit(true): the files are then completed, and the
+ * next detections start new files.
+ */
+class DetectionWriter : public InternalThread {
+ public:
+  DetectionWriter(const string& output_directory,
+      const string& output_name_prefix, const string& output_format,
+      const map<int, string>& label_to_name, int num_classes,
+      int background_label_id);
+  // Writes all the added detections and closes the files.
+  virtual ~DetectionWriter();
+
+  // Start the detections of a new image.
+  void AddImage(const string& name);
+  // Add a detection of the last added image. The box is in image pixels.
+  void AddDetection(int label, float score, float xmin, float ymin,
+      float xmax, float ymax);
+  // Hand the added detections over to the writing thread. Blocks only if
+  // the thread is several commits behind.
+  void Commit(bool end_of_pass);
+
+  struct Detection {
+    int image;
+    int label;
+    float score;
+    float bbox[4];
+  };
+  struct Batch {
+    vector<string> images;
+    vector<Detection> detections;
+    bool end_of_pass;
+    bool stop;
+  };
+
+ protected:
+  virtual void InternalThreadEntry();
+  void Open();
+  void Write(const Batch& batch);
+  void Close();
+
+  const string output_directory_;
+  const string output_name_prefix_;
+  const string output_format_;
+  map<int, string> label_to_name_;
+  const int num_classes_;
+  const int background_label_id_;
+
+  // The batch being filled by the caller.
+  Batch* batch_;
+  BlockingQueue<Batch*> free_;
+  BlockingQueue<Batch*> full_;
+
+  // Files of the current pass, only used by the writing thread. VOC has one
+  // file per label, the other formats a single one.
+  vector<shared_ptr<std::ofstream> > outfiles_;
+  bool is_open_;
+  int num_written_;
+
+DISABLE_COPY_AND_ASSIGN(DetectionWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DETECTION_WRITER_H_
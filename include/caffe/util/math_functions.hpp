@@ -142,6 +142,48 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Sparse counterparts of caffe_cpu_gemv/gemm for matrices stored in CSR form
+// (zero-based csrrowptr/csrcolind, as produced by Blob::ToProto). A is M x N
+// for csrmv and M x K for csrmm; op(A) follows TransA. B, C are dense
+// row-major, with C = alpha * op(A) * B + beta * C and op(A) * B being
+// M x N. Rows are processed in parallel when built with OpenMP.
+template <typename Dtype>
+void caffe_cpu_csrmv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+    const Dtype alpha, const Dtype* csrval, const int* csrrowptr,
+    const int* csrcolind, const int nnz, const Dtype* x, const Dtype beta,
+    Dtype* y);
+
+template <typename Dtype>
+void caffe_cpu_csrmm(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+    const int K, const Dtype alpha, const Dtype* csrval, const int* csrrowptr,
+    const int* csrcolind, const Dtype* B, const Dtype beta, Dtype* C);
+
+// Converts the dense row-major M x N matrix A to CSR, keeping its non-zero
+// entries, and returns their number. csrrowptr (M + 1 entries) is always
+// filled; csrval and csrcolind are only filled when non-NULL, in which case
+// they must hold as many entries as a prior counting call returned.
+template <typename Dtype>
+int caffe_cpu_dense2csr(const int M, const int N, const Dtype* A,
+    Dtype* csrval, int* csrrowptr, int* csrcolind);
+
+// Cache-blocked out-of-place transpose of the rows x cols matrix A into B.
+template <typename Dtype>
+void caffe_cpu_transpose(const int rows, const int cols, const Dtype* A,
+    Dtype* B);
+
+// Transposes each of the num consecutive rows x cols matrices of A into B, as
+// caffe_cpu_transpose, sharing the work of all of them between the threads.
+template <typename Dtype>
+void caffe_cpu_batch_transpose(const int num, const int rows, const int cols,
+    const Dtype* A, Dtype* B);
+
+// Y[i] = alpha * X[i] + Y[i] where bit i of the packed mask is set (bit i % 32
+// of word i / 32), and Y[i] = 0 elsewhere: the update of a pruned blob in one
+// pass over its data.
+template <typename Dtype>
+void caffe_cpu_bitmask_axpy(const int N, const Dtype alpha, const Dtype* X,
+    const uint32_t* mask, Dtype* Y);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -171,6 +213,10 @@ template <typename Dtype>
 void caffe_gpu_axpby(const int N, const Dtype alpha, const Dtype* X,
     const Dtype beta, Dtype* Y);
 
+template <typename Dtype>
+void caffe_gpu_bitmask_axpy(const int N, const Dtype alpha, const Dtype* X,
+    const uint32_t* mask, Dtype* Y);
+
 void caffe_gpu_memcpy(const size_t N, const void *X, void *Y);
 
 template <typename Dtype>
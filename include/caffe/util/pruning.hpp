@@ -0,0 +1,26 @@
+#ifndef CAFFE_UTIL_PRUNING_H_
+#define CAFFE_UTIL_PRUNING_H_
+
+#include "caffe/blob.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Check if the mask of the pruned layer is recomputed at iteration iter.
+bool IsPruningIter(const PruningParameter& param, const int iter);
+
+// Get the sparsity of the mask at iteration iter, i.e. the one set at the
+// last pruning iteration; initial_sparsity before start_iter.
+float PruningSparsity(const PruningParameter& param, const int iter);
+
+// Recompute the mask of a PRUNE-mode blob so that a fraction sparsity of its
+// weights (or of its rows or input channels, for the structured criteria) is
+// pruned, and zero the pruned weights. Returns the number of weights the mask
+// keeps.
+template <typename Dtype>
+int PruneBlob(const PruningParameter::Criterion criterion,
+              const float sparsity, Blob<Dtype>* blob);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PRUNING_H_
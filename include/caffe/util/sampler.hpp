@@ -4,29 +4,70 @@
 #include <vector>
 
 #include "glog/logging.h"
+#include "google/protobuf/repeated_field.h"
 
 #include "caffe/caffe.hpp"
 
+using google::protobuf::RepeatedPtrField;
+
 namespace caffe {
 
 // Find all annotated NormalizedBBox.
 void GroupObjectBBoxes(const AnnotatedDatum& anno_datum,
                        vector<NormalizedBBox>* object_bboxes);
+void GroupObjectBBoxes(const RepeatedPtrField<AnnotationGroup>& anno_groups,
+                       vector<NormalizedBBox>* object_bboxes);
 
 // Check if a sampled bbox satisfy the constraints with all object bboxes.
 bool SatisfySampleConstraint(const NormalizedBBox& sampled_bbox,
                              const vector<NormalizedBBox>& object_bboxes,
                              const SampleConstraint& sample_constraint);
 
+/**
+ * @brief Checks sampled bboxes against the object bboxes of an image.
+ *
+ * The object bboxes are stored as contiguous arrays of coordinates, so that
+ * the intersections of a sampled bbox with all of them are computed in one
+ * loop the compiler can vectorize, without going through NormalizedBBox.
+ */
+class SampleConstraintChecker {
+ public:
+  explicit SampleConstraintChecker(
+      const vector<NormalizedBBox>& object_bboxes);
+
+  // Same as SatisfySampleConstraint, for sampled_bbox given as
+  // [xmin, ymin, xmax, ymax].
+  bool Satisfy(const float* sampled_bbox,
+               const SampleConstraint& sample_constraint);
+
+ protected:
+  vector<float> xmin_;
+  vector<float> ymin_;
+  vector<float> xmax_;
+  vector<float> ymax_;
+  vector<float> size_;
+  // Intersection sizes with the last checked sampled bbox.
+  vector<float> intersect_size_;
+};
+
 // Sample a NormalizedBBox given the specifictions.
 void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox);
 
+// Sample a bbox [xmin, ymin, xmax, ymax] given the specifictions.
+void SampleBBox(const Sampler& sampler, float* sampled_bbox);
+
 // Generate samples from NormalizedBBox using the BatchSampler.
 void GenerateSamples(const NormalizedBBox& source_bbox,
                      const vector<NormalizedBBox>& object_bboxes,
                      const BatchSampler& batch_sampler,
                      vector<NormalizedBBox>* sampled_bboxes);
 
+// Same as above, with the object bboxes already hoisted into checker.
+void GenerateSamples(const NormalizedBBox& source_bbox,
+                     SampleConstraintChecker* checker,
+                     const BatchSampler& batch_sampler,
+                     vector<NormalizedBBox>* sampled_bboxes);
+
 // Generate samples from AnnotatedDatum using the BatchSampler.
 // All sampled bboxes which satisfy the constraints defined in BatchSampler
 // is stored in sampled_bboxes.
@@ -34,6 +75,11 @@ void GenerateBatchSamples(const AnnotatedDatum& anno_datum,
                           const vector<BatchSampler>& batch_samplers,
                           vector<NormalizedBBox>* sampled_bboxes);
 
+// Generate samples from the annotation of an image using the BatchSampler.
+void GenerateBatchSamples(const RepeatedPtrField<AnnotationGroup>& anno_groups,
+                          const vector<BatchSampler>& batch_samplers,
+                          vector<NormalizedBBox>* sampled_bboxes);
+
 }  // namespace caffe
 
 #endif  // CAFFE_UTIL_SAMPLER_H_
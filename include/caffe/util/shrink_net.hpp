@@ -0,0 +1,26 @@
+#ifndef CAFFE_UTIL_SHRINK_NET_H_
+#define CAFFE_UTIL_SHRINK_NET_H_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Physically remove the output channels of Convolution and InnerProduct
+// layers that structured pruning left without effect: channels whose filter
+// is all zero (their constant bias is folded into the consumers' biases), or
+// that every consuming layer ignores. The change is propagated through
+// channel-wise layers in between (ReLU, Dropout, Pooling, BatchNorm, Scale,
+// Normalize) and the input channels of consuming Convolution/InnerProduct
+// layers, such as the SSD mbox_loc/mbox_conf heads. Layers which only read the
+// shape, such as PriorBox, are ignored. Layers feeding any other kind of
+// layer are left unchanged.
+//
+// param is the net definition and weights the trained model; the shrunk
+// versions are written to shrunk_param and shrunk_weights. Returns the
+// number of channels removed.
+int ShrinkNet(const NetParameter& param, const NetParameter& weights,
+              NetParameter* shrunk_param, NetParameter* shrunk_weights);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SHRINK_NET_H_
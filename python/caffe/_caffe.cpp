@@ -238,6 +238,20 @@ bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+// The packed pruning mask as a flat uint32 array viewing the blob's memory;
+// bit i % 32 of word i / 32 keeps element i.
+bp::object Blob_Mask(bp::object pyblob) {
+  shared_ptr<Blob<Dtype> > blob =
+    bp::extract<shared_ptr<Blob<Dtype> > >(pyblob);
+  npy_intp words = blob->mask_words();
+  PyObject* arr_obj = PyArray_SimpleNewFromData(1, &words, NPY_UINT32,
+                                                blob->mutable_cpu_mask());
+  Py_INCREF(pyblob.ptr());
+  PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(arr_obj),
+      pyblob.ptr());
+  return bp::object(bp::handle<>(arr_obj));
+}
+
 bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   if (bp::len(kwargs) > 0) {
     throw std::runtime_error("BlobVec.add_blob takes no kwargs");
@@ -355,8 +369,7 @@ BOOST_PYTHON_MODULE(_caffe) {
           NdarrayCallPolicies()))
     .add_property("diff",     bp::make_function(&Blob<Dtype>::mutable_cpu_diff,
           NdarrayCallPolicies()))
-	.add_property("mask",     bp::make_function(&Blob<Dtype>::mutable_cpu_mask,
-          NdarrayCallPolicies()))
+    .add_property("mask",     &Blob_Mask)
     .add_property("csrval",   bp::make_function(&Blob<Dtype>::mutable_cpu_csrval,
           NdarrayCallPolicies()));
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Blob<Dtype>);
@@ -794,7 +794,7 @@ def CreateMultiBoxHead(net, data_layer="data", num_classes=[], from_layers=[],
         use_scale=True, min_sizes=[], max_sizes=[], prior_variance = [0.1],
         aspect_ratios=[], steps=[], img_height=0, img_width=0, share_location=True,
         flip=True, clip=True, offset=0.5, inter_layer_depth=[], kernel_size=1, pad=0,
-        conf_postfix='', loc_postfix='', **bn_param):
+        conf_postfix='', loc_postfix='', fuse_head=False, **bn_param):
     assert num_classes, "must provide num_classes"
     assert num_classes > 0, "num_classes must be positive number"
     if normalizations:
@@ -868,22 +868,30 @@ def CreateMultiBoxHead(net, data_layer="data", num_classes=[], from_layers=[],
             num_loc_output *= num_classes
         ConvBNLayer(net, from_layer, name, use_bn=use_batchnorm, use_relu=False, lr_mult=lr_mult,
             num_output=num_loc_output, kernel_size=kernel_size, pad=pad, stride=1, **bn_param)
-        permute_name = "{}_perm".format(name)
-        net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
-        flatten_name = "{}_flat".format(name)
-        net[flatten_name] = L.Flatten(net[permute_name], axis=1)
-        loc_layers.append(net[flatten_name])
+        if fuse_head:
+            # MultiBoxHead permutes, flattens and concatenates at once.
+            loc_layers.append(net[name])
+        else:
+            permute_name = "{}_perm".format(name)
+            net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
+            flatten_name = "{}_flat".format(name)
+            net[flatten_name] = L.Flatten(net[permute_name], axis=1)
+            loc_layers.append(net[flatten_name])
 
         # Create confidence prediction layer.
         name = "{}_mbox_conf{}".format(from_layer, conf_postfix)
         num_conf_output = num_priors_per_location * num_classes;
         ConvBNLayer(net, from_layer, name, use_bn=use_batchnorm, use_relu=False, lr_mult=lr_mult,
             num_output=num_conf_output, kernel_size=kernel_size, pad=pad, stride=1, **bn_param)
-        permute_name = "{}_perm".format(name)
-        net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
-        flatten_name = "{}_flat".format(name)
-        net[flatten_name] = L.Flatten(net[permute_name], axis=1)
-        conf_layers.append(net[flatten_name])
+        if fuse_head:
+            # MultiBoxHead permutes, flattens and concatenates at once.
+            conf_layers.append(net[name])
+        else:
+            permute_name = "{}_perm".format(name)
+            net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
+            flatten_name = "{}_flat".format(name)
+            net[flatten_name] = L.Flatten(net[permute_name], axis=1)
+            conf_layers.append(net[flatten_name])
 
         # Create prior generation layer.
         name = "{}_mbox_priorbox".format(from_layer)
@@ -908,26 +916,38 @@ def CreateMultiBoxHead(net, data_layer="data", num_classes=[], from_layers=[],
             num_obj_output = num_priors_per_location * 2;
             ConvBNLayer(net, from_layer, name, use_bn=use_batchnorm, use_relu=False, lr_mult=lr_mult,
                 num_output=num_obj_output, kernel_size=kernel_size, pad=pad, stride=1, **bn_param)
-            permute_name = "{}_perm".format(name)
-            net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
-            flatten_name = "{}_flat".format(name)
-            net[flatten_name] = L.Flatten(net[permute_name], axis=1)
-            objectness_layers.append(net[flatten_name])
+            if fuse_head:
+                objectness_layers.append(net[name])
+            else:
+                permute_name = "{}_perm".format(name)
+                net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
+                flatten_name = "{}_flat".format(name)
+                net[flatten_name] = L.Flatten(net[permute_name], axis=1)
+                objectness_layers.append(net[flatten_name])
 
     # Concatenate priorbox, loc, and conf layers.
     mbox_layers = []
     name = "mbox_loc"
-    net[name] = L.Concat(*loc_layers, axis=1)
+    if fuse_head:
+        net[name] = L.MultiBoxHead(*loc_layers)
+    else:
+        net[name] = L.Concat(*loc_layers, axis=1)
     mbox_layers.append(net[name])
     name = "mbox_conf"
-    net[name] = L.Concat(*conf_layers, axis=1)
+    if fuse_head:
+        net[name] = L.MultiBoxHead(*conf_layers)
+    else:
+        net[name] = L.Concat(*conf_layers, axis=1)
     mbox_layers.append(net[name])
     name = "mbox_priorbox"
     net[name] = L.Concat(*priorbox_layers, axis=2)
     mbox_layers.append(net[name])
     if use_objectness:
         name = "mbox_objectness"
-        net[name] = L.Concat(*objectness_layers, axis=1)
+        if fuse_head:
+            net[name] = L.MultiBoxHead(*objectness_layers)
+        else:
+            net[name] = L.Concat(*objectness_layers, axis=1)
         mbox_layers.append(net[name])
 
     return mbox_layers
@@ -4,7 +4,6 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
-#include "caffe/caffe.hpp"
 #include "caffe/util/math_functions.hpp"
 namespace caffe {
 
@@ -42,23 +41,60 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
 	if (count_ > capacity_) {
 		capacity_ = count_;
 		data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+		if (host_allocator_) {
+			data_->set_host_allocator(host_allocator_);
+		}
 		diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
-		if(sparse_&&(FLAGS_step!="three"))
-			mask_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+	}
+	if(sparsity_mode_==SparsityParameter::PRUNE&&
+	        (!mask_||mask_->size()<mask_words()*sizeof(uint32_t))) {
+		InitMask();
+	}
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_host_allocator(
+		const shared_ptr<HostAllocator>& allocator) {
+	host_allocator_ = allocator;
+	data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+	data_->set_host_allocator(host_allocator_);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::InitMask() {
+	mask_.reset(new SyncedMemory(std::max(mask_words(), 1)*sizeof(uint32_t)));
+	uint32_t* mask_vec=mutable_cpu_mask();
+	caffe_memset(mask_words()*sizeof(uint32_t), 0xFF, mask_vec);
+	// Bits past count_ stay clear so that mask_nnz can count whole words.
+	if(count_%32!=0) {
+		mask_vec[count_/32]=(1u<<(count_%32))-1;
+	}
+}
 
+template <typename Dtype>
+void Blob<Dtype>::set_sparsity_mode(SparsityParameter::Mode mode) {
+	sparsity_mode_=mode;
+	if(mode!=SparsityParameter::PRUNE) {
+		mask_.reset();
+	} else if(!mask_||mask_->size()<mask_words()*sizeof(uint32_t)) {
+		InitMask();
 	}
 }
 
 template <typename Dtype>
-void Blob<Dtype>::Addmask(const vector<int>& shape) {
-	if(count_>=capacity_) {
-		capacity_=count_;
-//    if(sparse_&&(FLAGS_step!="three"))
-		mask_.reset(new SyncedMemory(capacity_*sizeof(Dtype)));
-		Dtype* mask=mutable_cpu_mask();
-		for(int i=0; i<count_; i++)
-			mask[i]=1;
+int Blob<Dtype>::mask_nnz() const {
+	if(!mask_) {
+		return count_;
+	}
+	const uint32_t* mask_vec=cpu_mask();
+	int nnz=0;
+	for(int i=0; i<mask_words(); i++) {
+		uint32_t bits=mask_vec[i];
+		for(; bits; nnz++) {
+			bits&=bits-1;
+		}
 	}
+	return nnz;
 }
 
 
@@ -81,18 +117,21 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
                   const int width)
 // capacity_ must be initialized before calling Reshape
-	: capacity_(0) {
-	if(!sparse_||FLAGS_step!="three")
-		Reshape(num, channels, height, width);
+	: sparsity_mode_(SparsityParameter::DENSE), capacity_(0), nnz_(0) {
+	Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
 // capacity_ must be initialized before calling Reshape
-	: capacity_(0),sparse_(false) {
-	if(!sparse_||FLAGS_step!="three") {
-		Reshape(shape);
-	}
+	: sparsity_mode_(SparsityParameter::DENSE), capacity_(0), nnz_(0) {
+	Reshape(shape);
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::use_csr() const {
+	return sparsity_mode_ == SparsityParameter::SPARSE &&
+	       csrval_ && csrrowptr_ && csrcolind_;
 }
 
 template <typename Dtype>
@@ -132,14 +171,14 @@ const Dtype* Blob<Dtype>::gpu_diff() const {
 }
 
 template <typename Dtype>
-const Dtype* Blob<Dtype>::cpu_mask() const {
+const uint32_t* Blob<Dtype>::cpu_mask() const {
 	CHECK(mask_);
-	return (const Dtype*)mask_->cpu_data();
+	return (const uint32_t*)mask_->cpu_data();
 }
 template <typename Dtype>
-const Dtype* Blob<Dtype>::gpu_mask()const {
+const uint32_t* Blob<Dtype>::gpu_mask()const {
 	CHECK(mask_);
-	return (const Dtype*)mask_->gpu_data();
+	return (const uint32_t*)mask_->gpu_data();
 }
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_csrval() const {
@@ -196,15 +235,15 @@ Dtype* Blob<Dtype>::mutable_gpu_diff() {
 }
 
 template <typename Dtype>
-Dtype* Blob<Dtype>::mutable_cpu_mask() {
+uint32_t* Blob<Dtype>::mutable_cpu_mask() {
 	CHECK(mask_);
-	return static_cast<Dtype*>(mask_->mutable_cpu_data());
+	return static_cast<uint32_t*>(mask_->mutable_cpu_data());
 }
 
 template <typename Dtype>
-Dtype* Blob<Dtype>::mutable_gpu_mask() {
+uint32_t* Blob<Dtype>::mutable_gpu_mask() {
 	CHECK(mask_);
-	return static_cast<Dtype*>(mask_->mutable_gpu_data());
+	return static_cast<uint32_t*>(mask_->mutable_gpu_data());
 }
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_csrval() {
@@ -278,30 +317,32 @@ void Blob<Dtype>::Update() {
 	switch (data_->head()) {
 	case SyncedMemory::HEAD_AT_CPU:
 		// perform computation on CPU
-		caffe_axpy<Dtype>(count_, Dtype(-1),
-		                  static_cast<const Dtype*>(diff_->cpu_data()),
-		                  static_cast<Dtype*>(data_->mutable_cpu_data()));
-		if(sparse_&&FLAGS_step!="three")
-			caffe_mul<Dtype>(count_,
-			                 static_cast<const Dtype*>(mask_->cpu_data()),
-			                 static_cast<const Dtype*>(data_->cpu_data()),
-			                 static_cast<Dtype*>(data_->mutable_cpu_data()));
+		if(mask_) {
+			// Pruned weights are zeroed in the same pass as the step.
+			caffe_cpu_bitmask_axpy<Dtype>(count_, Dtype(-1),
+			                              static_cast<const Dtype*>(diff_->cpu_data()),
+			                              cpu_mask(),
+			                              static_cast<Dtype*>(data_->mutable_cpu_data()));
+		} else {
+			caffe_axpy<Dtype>(count_, Dtype(-1),
+			                  static_cast<const Dtype*>(diff_->cpu_data()),
+			                  static_cast<Dtype*>(data_->mutable_cpu_data()));
+		}
 		break;
 	case SyncedMemory::HEAD_AT_GPU:
 	case SyncedMemory::SYNCED:
 #ifndef CPU_ONLY
 		// perform computation on GPU
-		caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
-		                      static_cast<const Dtype*>(diff_->gpu_data()),
-		                      static_cast<Dtype*>(data_->mutable_gpu_data()));
-		// for(int c_idx=0;c_idx<count_;c_idx++)
-		//   std::cout<<cpu_mask()[c_idx]<<" ";
-		// std::cout<<std::endl;
-		if(sparse_&&FLAGS_step!="three")
-			caffe_gpu_mul<Dtype>(count_,
-			                     static_cast<const Dtype*>(mask_->gpu_data()),
-			                     static_cast<const Dtype*>(data_->gpu_data()),
-			                     static_cast<Dtype*>(data_->mutable_gpu_data()));
+		if(mask_) {
+			caffe_gpu_bitmask_axpy<Dtype>(count_, Dtype(-1),
+			                              static_cast<const Dtype*>(diff_->gpu_data()),
+			                              gpu_mask(),
+			                              static_cast<Dtype*>(data_->mutable_gpu_data()));
+		} else {
+			caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
+			                      static_cast<const Dtype*>(diff_->gpu_data()),
+			                      static_cast<Dtype*>(data_->mutable_gpu_data()));
+		}
 #else
 		NO_GPU;
 #endif
@@ -384,43 +425,6 @@ Dtype Blob<Dtype>::asum_diff() const {
 	}
 	return 0;
 }
-template <> unsigned int Blob<unsigned int>::asum_mask() const {
-	NOT_IMPLEMENTED;
-	return 0;
-}
-
-template <> int Blob<int>::asum_mask() const {
-	NOT_IMPLEMENTED;
-	return 0;
-}
-
-template <typename Dtype>
-Dtype Blob<Dtype>::asum_mask() const {
-	if (!mask_) {
-		return 0;
-	}
-	switch (mask_->head()) {
-	case SyncedMemory::HEAD_AT_CPU:
-		return caffe_cpu_asum(count_, cpu_mask());
-	case SyncedMemory::HEAD_AT_GPU:
-	case SyncedMemory::SYNCED:
-#ifndef CPU_ONLY
-		{
-			Dtype asum;
-			caffe_gpu_asum(count_, gpu_mask(), &asum);
-			return asum;
-		}
-#else
-		NO_GPU;
-#endif
-	case SyncedMemory::UNINITIALIZED:
-		return 0;
-	default:
-		LOG(FATAL) << "Unknown SyncedMemory head state: " << mask_->head();
-	}
-	return 0;
-}
-
 template <> unsigned int Blob<unsigned int>::sumsq_data() const {
 	NOT_IMPLEMENTED;
 	return 0;
@@ -522,45 +526,6 @@ Dtype Blob<Dtype>::sumsq_diff() const {
 	}
 	return sumsq;
 }
-template <> unsigned int Blob<unsigned int>::sumsq_mask() const {
-	NOT_IMPLEMENTED;
-	return 0;
-}
-
-template <> int Blob<int>::sumsq_mask() const {
-	NOT_IMPLEMENTED;
-	return 0;
-}
-
-template <typename Dtype>
-Dtype Blob<Dtype>::sumsq_mask() const {
-	Dtype sumsq;
-	const Dtype* mask;
-	if (!mask_) {
-		return 0;
-	}
-	switch (mask_->head()) {
-	case SyncedMemory::HEAD_AT_CPU:
-		mask = cpu_mask();
-		sumsq = caffe_cpu_dot(count_, mask, mask);
-		break;
-	case SyncedMemory::HEAD_AT_GPU:
-	case SyncedMemory::SYNCED:
-#ifndef CPU_ONLY
-		mask = gpu_mask();
-		caffe_gpu_dot(count_, mask, mask, &sumsq);
-		break;
-
-#else
-		NO_GPU;
-#endif
-	case SyncedMemory::UNINITIALIZED:
-		return 0;
-	default:
-		LOG(FATAL) << "Unknown SyncedMemory head state: " << mask_->head();
-	}
-	return sumsq;
-}
 //template <typename Dtype>
 //Dtype Blob<Dtype>::sumsq_csrval() const {
 //  Dtype sumsq;
@@ -658,41 +623,6 @@ void Blob<Dtype>::scale_diff(Dtype scale_factor) {
 		LOG(FATAL) << "Unknown SyncedMemory head state: " << diff_->head();
 	}
 }
-template <> void Blob<unsigned int>::scale_mask(unsigned int scale_factor) {
-	NOT_IMPLEMENTED;
-}
-
-template <> void Blob<int>::scale_mask(int scale_factor) {
-	NOT_IMPLEMENTED;
-}
-
-template <typename Dtype>
-void Blob<Dtype>::scale_mask(Dtype scale_factor) {
-	Dtype* mask;
-	if (!mask_) {
-		return;
-	}
-	switch (mask_->head()) {
-	case SyncedMemory::HEAD_AT_CPU:
-		mask = mutable_cpu_mask();
-		caffe_scal(count_, scale_factor, mask);
-		return;
-	case SyncedMemory::HEAD_AT_GPU:
-	case SyncedMemory::SYNCED:
-#ifndef CPU_ONLY
-		mask = mutable_gpu_mask();
-		caffe_gpu_scal(count_, scale_factor, mask);
-		return;
-#else
-		NO_GPU;
-#endif
-	case SyncedMemory::UNINITIALIZED:
-		return;
-	default:
-		LOG(FATAL) << "Unknown SyncedMemory head state: " << mask_->head();
-	}
-}
-
 template <typename Dtype>
 bool Blob<Dtype>::ShapeEquals(const BlobProto& other) {
 	if (other.has_num() || other.has_channels() ||
@@ -734,8 +664,9 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
 		} else {
 			caffe_copy(count_, source.gpu_data(),
 			           static_cast<Dtype*>(data_->mutable_gpu_data()));
-			caffe_copy(count_,source.gpu_mask(),
-			           static_cast<Dtype*>(mask_->mutable_gpu_data()));
+			if(mask_&&source.mask_) {
+				caffe_copy(mask_words(), source.gpu_mask(), mutable_gpu_mask());
+			}
 		}
 		break;
 	case Caffe::CPU:
@@ -745,8 +676,9 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
 		} else {
 			caffe_copy(count_, source.cpu_data(),
 			           static_cast<Dtype*>(data_->mutable_cpu_data()));
-			caffe_copy(count_,source.cpu_mask(),
-			           static_cast<Dtype*>(mask_->mutable_cpu_data()));
+			if(mask_&&source.mask_) {
+				caffe_copy(mask_words(), source.cpu_mask(), mutable_cpu_mask());
+			}
 		}
 		break;
 	default:
@@ -754,112 +686,190 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
 	}
 }
 
+// Writes the CSR row pointers and the column indices of each row as gaps to
+// the previous index, which keeps most of them within one or two varint bytes.
+static void CsrIndicesToProto(const int rows, const int* csrrowptr,
+                              const int* csrcolind, BlobProto* proto) {
+	for (int i = 0; i < rows + 1; ++i) {
+		proto->add_csrrowptr(csrrowptr[i]);
+	}
+	for (int i = 0; i < rows; ++i) {
+		int prev = 0;
+		for (int j = csrrowptr[i]; j < csrrowptr[i + 1]; ++j) {
+			proto->add_csrcolind_delta(csrcolind[j] - prev);
+			prev = csrcolind[j];
+		}
+	}
+	proto->set_nnz(csrrowptr[rows]);
+	proto->set_sparse(true);
+	proto->set_storage(BlobProto::CSR);
+}
+
+// Reads the column indices written by CsrIndicesToProto, or the legacy
+// absolute csrcolind field.
+static void CsrIndicesFromProto(const BlobProto& proto, const int rows,
+                                const int* csrrowptr, int* csrcolind) {
+	if (proto.csrcolind_delta_size() > 0) {
+		CHECK_EQ(proto.csrcolind_delta_size(), proto.nnz());
+		for (int i = 0; i < rows; ++i) {
+			int col = 0;
+			for (int j = csrrowptr[i]; j < csrrowptr[i + 1]; ++j) {
+				col += proto.csrcolind_delta(j);
+				csrcolind[j] = col;
+			}
+		}
+	} else {
+		CHECK_EQ(proto.csrcolind_size(), proto.nnz());
+		for (int i = 0; i < proto.nnz(); ++i) {
+			csrcolind[i] = proto.csrcolind(i);
+		}
+	}
+}
+
 template <typename Dtype>
 void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
-	if(FLAGS_step!="three"||!proto.sparse()) {
-		if (reshape) {
-			vector<int> shape;
-			if (proto.has_num() || proto.has_channels() ||
-			        proto.has_height() || proto.has_width()) {
-				// Using deprecated 4D Blob dimensions --
-				// shape is (num, channels, height, width).
-				shape.resize(4);
-				shape[0] = proto.num();
-				shape[1] = proto.channels();
-				shape[2] = proto.height();
-				shape[3] = proto.width();
-			} else {
-				shape.resize(proto.shape().dim_size());
-				for (int i = 0; i < proto.shape().dim_size(); ++i) {
-					shape[i] = proto.shape().dim(i);
-				}
-			}
-			Reshape(shape);
+	if (reshape) {
+		vector<int> shape;
+		if (proto.has_num() || proto.has_channels() ||
+		        proto.has_height() || proto.has_width()) {
+			// Using deprecated 4D Blob dimensions --
+			// shape is (num, channels, height, width).
+			shape.resize(4);
+			shape[0] = proto.num();
+			shape[1] = proto.channels();
+			shape[2] = proto.height();
+			shape[3] = proto.width();
 		} else {
-			CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
-		}
-		// copy data
-		if (proto.double_data_size() > 0) {
-			CHECK_EQ(count_, proto.double_data_size());
-			Dtype* data_vec = mutable_cpu_data();
-			for (int i = 0; i < count_; ++i) {
-				data_vec[i] = proto.double_data(i);
-			}
-		} else if(proto.data_size()>0) {
-			CHECK_EQ(count_, proto.data_size());
-			Dtype* data_vec = mutable_cpu_data();
-			for (int i = 0; i < count_; ++i) {
-				data_vec[i] = proto.data(i);
+			shape.resize(proto.shape().dim_size());
+			for (int i = 0; i < proto.shape().dim_size(); ++i) {
+				shape[i] = proto.shape().dim(i);
 			}
 		}
-		if (proto.double_diff_size() > 0) {
-			CHECK_EQ(count_, proto.double_diff_size());
-			Dtype* diff_vec = mutable_cpu_diff();
-			for (int i = 0; i < count_; ++i) {
-				diff_vec[i] = proto.double_diff(i);
-			}
-		} else if (proto.diff_size() > 0) {
-			CHECK_EQ(count_, proto.diff_size());
-			Dtype* diff_vec = mutable_cpu_diff();
-			for (int i = 0; i < count_; ++i) {
-				diff_vec[i] = proto.diff(i);
-			}
+		Reshape(shape);
+	} else {
+		CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
+	}
+	// copy data
+	if (proto.double_data_size() > 0) {
+		CHECK_EQ(count_, proto.double_data_size());
+		Dtype* data_vec = mutable_cpu_data();
+		for (int i = 0; i < count_; ++i) {
+			data_vec[i] = proto.double_data(i);
 		}
-		if(sparse_&&FLAGS_step!="three") {
-			if (proto.double_mask_size() > 0) {
-				CHECK_EQ(count_, proto.double_mask_size());
-				Dtype* mask_vec = mutable_cpu_mask();
-				for (int i = 0; i < count_; ++i) {
-					mask_vec[i] = proto.double_mask(i);
-				}
-			} else if (proto.mask_size() > 0) {
-				CHECK_EQ(count_, proto.mask_size());
-				Dtype* mask_vec = mutable_cpu_mask();
-				for (int i = 0; i < count_; ++i) {
-					mask_vec[i] = proto.mask(i);
-				}
+	} else if(proto.data_size()>0) {
+		CHECK_EQ(count_, proto.data_size());
+		Dtype* data_vec = mutable_cpu_data();
+		for (int i = 0; i < count_; ++i) {
+			data_vec[i] = proto.data(i);
+		}
+	}
+	if (proto.double_diff_size() > 0) {
+		CHECK_EQ(count_, proto.double_diff_size());
+		Dtype* diff_vec = mutable_cpu_diff();
+		for (int i = 0; i < count_; ++i) {
+			diff_vec[i] = proto.double_diff(i);
+		}
+	} else if (proto.diff_size() > 0) {
+		CHECK_EQ(count_, proto.diff_size());
+		Dtype* diff_vec = mutable_cpu_diff();
+		for (int i = 0; i < count_; ++i) {
+			diff_vec[i] = proto.diff(i);
+		}
+	}
+	// Older models store one float per mask element; pack it into bits.
+	if(mask_&&(proto.double_mask_size()>0||proto.mask_size()>0)) {
+		const bool use_double = proto.double_mask_size() > 0;
+		CHECK_EQ(count_, use_double ? proto.double_mask_size() :
+		         proto.mask_size());
+		uint32_t* mask_vec = mutable_cpu_mask();
+		caffe_memset(mask_words()*sizeof(uint32_t), 0, mask_vec);
+		for (int i = 0; i < count_; ++i) {
+			if (use_double ? proto.double_mask(i) != 0 : proto.mask(i) != 0) {
+				mask_vec[i >> 5] |= 1u << (i & 31);
 			}
 		}
 	}
 
+	if(proto.csrval_size()==0&&proto.double_csrval_size()==0) {
+		return;
+	}
+	const int rows = shape_[0];
+	setNnz(proto.nnz());
+	csrval_.reset(new SyncedMemory(std::max(nnz_, 1)*sizeof(Dtype)));
+	Dtype* csrval_vec=mutable_cpu_csrval();
 	if(proto.csrval_size()>0) {
 		CHECK_EQ(proto.nnz(),proto.csrval_size());
-		csrval_.reset(new SyncedMemory(proto.nnz()*sizeof(Dtype)));
-		Dtype* csrval_vec=mutable_cpu_csrval();
-		setNnz(proto.nnz());
-		LOG(INFO)<<"csrval_size()>0"<<" "<<nnz();
-		for(int i=0; i<proto.nnz(); i++) {
+		for(int i=0; i<nnz_; i++) {
 			csrval_vec[i]=proto.csrval(i);
 		}
-	} else if(proto.double_csrval_size()>0) {
+	} else {
 		CHECK_EQ(proto.nnz(),proto.double_csrval_size());
-		csrval_.reset(new SyncedMemory(proto.nnz()*sizeof(Dtype)));
-		Dtype* csrval_vec=mutable_cpu_csrval();
-		setNnz(proto.nnz());
 		for(int i=0; i<nnz_; i++) {
 			csrval_vec[i]=proto.double_csrval(i);
 		}
 	}
-	if(proto.csrrowptr_size()>0) {
-		CHECK_EQ(proto.csrrowptr_size(),shape_[0]+1);
-		csrrowptr_.reset(new SyncedMemory(sizeof(int)*(shape_[0]+1)));
-		int* csrrowptr_vec=mutable_cpu_csrrowptr();
-		LOG(INFO)<<"csrrowptr_size>0";
-		for(int i=0; i<shape_[0]+1; i++) {
-			csrrowptr_vec[i]=proto.csrrowptr(i);
+	CHECK_EQ(proto.csrrowptr_size(),rows+1);
+	csrrowptr_.reset(new SyncedMemory(sizeof(int)*(rows+1)));
+	int* csrrowptr_vec=mutable_cpu_csrrowptr();
+	for(int i=0; i<rows+1; i++) {
+		csrrowptr_vec[i]=proto.csrrowptr(i);
+	}
+	CHECK_EQ(csrrowptr_vec[rows],nnz_);
+	csrcolind_.reset(new SyncedMemory(sizeof(int)*std::max(nnz_, 1)));
+	int* csrcolind_vec=mutable_cpu_csrcolind();
+	CsrIndicesFromProto(proto, rows, csrrowptr_vec, csrcolind_vec);
+
+	// A CSR-only blob is expanded to dense weights (and the mask implied by
+	// its pattern) unless the layer is going to compute with the CSR arrays.
+	// The GPU layers always compute with the dense weights. Legacy protos
+	// have no storage field, but no dense data either.
+	const bool csr_only = proto.storage()==BlobProto::CSR||
+	        (proto.data_size()==0&&proto.double_data_size()==0);
+	if(csr_only&&(!use_csr()||Caffe::mode()==Caffe::GPU)) {
+		const int cols = count_/rows;
+		Dtype* data_vec = mutable_cpu_data();
+		caffe_memset(count_*sizeof(Dtype), 0, data_vec);
+		uint32_t* mask_vec = mask_ ? mutable_cpu_mask() : NULL;
+		if (mask_vec) {
+			caffe_memset(mask_words()*sizeof(uint32_t), 0, mask_vec);
 		}
-	}
-	if(proto.csrcolind_size()>0) {
-		CHECK_EQ(proto.csrcolind_size(),proto.nnz());
-		csrcolind_.reset(new SyncedMemory(sizeof(int)*nnz_));
-		int* csrcolind_vec=mutable_cpu_csrcolind();
-		LOG(INFO)<<"csrcolind_size>0";
-		for(int i=0; i<nnz_; i++) {
-			csrcolind_vec[i]=proto.csrcolind(i);
+		for(int i=0; i<rows; i++) {
+			for(int j=csrrowptr_vec[i]; j<csrrowptr_vec[i+1]; j++) {
+				const int index = i*cols+csrcolind_vec[j];
+				data_vec[index]=csrval_vec[j];
+				if (mask_vec) {
+					mask_vec[index >> 5] |= 1u << (index & 31);
+				}
+			}
 		}
 	}
 }
 
+template <> void Blob<unsigned int>::ComputeCsr() {
+	NOT_IMPLEMENTED;
+}
+
+template <> void Blob<int>::ComputeCsr() {
+	NOT_IMPLEMENTED;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ComputeCsr() {
+	// Rows are the leading axis (outputs); the remaining axes are flattened
+	// into columns so that convolution filters work too.
+	const int rows = shape_[0];
+	const int cols = count_/rows;
+	const Dtype* data_vec = cpu_data();
+	csrrowptr_.reset(new SyncedMemory(sizeof(int)*(rows+1)));
+	int* csrrowptr_vec = mutable_cpu_csrrowptr();
+	setNnz(caffe_cpu_dense2csr<Dtype>(rows, cols, data_vec, NULL,
+	                                  csrrowptr_vec, NULL));
+	csrval_.reset(new SyncedMemory(std::max(nnz_, 1)*sizeof(Dtype)));
+	csrcolind_.reset(new SyncedMemory(std::max(nnz_, 1)*sizeof(int)));
+	caffe_cpu_dense2csr<Dtype>(rows, cols, data_vec, mutable_cpu_csrval(),
+	                           csrrowptr_vec, mutable_cpu_csrcolind());
+}
+
 template <>
 void Blob<double>::ToProto(BlobProto* proto, bool write_diff)  {
 	proto->clear_shape();
@@ -870,13 +880,25 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff)  {
 	proto->clear_double_diff();
 	proto->clear_double_mask();
 	proto->clear_double_csrval();
-	const double* data_vec = cpu_data();
-	const double* mask_vec = cpu_mask();
-	for (int i = 0; i < count_; ++i) {
-		proto->add_double_data(data_vec[i]);
-	}
-	for(int i=0; i<count_; i++) {
-		proto->add_double_mask(mask_vec[i]);
+	proto->clear_csrrowptr();
+	proto->clear_csrcolind();
+	proto->clear_csrcolind_delta();
+	if(sparse()) {
+		// Sparse blobs are stored as CSR only; the mask is implied. A blob
+		// computing with its CSR arrays has no dense copy to rebuild them from.
+		if(!use_csr()) {
+			ComputeCsr();
+		}
+		const double* csrval_vec = cpu_csrval();
+		for (int i = 0; i < nnz_; ++i) {
+			proto->add_double_csrval(csrval_vec[i]);
+		}
+		CsrIndicesToProto(shape_[0], cpu_csrrowptr(), cpu_csrcolind(), proto);
+	} else {
+		const double* data_vec = cpu_data();
+		for (int i = 0; i < count_; ++i) {
+			proto->add_double_data(data_vec[i]);
+		}
 	}
 	if (write_diff) {
 		const double* diff_vec = cpu_diff();
@@ -898,105 +920,28 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff)  {
 	proto->clear_csrval();
 	proto->clear_csrrowptr();
 	proto->clear_csrcolind();
-
-
-
-////////////////////compute csr////////////////
-// if(with_csr==true&&shape_.size()==2){
-	if(sparse_) {
-		cusparseMatDescr_t descr;
-		CUSPARSE_CHECK(cusparseCreateMatDescr(&descr));
-		cusparseSetMatType(descr,CUSPARSE_MATRIX_TYPE_GENERAL);
-		cusparseSetMatIndexBase(descr,CUSPARSE_INDEX_BASE_ZERO);
-		cusparseDirection_t dir=CUSPARSE_DIRECTION_COLUMN;
-		int lda=shape_[1];
-		int M=shape_[0],N=shape_[1];
-		int *nnzPerRow=0;
-		LOG(INFO)<<"M N:"<<M<<" "<<N;
-		LOG(INFO)<<shape_[0]<<" "<<shape_[1]<<" "<<shape_[2]<<" "<<shape_[3];
-		int *nnzTotalDevHostPtr=0;
-		cudaMalloc((void**)&nnzPerRow,(M)*sizeof(int));
-		cudaMalloc((void**)&nnzTotalDevHostPtr,sizeof(int));
-		const float* weight = gpu_data();
-		CUSPARSE_CHECK(cusparseSnnz(Caffe::cusparse_handle(),dir,N,M,descr,weight,lda,nnzPerRow,nnzTotalDevHostPtr));
-		cudaDeviceSynchronize();
-		int* nnzTotalHostPtr=(int*)malloc(sizeof(int));
-		cudaMemcpy(nnzTotalHostPtr,nnzTotalDevHostPtr,sizeof(int),cudaMemcpyDeviceToHost);
-		float* csrVal=0;
-		cudaMalloc((void**)&csrVal,(*nnzTotalHostPtr)*sizeof(float));
-		int *csrRowPtr=0,*csrColInd=0;
-		cudaMalloc((void**)&csrRowPtr,(M+1)*sizeof(int));
-		cudaMalloc((void**)&csrColInd,(*nnzTotalHostPtr)*sizeof(int));
-		CUSPARSE_CHECK(cusparseSdense2csc(Caffe::cusparse_handle(),N,M,descr,weight,lda,nnzPerRow,csrVal,csrColInd,csrRowPtr));
-
-		cudaDeviceSynchronize();
-		float* csrVal_cpu=(float*)malloc(sizeof(float)*(*nnzTotalHostPtr));
-		LOG(INFO)<<"finish csr";
-		int* csrColInd_cpu=(int*)malloc(sizeof(int)*(*nnzTotalHostPtr));
-		cudaMemcpy(csrColInd_cpu,csrColInd,(*nnzTotalHostPtr)*sizeof(int),cudaMemcpyDeviceToHost);
-		cudaMemcpy(csrVal_cpu,csrVal,(*nnzTotalHostPtr)*sizeof(float),cudaMemcpyDeviceToHost);
-		int* csrRowPtr_cpu=(int*)malloc(sizeof(int)*(M+1));
-		cudaMemcpy(csrRowPtr_cpu,csrRowPtr,(M+1)*sizeof(int),cudaMemcpyDeviceToHost);
-
-		csrval_.reset(new SyncedMemory((*nnzTotalHostPtr)*sizeof(float)));
-		float* csrval_vec=static_cast<float*>(mutable_cpu_csrval());
-		setNnz(*nnzTotalHostPtr);
-		for(int i=0; i<*nnzTotalHostPtr; i++) {
-			csrval_vec[i]=csrVal_cpu[i];
-		}
-		csrrowptr_.reset(new SyncedMemory(sizeof(int)*(M+1)));
-		int* csrrowptr_vec=mutable_cpu_csrrowptr();
-		for(int i=0; i<M+1; i++) {
-			csrrowptr_vec[i]=csrRowPtr_cpu[i];
-		}
-		csrcolind_.reset(new SyncedMemory(sizeof(int)*(*nnzTotalHostPtr)));
-		int* csrcolind_vec=mutable_cpu_csrcolind();
-		for(int i=0; i<*nnzTotalHostPtr; i++) {
-			csrcolind_vec[i]=csrColInd_cpu[i];
+	proto->clear_csrcolind_delta();
+	if(sparse()) {
+		// Sparse blobs are stored as CSR only; the mask is implied. A blob
+		// computing with its CSR arrays has no dense copy to rebuild them from.
+		if(!use_csr()) {
+			ComputeCsr();
 		}
-
-		for(int i=0; i<nnz(); i++) {
-			proto->add_csrval(csrVal_cpu[i]);
-			proto->add_csrcolind(csrColInd_cpu[i]);
-		}
-
-		for(int i=0; i<shape_[0]+1; i++) {
-			proto->add_csrrowptr(csrRowPtr_cpu[i]);
-		}
-		proto->set_nnz(nnz());
-		LOG(INFO)<<proto->nnz();
-		free(csrVal_cpu);
-		free(csrRowPtr_cpu);
-		free(csrColInd_cpu);
-		cusparseDestroyMatDescr(descr);
-		cudaFree(csrRowPtr);
-		cudaFree(csrColInd);
-		cudaFree(csrVal);
-		cudaFree(nnzPerRow);
-		cudaFree(nnzTotalDevHostPtr);
-		free(nnzTotalHostPtr);
-		if(FLAGS_step!="yufeng") {
-			const float* mask_vec = cpu_mask();
-			for(int i=0; i< count_; i++) {
-				proto->add_mask(mask_vec[i]);
-			}
-			const float* data_vec = cpu_data();
-			for (int i = 0; i < count_; ++i) {
-				proto->add_data(data_vec[i]);
-			}
+		const float* csrval_vec = cpu_csrval();
+		for (int i = 0; i < nnz_; ++i) {
+			proto->add_csrval(csrval_vec[i]);
 		}
-	}
-///////////////////////end////////////////////
-	if(!sparse_) {
+		CsrIndicesToProto(shape_[0], cpu_csrrowptr(), cpu_csrcolind(), proto);
+	} else {
 		const float* data_vec = cpu_data();
 		for (int i = 0; i < count_; ++i) {
 			proto->add_data(data_vec[i]);
 		}
-		if (write_diff) {
-			const float* diff_vec = cpu_diff();
-			for (int i = 0; i < count_; ++i) {
-				proto->add_diff(diff_vec[i]);
-			}
+	}
+	if (write_diff) {
+		const float* diff_vec = cpu_diff();
+		for (int i = 0; i < count_; ++i) {
+			proto->add_diff(diff_vec[i]);
 		}
 	}
 }
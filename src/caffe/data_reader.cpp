@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -8,6 +9,7 @@
 #include "caffe/layers/annotated_data_layer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
@@ -87,23 +89,27 @@ template <typename T>
 void DataReader<T>::Body::InternalThreadEntry() {
   shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));
   db->Open(param_.data_param().source(), db::READ);
-  shared_ptr<db::Cursor> cursor(db->NewCursor());
+  vector<shared_ptr<Shard> > shards;
   vector<shared_ptr<QueuePair> > qps;
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
+    for (int i = 0; i < solver_count; ++i) {
+      shards.push_back(shared_ptr<Shard>(
+          new Shard(param_, db.get(), i, solver_count)));
+    }
 
     // To ensure deterministic runs, only start running once all solvers
     // are ready. But solvers need to peek on one item during initialization,
     // so read one item, then wait for the next solver.
     for (int i = 0; i < solver_count; ++i) {
       shared_ptr<QueuePair> qp(new_queue_pairs_.pop());
-      read_one(cursor.get(), qp.get());
+      shards[i]->read_one(qp.get());
       qps.push_back(qp);
     }
     // Main loop
     while (!must_stop()) {
       for (int i = 0; i < solver_count; ++i) {
-        read_one(cursor.get(), qps[i].get());
+        shards[i]->read_one(qps[i].get());
       }
       // Check no additional readers have been created. This can happen if
       // more than one net is trained at a time per process, whether single
@@ -114,20 +120,101 @@ void DataReader<T>::Body::InternalThreadEntry() {
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
   }
+  // Joining the readers must not be cut short by the interruption of this
+  // thread.
+  boost::this_thread::disable_interruption no_interruption;
+  shards.clear();
 }
 
+// Number of parsed records that each reader can hold ahead.
+static const int kItemsPerReader = 4;
+
 template <typename T>
-void DataReader<T>::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
+DataReader<T>::Shard::Shard(const LayerParameter& param, db::DB* db,
+    int solver_id, int solver_count)
+    : next_reader_(0) {
+  const int num_readers = std::max<int>(param.data_param().num_readers(), 1);
+  shuffle_buffer_size_ = param.phase() == TRAIN ?
+      param.data_param().shuffle_buffer_size() : 0;
+  if (shuffle_buffer_size_ > 0) {
+    rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+  }
+  // The j-th record of the shard is record solver_id + j * solver_count of
+  // the database, and is read by reader j % num_readers.
+  for (int r = 0; r < num_readers; ++r) {
+    readers_.push_back(shared_ptr<Reader>(new Reader(db->NewCursor(),
+        solver_id + r * solver_count, num_readers * solver_count)));
+  }
+}
+
+template <typename T>
+void DataReader<T>::Shard::next(T* t) {
+  Reader* reader = readers_[next_reader_].get();
+  next_reader_ = (next_reader_ + 1) % readers_.size();
+  T* item = reader->full_.pop();
+  t->Swap(item);
+  reader->free_.push(item);
+}
+
+template <typename T>
+void DataReader<T>::Shard::read_one(QueuePair* qp) {
   T* t = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
-  t->ParseFromString(cursor->value());
+  if (shuffle_buffer_size_ > 0) {
+    while (shuffle_buffer_.size() < shuffle_buffer_size_) {
+      shuffle_buffer_.push_back(shared_ptr<T>(new T()));
+      next(shuffle_buffer_.back().get());
+    }
+    // Output a random record of the buffer and replace it by the next one.
+    caffe::rng_t* rng = static_cast<caffe::rng_t*>(rng_->generator());
+    T* item = shuffle_buffer_[(*rng)() % shuffle_buffer_size_].get();
+    t->Swap(item);
+    next(item);
+  } else {
+    next(t);
+  }
   qp->full_.push(t);
+}
+
+template <typename T>
+DataReader<T>::Reader::Reader(db::Cursor* cursor, int offset, int stride)
+    : cursor_(cursor), offset_(offset), stride_(stride) {
+  for (int i = 0; i < kItemsPerReader; ++i) {
+    items_.push_back(shared_ptr<T>(new T()));
+    free_.push(items_.back().get());
+  }
+  StartInternalThread();
+}
 
-  // go to the next iter
-  cursor->Next();
-  if (!cursor->valid()) {
-    DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+template <typename T>
+DataReader<T>::Reader::~Reader() {
+  StopInternalThread();
+}
+
+template <typename T>
+void DataReader<T>::Reader::InternalThreadEntry() {
+  try {
+    advance(offset_);
+    while (!must_stop()) {
+      T* t = free_.pop();
+      CHECK(cursor_->ParseValue(t)) << "Failed to parse item "
+          << cursor_->key();
+      full_.push(t);
+      advance(stride_);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename T>
+void DataReader<T>::Reader::advance(int n) {
+  for (int i = 0; i < n; ++i) {
+    // go to the next iter
+    cursor_->Next();
+    if (!cursor_->valid()) {
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      cursor_->SeekToFirst();
+    }
   }
 }
 
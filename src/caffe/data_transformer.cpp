@@ -2,6 +2,9 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <stdint.h>
+
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -159,15 +162,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   // If datum is encoded, decoded and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
+    cv::Mat cv_img = DecodeImage(datum);
     // Transform the cv::image into blob.
     return Transform(cv_img, transformed_blob, crop_bbox, do_mirror);
 #else
@@ -285,58 +280,68 @@ void DataTransformer<Dtype>::TransformAnnotation(
     const AnnotatedDatum& anno_datum, const bool do_resize,
     const NormalizedBBox& crop_bbox, const bool do_mirror,
     RepeatedPtrField<AnnotationGroup>* transformed_anno_group_all) {
-  const int img_height = anno_datum.datum().height();
-  const int img_width = anno_datum.datum().width();
   if (anno_datum.type() == AnnotatedDatum_AnnotationType_BBOX) {
-    // Go through each AnnotationGroup.
-    for (int g = 0; g < anno_datum.annotation_group_size(); ++g) {
-      const AnnotationGroup& anno_group = anno_datum.annotation_group(g);
-      AnnotationGroup transformed_anno_group;
-      // Go through each Annotation.
-      bool has_valid_annotation = false;
-      for (int a = 0; a < anno_group.annotation_size(); ++a) {
-        const Annotation& anno = anno_group.annotation(a);
-        const NormalizedBBox& bbox = anno.bbox();
-        // Adjust bounding box annotation.
-        NormalizedBBox resize_bbox = bbox;
-        if (do_resize && param_.has_resize_param()) {
-          CHECK_GT(img_height, 0);
-          CHECK_GT(img_width, 0);
-          UpdateBBoxByResizePolicy(param_.resize_param(), img_width, img_height,
-                                   &resize_bbox);
-        }
-        if (param_.has_emit_constraint() &&
-            !MeetEmitConstraint(crop_bbox, resize_bbox,
-                                param_.emit_constraint())) {
-          continue;
+    TransformAnnotation(anno_datum.annotation_group(),
+                        anno_datum.datum().height(), anno_datum.datum().width(),
+                        do_resize, crop_bbox, do_mirror,
+                        transformed_anno_group_all);
+  } else {
+    LOG(FATAL) << "Unknown annotation type.";
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformAnnotation(
+    const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+    const int img_height, const int img_width, const bool do_resize,
+    const NormalizedBBox& crop_bbox, const bool do_mirror,
+    RepeatedPtrField<AnnotationGroup>* transformed_anno_group_all) {
+  // Go through each AnnotationGroup.
+  for (int g = 0; g < anno_group_all.size(); ++g) {
+    const AnnotationGroup& anno_group = anno_group_all.Get(g);
+    AnnotationGroup transformed_anno_group;
+    // Go through each Annotation.
+    bool has_valid_annotation = false;
+    for (int a = 0; a < anno_group.annotation_size(); ++a) {
+      const Annotation& anno = anno_group.annotation(a);
+      const NormalizedBBox& bbox = anno.bbox();
+      // Adjust bounding box annotation.
+      NormalizedBBox resize_bbox = bbox;
+      if (do_resize && param_.has_resize_param()) {
+        CHECK_GT(img_height, 0);
+        CHECK_GT(img_width, 0);
+        UpdateBBoxByResizePolicy(param_.resize_param(), img_width, img_height,
+                                 &resize_bbox);
+      }
+      if (param_.has_emit_constraint() &&
+          !MeetEmitConstraint(crop_bbox, resize_bbox,
+                              param_.emit_constraint())) {
+        continue;
+      }
+      NormalizedBBox proj_bbox;
+      if (ProjectBBox(crop_bbox, resize_bbox, &proj_bbox)) {
+        has_valid_annotation = true;
+        Annotation* transformed_anno =
+            transformed_anno_group.add_annotation();
+        transformed_anno->set_instance_id(anno.instance_id());
+        NormalizedBBox* transformed_bbox = transformed_anno->mutable_bbox();
+        transformed_bbox->CopyFrom(proj_bbox);
+        if (do_mirror) {
+          Dtype temp = transformed_bbox->xmin();
+          transformed_bbox->set_xmin(1 - transformed_bbox->xmax());
+          transformed_bbox->set_xmax(1 - temp);
         }
-        NormalizedBBox proj_bbox;
-        if (ProjectBBox(crop_bbox, resize_bbox, &proj_bbox)) {
-          has_valid_annotation = true;
-          Annotation* transformed_anno =
-              transformed_anno_group.add_annotation();
-          transformed_anno->set_instance_id(anno.instance_id());
-          NormalizedBBox* transformed_bbox = transformed_anno->mutable_bbox();
-          transformed_bbox->CopyFrom(proj_bbox);
-          if (do_mirror) {
-            Dtype temp = transformed_bbox->xmin();
-            transformed_bbox->set_xmin(1 - transformed_bbox->xmax());
-            transformed_bbox->set_xmax(1 - temp);
-          }
-          if (do_resize && param_.has_resize_param()) {
-            ExtrapolateBBox(param_.resize_param(), img_height, img_width,
-                crop_bbox, transformed_bbox);
-          }
+        if (do_resize && param_.has_resize_param()) {
+          ExtrapolateBBox(param_.resize_param(), img_height, img_width,
+              crop_bbox, transformed_bbox);
         }
       }
-      // Save for output.
-      if (has_valid_annotation) {
-        transformed_anno_group.set_group_label(anno_group.group_label());
-        transformed_anno_group_all->Add()->CopyFrom(transformed_anno_group);
-      }
     }
-  } else {
-    LOG(FATAL) << "Unknown annotation type.";
+    // Save for output.
+    if (has_valid_annotation) {
+      transformed_anno_group.set_group_label(anno_group.group_label());
+      transformed_anno_group_all->Add()->CopyFrom(transformed_anno_group);
+    }
   }
 }
 
@@ -347,15 +352,7 @@ void DataTransformer<Dtype>::CropImage(const Datum& datum,
   // If datum is encoded, decode and crop the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-      // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
+    cv::Mat cv_img = DecodeImage(datum);
     // Crop the image.
     cv::Mat crop_img;
     CropImage(cv_img, bbox, &crop_img);
@@ -386,27 +383,26 @@ void DataTransformer<Dtype>::CropImage(const Datum& datum,
   const int width = static_cast<int>(scaled_bbox.xmax() - scaled_bbox.xmin());
   const int height = static_cast<int>(scaled_bbox.ymax() - scaled_bbox.ymin());
 
-  // Crop the image using bbox.
+  // Crop the image using bbox. The data of crop_datum is reused, and each
+  // row of each channel is copied at once.
   crop_datum->set_channels(datum_channels);
   crop_datum->set_height(height);
   crop_datum->set_width(width);
   crop_datum->set_label(datum.label());
-  crop_datum->clear_data();
   crop_datum->clear_float_data();
   crop_datum->set_encoded(false);
   const int crop_datum_size = datum_channels * height * width;
-  const std::string& datum_buffer = datum.data();
-  std::string buffer(crop_datum_size, ' ');
-  for (int h = h_off; h < h_off + height; ++h) {
-    for (int w = w_off; w < w_off + width; ++w) {
-      for (int c = 0; c < datum_channels; ++c) {
-        int datum_index = (c * datum_height + h) * datum_width + w;
-        int crop_datum_index = (c * height + h - h_off) * width + w - w_off;
-        buffer[crop_datum_index] = datum_buffer[datum_index];
-      }
+  std::string* buffer = crop_datum->mutable_data();
+  buffer->resize(crop_datum_size);
+  char* crop_data = &(*buffer)[0];
+  const char* datum_data = datum.data().data();
+  for (int c = 0; c < datum_channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      memcpy(crop_data + (c * height + h) * width,
+             datum_data + (c * datum_height + h + h_off) * datum_width + w_off,
+             width);
     }
   }
-  crop_datum->set_data(buffer);
 }
 
 template<typename Dtype>
@@ -416,6 +412,7 @@ void DataTransformer<Dtype>::CropImage(const AnnotatedDatum& anno_datum,
   // Crop the datum.
   CropImage(anno_datum.datum(), bbox, cropped_anno_datum->mutable_datum());
   cropped_anno_datum->set_type(anno_datum.type());
+  cropped_anno_datum->clear_annotation_group();
 
   // Transform the annotation according to crop_bbox.
   const bool do_resize = false;
@@ -434,15 +431,7 @@ void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
   // If datum is encoded, decode and crop the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-      // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
+    cv::Mat cv_img = DecodeImage(datum);
     // Expand the image.
     cv::Mat expand_img;
     ExpandImage(cv_img, expand_ratio, expand_bbox, &expand_img);
@@ -476,28 +465,48 @@ void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
   expand_bbox->set_xmax((width - w_off)/datum_width);
   expand_bbox->set_ymax((height - h_off)/datum_height);
 
-  // Crop the image using bbox.
+  // Expand the image using bbox. The data of expand_datum is reused.
   expand_datum->set_channels(datum_channels);
   expand_datum->set_height(height);
   expand_datum->set_width(width);
   expand_datum->set_label(datum.label());
-  expand_datum->clear_data();
   expand_datum->clear_float_data();
   expand_datum->set_encoded(false);
   const int expand_datum_size = datum_channels * height * width;
-  const std::string& datum_buffer = datum.data();
-  std::string buffer(expand_datum_size, ' ');
-  for (int h = h_off; h < h_off + datum_height; ++h) {
-    for (int w = w_off; w < w_off + datum_width; ++w) {
-      for (int c = 0; c < datum_channels; ++c) {
-        int datum_index =
-            (c * datum_height + h - h_off) * datum_width + w - w_off;
-        int expand_datum_index = (c * height + h) * width + w;
-        buffer[expand_datum_index] = datum_buffer[datum_index];
-      }
+  const int expand_spatial_size = height * width;
+  std::string* buffer = expand_datum->mutable_data();
+  buffer->resize(expand_datum_size);
+  char* expand_data = &(*buffer)[0];
+  // Fill the background with the mean, as for cv::Mat, or 0.
+  if (param_.has_mean_file()) {
+    CHECK_EQ(datum_channels, data_mean_.channels());
+    CHECK_EQ(height, data_mean_.height());
+    CHECK_EQ(width, data_mean_.width());
+    const Dtype* mean = data_mean_.cpu_data();
+    for (int i = 0; i < expand_datum_size; ++i) {
+      expand_data[i] = static_cast<uint8_t>(mean[i]);
+    }
+  } else if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
+        "Specify either 1 mean_value or as many as channels: " <<
+        datum_channels;
+    for (int c = 0; c < datum_channels; ++c) {
+      const Dtype mean = mean_values_[mean_values_.size() == 1 ? 0 : c];
+      memset(expand_data + c * expand_spatial_size, static_cast<uint8_t>(mean),
+             expand_spatial_size);
+    }
+  } else {
+    memset(expand_data, 0, expand_datum_size);
+  }
+  // Copy each row of each channel at once.
+  const char* datum_data = datum.data().data();
+  for (int c = 0; c < datum_channels; ++c) {
+    for (int h = 0; h < datum_height; ++h) {
+      memcpy(expand_data + c * expand_spatial_size +
+             (h + static_cast<int>(h_off)) * width + static_cast<int>(w_off),
+             datum_data + (c * datum_height + h) * datum_width, datum_width);
     }
   }
-  expand_datum->set_data(buffer);
 }
 
 template<typename Dtype>
@@ -527,6 +536,7 @@ void DataTransformer<Dtype>::ExpandImage(const AnnotatedDatum& anno_datum,
   ExpandImage(anno_datum.datum(), expand_ratio, &expand_bbox,
               expanded_anno_datum->mutable_datum());
   expanded_anno_datum->set_type(anno_datum.type());
+  expanded_anno_datum->clear_annotation_group();
 
   // Transform the annotation according to crop_bbox.
   const bool do_resize = false;
@@ -545,15 +555,7 @@ void DataTransformer<Dtype>::DistortImage(const Datum& datum,
   // If datum is encoded, decode and crop the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-      // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
+    cv::Mat cv_img = DecodeImage(datum);
     // Distort the image.
     cv::Mat distort_img = ApplyDistort(cv_img, param_.distort_param());
     // Save the image into datum.
@@ -885,6 +887,104 @@ void DataTransformer<Dtype>::ExpandImage(const cv::Mat& img,
   img.copyTo((*expand_img)(bbox_roi));
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(
+    const cv::Mat& cv_img,
+    const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+    Blob<Dtype>* transformed_blob,
+    RepeatedPtrField<AnnotationGroup>* transformed_anno_group_all) {
+  // Transform image.
+  NormalizedBBox crop_bbox;
+  bool do_mirror;
+  Transform(cv_img, transformed_blob, &crop_bbox, &do_mirror);
+
+  // Transform annotation.
+  const bool do_resize = true;
+  TransformAnnotation(anno_group_all, cv_img.rows, cv_img.cols, do_resize,
+                      crop_bbox, do_mirror, transformed_anno_group_all);
+}
+
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeImage(const Datum& datum) {
+  CHECK(!(param_.force_color() && param_.force_gray()))
+      << "cannot set both force_color and force_gray";
+  if (param_.force_color() || param_.force_gray()) {
+    // If force_color then decode in color otherwise decode in gray.
+    return DecodeDatumToCVMat(datum, param_.force_color());
+  } else {
+    return DecodeDatumToCVMatNative(datum);
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CropImage(
+    const cv::Mat& img,
+    const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+    const NormalizedBBox& bbox, cv::Mat* crop_img,
+    RepeatedPtrField<AnnotationGroup>* cropped_anno_group_all) {
+  // Crop the image.
+  CropImage(img, bbox, crop_img);
+
+  // Transform the annotation according to crop_bbox.
+  const bool do_resize = false;
+  const bool do_mirror = false;
+  NormalizedBBox crop_bbox;
+  ClipBBox(bbox, &crop_bbox);
+  cropped_anno_group_all->Clear();
+  TransformAnnotation(anno_group_all, img.rows, img.cols, do_resize,
+                      crop_bbox, do_mirror, cropped_anno_group_all);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::ExpandImage(
+    const cv::Mat& img,
+    const RepeatedPtrField<AnnotationGroup>& anno_group_all,
+    cv::Mat* expand_img,
+    RepeatedPtrField<AnnotationGroup>* expanded_anno_group_all) {
+  if (!param_.has_expand_param()) {
+    *expand_img = img;
+    expanded_anno_group_all->CopyFrom(anno_group_all);
+    return;
+  }
+  const ExpansionParameter& expand_param = param_.expand_param();
+  const float expand_prob = expand_param.prob();
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  if (prob > expand_prob) {
+    *expand_img = img;
+    expanded_anno_group_all->CopyFrom(anno_group_all);
+    return;
+  }
+  const float max_expand_ratio = expand_param.max_expand_ratio();
+  if (fabs(max_expand_ratio - 1.) < 1e-2) {
+    *expand_img = img;
+    expanded_anno_group_all->CopyFrom(anno_group_all);
+    return;
+  }
+  float expand_ratio;
+  caffe_rng_uniform(1, 1.f, max_expand_ratio, &expand_ratio);
+  // Expand the image.
+  NormalizedBBox expand_bbox;
+  ExpandImage(img, expand_ratio, &expand_bbox, expand_img);
+
+  // Transform the annotation according to crop_bbox.
+  const bool do_resize = false;
+  const bool do_mirror = false;
+  expanded_anno_group_all->Clear();
+  TransformAnnotation(anno_group_all, img.rows, img.cols, do_resize,
+                      expand_bbox, do_mirror, expanded_anno_group_all);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::DistortImage(const cv::Mat& img,
+                                          cv::Mat* distort_img) {
+  if (!param_.has_distort_param()) {
+    *distort_img = img;
+    return;
+  }
+  *distort_img = ApplyDistort(img, param_.distort_param());
+}
+
 #endif  // USE_OPENCV
 
 template<typename Dtype>
@@ -1005,15 +1105,7 @@ template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
+    cv::Mat cv_img = DecodeImage(datum);
     // InferBlobShape using the cv::image.
     return InferBlobShape(cv_img);
 #else
@@ -9,6 +9,7 @@
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/annotated_data_layer.hpp"
+#include "caffe/util/bbox_util.hpp"
 #include "caffe/util/benchmark.hpp"
 #include "caffe/util/sampler.hpp"
 
@@ -35,6 +36,7 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
     batch_samplers_.push_back(anno_data_param.batch_sampler(i));
   }
   label_map_file_ = anno_data_param.label_map_file();
+  fixed_label_capacity_ = anno_data_param.fixed_label_capacity();
   // Make sure dimension is consistent within batch.
   const TransformationParameter& transform_param =
     this->layer_param_.transform_param();
@@ -53,11 +55,22 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
   vector<int> top_shape =
       this->data_transformer_->InferBlobShape(anno_datum.datum());
   this->transformed_data_.Reshape(top_shape);
+  worker_transformed_data_.clear();
+  expand_datums_.clear();
+  sampled_datums_.clear();
+  worker_anno_.resize(this->num_workers_);
+  for (int i = 0; i < this->num_workers_; ++i) {
+    worker_transformed_data_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>(top_shape)));
+    expand_datums_.push_back(shared_ptr<AnnotatedDatum>(new AnnotatedDatum()));
+    sampled_datums_.push_back(
+        shared_ptr<AnnotatedDatum>(new AnnotatedDatum()));
+  }
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -94,6 +107,11 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
         // sure there is at least one bbox.
         label_shape[2] = std::max(num_bboxes, 1);
         label_shape[3] = 8;
+        if (fixed_label_capacity_) {
+          // Leave room for the header.
+          label_capacity_ = label_shape[2];
+          ++label_shape[2];
+        }
       } else {
         LOG(FATAL) << "Unknown annotation type.";
       }
@@ -101,8 +119,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
       label_shape[0] = batch_size;
     }
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -116,62 +134,172 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
-  CHECK(this->transformed_data_.count());
 
   // Reshape according to the first anno_datum of each batch
   // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
   const AnnotatedDataParameter& anno_data_param =
       this->layer_param_.annotated_data_param();
-  const TransformationParameter& transform_param =
-    this->layer_param_.transform_param();
   AnnotatedDatum& anno_datum = *(reader_.full().peek());
   // Use data_transformer to infer the expected blob shape from anno_datum.
   vector<int> top_shape =
       this->data_transformer_->InferBlobShape(anno_datum.datum());
-  this->transformed_data_.Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
 
-  Dtype* top_data = batch->data_.mutable_cpu_data();
   Dtype* top_label = NULL;  // suppress warnings about uninitialized variables
   if (this->output_labels_ && !has_anno_type_) {
     top_label = batch->label_.mutable_cpu_data();
   }
 
-  // Store transformed annotation.
-  map<int, vector<AnnotationGroup> > all_anno;
-  int num_bboxes = 0;
-
+  // Read the items of the batch, then transform them with the workers.
+  const bool transform_anno = this->output_labels_ && has_anno_type_;
+  items_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
     // get a anno_datum
     AnnotatedDatum& anno_datum = *(reader_.full().pop("Waiting for data"));
     read_time += timer.MicroSeconds();
-    timer.Start();
+    if (transform_anno) {
+      // Make sure all data have same annotation type.
+      CHECK(anno_datum.has_type()) << "Some datum misses AnnotationType.";
+      if (anno_data_param.has_anno_type()) {
+        anno_datum.set_type(anno_type_);
+      } else {
+        CHECK_EQ(anno_type_, anno_datum.type()) <<
+            "Different AnnotationType.";
+      }
+    }
+    items_[item_id] = &anno_datum;
+  }
+  timer.Start();
+  item_labels_.resize(batch_size);
+  batch_ = batch;
+  // Settle the memory of the batch before the workers share it.
+  batch->data_.mutable_cpu_data();
+  this->RunWorkers();
+  trans_time += timer.MicroSeconds();
+
+  // Merge the annotations in item order.
+  int num_bboxes = 0;
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    const AnnotatedDatum& anno_datum = *items_[item_id];
+    if (transform_anno) {
+      num_bboxes += item_labels_[item_id].size() / 8;
+    } else if (this->output_labels_) {
+      // Otherwise, store the label from datum.
+      CHECK(anno_datum.datum().has_label()) << "Cannot find any label.";
+      top_label[item_id] = anno_datum.datum().label();
+    }
+    reader_.free().push(const_cast<AnnotatedDatum*>(&anno_datum));
+  }
+
+  // Store "rich" annotation if needed.
+  if (transform_anno) {
+    vector<int> label_shape(4, 1);
+    label_shape[3] = 8;
+    int first_row = 0;
+    if (fixed_label_capacity_) {
+      // Only grow the capacity, so that the label keeps its shape.
+      while (label_capacity_ < num_bboxes) {
+        label_capacity_ *= 2;
+      }
+      label_shape[2] = label_capacity_ + 1;
+      first_row = 1;
+    } else {
+      // Store all -1 in the label if there is no bbox.
+      label_shape[2] = std::max(num_bboxes, 1);
+    }
+    batch->label_.Reshape(label_shape);
+    top_label = batch->label_.mutable_cpu_data();
+    if (fixed_label_capacity_) {
+      caffe_set<Dtype>(8, -1, top_label);
+      top_label[0] = kLabelHeaderId;
+      top_label[1] = num_bboxes;
+      top_label[2] = label_capacity_;
+    }
+    Dtype* row = top_label + first_row * 8;
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      const vector<Dtype>& labels = item_labels_[item_id];
+      if (!labels.empty()) {
+        caffe_copy<Dtype>(labels.size(), &labels[0], row);
+        row += labels.size();
+      }
+    }
+    caffe_set<Dtype>(batch->label_.count() - (row - top_label), -1, row);
+  }
+  timer.Stop();
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+}
+
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::transform_items(int worker_id) {
+  for (int item_id = worker_id; item_id < items_.size();
+       item_id += this->num_workers_) {
+    transform_item(worker_id, item_id);
+  }
+}
+
+// This function is called on the thread of worker worker_id
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::transform_item(int worker_id, int item_id) {
+  const TransformationParameter& transform_param =
+    this->layer_param_.transform_param();
+  DataTransformer<Dtype>* transformer =
+      this->data_transformers_[worker_id].get();
+  Blob<Dtype>* transformed_data = worker_transformed_data_[worker_id].get();
+  AnnotatedDatum& anno_datum = *items_[item_id];
+  const bool transform_anno = this->output_labels_ && has_anno_type_;
+  RepeatedPtrField<AnnotationGroup>& transformed_anno = worker_anno_[worker_id];
+  transformed_anno.Clear();
+#ifdef USE_OPENCV
+  const bool decode_once = anno_datum.datum().encoded();
+#else
+  const bool decode_once = false;
+#endif  // USE_OPENCV
+  if (decode_once) {
+#ifdef USE_OPENCV
+    // Decode the image once and keep it as cv::Mat until it is written
+    // into the batch.
+    cv::Mat sampled_img;
+    RepeatedPtrField<AnnotationGroup> sampled_anno;
+    SampleImage(transformer, anno_datum, &sampled_img, &sampled_anno);
+    SetUpTransformedData(transformer->InferBlobShape(sampled_img),
+                         item_id, batch_, transformed_data);
+    // Apply data transformations (mirror, scale, crop...)
+    if (transform_anno) {
+      transformer->Transform(sampled_img, sampled_anno, transformed_data,
+                             &transformed_anno);
+    } else {
+      transformer->Transform(sampled_img, transformed_data);
+    }
+#endif  // USE_OPENCV
+  } else {
     AnnotatedDatum distort_datum;
     AnnotatedDatum* expand_datum = NULL;
     if (transform_param.has_distort_param()) {
       distort_datum.CopyFrom(anno_datum);
-      this->data_transformer_->DistortImage(anno_datum.datum(),
-                                            distort_datum.mutable_datum());
+      transformer->DistortImage(anno_datum.datum(),
+                                distort_datum.mutable_datum());
       if (transform_param.has_expand_param()) {
-        expand_datum = new AnnotatedDatum();
-        this->data_transformer_->ExpandImage(distort_datum, expand_datum);
+        expand_datum = expand_datums_[worker_id].get();
+        transformer->ExpandImage(distort_datum, expand_datum);
       } else {
         expand_datum = &distort_datum;
       }
     } else {
       if (transform_param.has_expand_param()) {
-        expand_datum = new AnnotatedDatum();
-        this->data_transformer_->ExpandImage(anno_datum, expand_datum);
+        expand_datum = expand_datums_[worker_id].get();
+        transformer->ExpandImage(anno_datum, expand_datum);
       } else {
         expand_datum = &anno_datum;
       }
     }
     AnnotatedDatum* sampled_datum = NULL;
-    bool has_sampled = false;
     if (batch_samplers_.size() > 0) {
       // Generate sampled bboxes from expand_datum.
       vector<NormalizedBBox> sampled_bboxes;
@@ -179,11 +307,9 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       if (sampled_bboxes.size() > 0) {
         // Randomly pick a sampled bbox and crop the expand_datum.
         int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
-        sampled_datum = new AnnotatedDatum();
-        this->data_transformer_->CropImage(*expand_datum,
-                                           sampled_bboxes[rand_idx],
-                                           sampled_datum);
-        has_sampled = true;
+        sampled_datum = sampled_datums_[worker_id].get();
+        transformer->CropImage(*expand_datum, sampled_bboxes[rand_idx],
+                               sampled_datum);
       } else {
         sampled_datum = expand_datum;
       }
@@ -191,121 +317,99 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       sampled_datum = expand_datum;
     }
     CHECK(sampled_datum != NULL);
-    timer.Start();
-    vector<int> shape =
-        this->data_transformer_->InferBlobShape(sampled_datum->datum());
-    if (transform_param.has_resize_param()) {
-      if (transform_param.resize_param().resize_mode() ==
-          ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
-        this->transformed_data_.Reshape(shape);
-        batch->data_.Reshape(shape);
-        top_data = batch->data_.mutable_cpu_data();
-      } else {
-        CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-              shape.begin() + 1));
-      }
-    } else {
-      CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-            shape.begin() + 1));
-    }
+    SetUpTransformedData(transformer->InferBlobShape(sampled_datum->datum()),
+                         item_id, batch_, transformed_data);
     // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    vector<AnnotationGroup> transformed_anno_vec;
-    if (this->output_labels_) {
-      if (has_anno_type_) {
-        // Make sure all data have same annotation type.
-        CHECK(sampled_datum->has_type()) << "Some datum misses AnnotationType.";
-        if (anno_data_param.has_anno_type()) {
-          sampled_datum->set_type(anno_type_);
-        } else {
-          CHECK_EQ(anno_type_, sampled_datum->type()) <<
-              "Different AnnotationType.";
-        }
-        // Transform datum and annotation_group at the same time
-        transformed_anno_vec.clear();
-        this->data_transformer_->Transform(*sampled_datum,
-                                           &(this->transformed_data_),
-                                           &transformed_anno_vec);
-        if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
-          // Count the number of bboxes.
-          for (int g = 0; g < transformed_anno_vec.size(); ++g) {
-            num_bboxes += transformed_anno_vec[g].annotation_size();
-          }
-        } else {
-          LOG(FATAL) << "Unknown annotation type.";
-        }
-        all_anno[item_id] = transformed_anno_vec;
-      } else {
-        this->data_transformer_->Transform(sampled_datum->datum(),
-                                           &(this->transformed_data_));
-        // Otherwise, store the label from datum.
-        CHECK(sampled_datum->datum().has_label()) << "Cannot find any label.";
-        top_label[item_id] = sampled_datum->datum().label();
-      }
+    if (transform_anno) {
+      // Transform datum and annotation_group at the same time
+      transformer->Transform(*sampled_datum, transformed_data,
+                             &transformed_anno);
     } else {
-      this->data_transformer_->Transform(sampled_datum->datum(),
-                                         &(this->transformed_data_));
-    }
-    // clear memory
-    if (has_sampled) {
-      delete sampled_datum;
+      transformer->Transform(sampled_datum->datum(), transformed_data);
     }
-    if (transform_param.has_expand_param()) {
-      delete expand_datum;
+  }
+  if (transform_anno) {
+    // Write the label rows of the item.
+    CHECK_EQ(anno_type_, AnnotatedDatum_AnnotationType_BBOX)
+        << "Unknown annotation type.";
+    vector<Dtype>& labels = item_labels_[item_id];
+    labels.clear();
+    for (int g = 0; g < transformed_anno.size(); ++g) {
+      const AnnotationGroup& anno_group = transformed_anno.Get(g);
+      for (int a = 0; a < anno_group.annotation_size(); ++a) {
+        const Annotation& anno = anno_group.annotation(a);
+        const NormalizedBBox& bbox = anno.bbox();
+        labels.push_back(item_id);
+        labels.push_back(anno_group.group_label());
+        labels.push_back(anno.instance_id());
+        labels.push_back(bbox.xmin());
+        labels.push_back(bbox.ymin());
+        labels.push_back(bbox.xmax());
+        labels.push_back(bbox.ymax());
+        labels.push_back(bbox.difficult());
+      }
     }
-    trans_time += timer.MicroSeconds();
+  }
+}
 
-    reader_.free().push(const_cast<AnnotatedDatum*>(&anno_datum));
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::SetUpTransformedData(const vector<int>& shape,
+    const int item_id, Batch<Dtype>* batch, Blob<Dtype>* transformed_data) {
+  const TransformationParameter& transform_param =
+    this->layer_param_.transform_param();
+  if (transform_param.has_resize_param() &&
+      transform_param.resize_param().resize_mode() ==
+      ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
+    batch->data_.Reshape(shape);
+  } else {
+    CHECK(std::equal(batch->data_.shape().begin() + 1,
+          batch->data_.shape().begin() + 4, shape.begin() + 1));
   }
+  transformed_data->Reshape(shape);
+  int offset = batch->data_.offset(item_id);
+  transformed_data->set_cpu_data(batch->data_.mutable_cpu_data() + offset);
+}
 
-  // Store "rich" annotation if needed.
-  if (this->output_labels_ && has_anno_type_) {
-    vector<int> label_shape(4);
-    if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
-      label_shape[0] = 1;
-      label_shape[1] = 1;
-      label_shape[3] = 8;
-      if (num_bboxes == 0) {
-        // Store all -1 in the label.
-        label_shape[2] = 1;
-        batch->label_.Reshape(label_shape);
-        caffe_set<Dtype>(8, -1, batch->label_.mutable_cpu_data());
-      } else {
-        // Reshape the label and store the annotation.
-        label_shape[2] = num_bboxes;
-        batch->label_.Reshape(label_shape);
-        top_label = batch->label_.mutable_cpu_data();
-        int idx = 0;
-        for (int item_id = 0; item_id < batch_size; ++item_id) {
-          const vector<AnnotationGroup>& anno_vec = all_anno[item_id];
-          for (int g = 0; g < anno_vec.size(); ++g) {
-            const AnnotationGroup& anno_group = anno_vec[g];
-            for (int a = 0; a < anno_group.annotation_size(); ++a) {
-              const Annotation& anno = anno_group.annotation(a);
-              const NormalizedBBox& bbox = anno.bbox();
-              top_label[idx++] = item_id;
-              top_label[idx++] = anno_group.group_label();
-              top_label[idx++] = anno.instance_id();
-              top_label[idx++] = bbox.xmin();
-              top_label[idx++] = bbox.ymin();
-              top_label[idx++] = bbox.xmax();
-              top_label[idx++] = bbox.ymax();
-              top_label[idx++] = bbox.difficult();
-            }
-          }
-        }
-      }
-    } else {
-      LOG(FATAL) << "Unknown annotation type.";
+#ifdef USE_OPENCV
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::SampleImage(
+    DataTransformer<Dtype>* transformer, const AnnotatedDatum& anno_datum,
+    cv::Mat* img, RepeatedPtrField<AnnotationGroup>* anno_group_all) {
+  const TransformationParameter& transform_param =
+    this->layer_param_.transform_param();
+  cv::Mat cv_img = transformer->DecodeImage(anno_datum.datum());
+  anno_group_all->CopyFrom(anno_datum.annotation_group());
+  if (transform_param.has_distort_param()) {
+    cv::Mat distort_img;
+    transformer->DistortImage(cv_img, &distort_img);
+    cv_img = distort_img;
+  }
+  if (transform_param.has_expand_param()) {
+    cv::Mat expand_img;
+    RepeatedPtrField<AnnotationGroup> expand_anno;
+    transformer->ExpandImage(cv_img, *anno_group_all, &expand_img,
+                             &expand_anno);
+    cv_img = expand_img;
+    anno_group_all->Swap(&expand_anno);
+  }
+  if (batch_samplers_.size() > 0) {
+    // Generate sampled bboxes from the expanded image.
+    vector<NormalizedBBox> sampled_bboxes;
+    GenerateBatchSamples(*anno_group_all, batch_samplers_, &sampled_bboxes);
+    if (sampled_bboxes.size() > 0) {
+      // Randomly pick a sampled bbox and crop the image.
+      int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+      cv::Mat crop_img;
+      RepeatedPtrField<AnnotationGroup> crop_anno;
+      transformer->CropImage(cv_img, *anno_group_all,
+                             sampled_bboxes[rand_idx], &crop_img, &crop_anno);
+      cv_img = crop_img;
+      anno_group_all->Swap(&crop_anno);
     }
   }
-  timer.Stop();
-  batch_timer.Stop();
-  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
-  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  *img = cv_img;
 }
+#endif  // USE_OPENCV
 
 INSTANTIATE_CLASS(AnnotatedDataLayer);
 REGISTER_LAYER_CLASS(AnnotatedData);
@@ -165,6 +165,14 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     // Initialize and fill the weights:
     // output channels x input channels per-group x kernel height x kernel width
     this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    // Convolution filters take part in pruning like InnerProduct weights;
+    // their CSR form has one row per output channel, so deconvolution
+    // cannot compute with it.
+    SparsityParameter::Mode sparsity = this->sparsity_mode(0);
+    if (reverse_dimensions() && sparsity == SparsityParameter::SPARSE) {
+      sparsity = SparsityParameter::PRUNE;
+    }
+    this->blobs_[0]->set_sparsity_mode(sparsity);
     shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
         this->layer_param_.convolution_param().weight_filler()));
     weight_filler->Fill(this->blobs_[0].get());
@@ -320,6 +328,47 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_csrmm(const Dtype* input,
+    Dtype* output) {
+  const Blob<Dtype>& weight = *this->blobs_[0];
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  // Each group owns a contiguous band of CSR rows; row pointers are global
+  // offsets into csrval/csrcolind, so the band is addressed by offsetting
+  // csrrowptr alone.
+  const int rows_per_group = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_csrmm<Dtype>(CblasNoTrans, rows_per_group,
+        conv_out_spatial_dim_, kernel_dim_, (Dtype)1., weight.cpu_csrval(),
+        weight.cpu_csrrowptr() + rows_per_group * g, weight.cpu_csrcolind(),
+        col_buff + col_offset_ * g, (Dtype)0., output + output_offset_ * g);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_csrmm(const Dtype* output,
+    Dtype* input) {
+  const Blob<Dtype>& weight = *this->blobs_[0];
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  if (is_1x1_) {
+    col_buff = input;
+  }
+  const int rows_per_group = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_csrmm<Dtype>(CblasTrans, kernel_dim_, conv_out_spatial_dim_,
+        rows_per_group, (Dtype)1., weight.cpu_csrval(),
+        weight.cpu_csrrowptr() + rows_per_group * g, weight.cpu_csrcolind(),
+        output + output_offset_ * g, (Dtype)0., col_buff + col_offset_ * g);
+  }
+  if (!is_1x1_) {
+    conv_col2im_cpu(col_buff, input);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -36,42 +36,107 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.data_param().prefetch()),
+      prefetch_free_(), prefetch_full_(),
+      host_allocator_(new PageAllocator(
+          param.data_param().prefetch_huge_pages(),
+          param.data_param().prefetch_numa_node())),
+      num_workers_(param.data_param().num_workers()) {
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be positive.";
+  CHECK_GT(num_workers_, 0) << "num_workers must be positive.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_[i]->data_.set_host_allocator(host_allocator_);
+    prefetch_[i]->label_.set_host_allocator(host_allocator_);
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (num_workers_ > 1 && !SupportsWorkers()) {
+    LOG(WARNING) << this->type() << " layer " << this->layer_param_.name()
+                 << " does not support num_workers > 1; using 1 worker.";
+    num_workers_ = 1;
+  }
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
 #endif
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
+  // Each worker gets its own transformer and thread, and hence its own
+  // random streams, all seeded here in a fixed order.
+  data_transformers_.clear();
+  data_transformers_.push_back(this->data_transformer_);
+  for (int i = 1; i < num_workers_; ++i) {
+    data_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    data_transformers_.back()->InitRand();
+  }
+  for (int i = 1; i < num_workers_; ++i) {
+    workers_.push_back(shared_ptr<Worker>(new Worker(this, i)));
+  }
   StartInternalThread();
   DLOG(INFO) << "Prefetch initialized.";
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::RunWorkers() {
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->start_.push(i + 1);
+  }
+  transform_items(0);
+  // The workers use the batch, so do not stop before they are done.
+  boost::this_thread::disable_interruption no_interruption;
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_done_.pop();
+  }
+}
+
+template <typename Dtype>
+BasePrefetchingDataLayer<Dtype>::Worker::Worker(
+    BasePrefetchingDataLayer<Dtype>* layer, int worker_id)
+    : layer_(layer), worker_id_(worker_id) {
+  StartInternalThread();
+}
+
+template <typename Dtype>
+BasePrefetchingDataLayer<Dtype>::Worker::~Worker() {
+  StopInternalThread();
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::Worker::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      start_.pop();
+      layer_->transform_items(worker_id_);
+      layer_->workers_done_.push(worker_id_);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #ifndef CPU_ONLY
@@ -5,13 +5,26 @@
 #include <utility>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "boost/filesystem.hpp"
-#include "boost/foreach.hpp"
 
 #include "caffe/layers/detection_output_layer.hpp"
 
 namespace caffe {
 
+// Order detections (score, (label, index)) by label, then by descending score.
+template <typename Dtype>
+static bool SortDetectionByLabel(const pair<Dtype, pair<int, int> >& det1,
+                                 const pair<Dtype, pair<int, int> >& det2) {
+  if (det1.second.first != det2.second.first) {
+    return det1.second.first < det2.second.first;
+  }
+  return SortScoreIndexDescend(det1, det2);
+}
+
 template <typename Dtype>
 void DetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -29,6 +42,7 @@ void DetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   confidence_threshold_ = detection_output_param.has_confidence_threshold() ?
       detection_output_param.confidence_threshold() : -FLT_MAX;
   // Parameters used in nms.
+  nms_param_ = detection_output_param.nms_param();
   nms_threshold_ = detection_output_param.nms_param().nms_threshold();
   CHECK_GE(nms_threshold_, 0.) << "nms_threshold must be non negative.";
   eta_ = detection_output_param.nms_param().eta();
@@ -38,6 +52,11 @@ void DetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (detection_output_param.nms_param().has_top_k()) {
     top_k_ = detection_output_param.nms_param().top_k();
   }
+  if (nms_param_.algorithm() ==
+      NonMaximumSuppressionParameter_Algorithm_BITMASK) {
+    CHECK_EQ(eta_, 1.) << "BITMASK nms does not support adaptive nms.";
+  }
+  CHECK_GT(nms_param_.sigma(), 0.);
   const SaveOutputParameter& save_output_param =
       detection_output_param.save_output_param();
   output_directory_ = save_output_param.output_directory();
@@ -105,6 +124,10 @@ void DetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     resize_param_ = save_output_param.resize_param();
   }
   name_count_ = 0;
+  if (need_save_) {
+    writer_.reset(new DetectionWriter(output_directory_, output_name_prefix_,
+        output_format_, label_to_name_, num_classes_, background_label_id_));
+  }
   visualize_ = detection_output_param.visualize();
   if (visualize_) {
     visualize_threshold_ = 0.6;
@@ -127,26 +150,6 @@ void DetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void DetectionOutputLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  if (need_save_) {
-    CHECK_LE(name_count_, names_.size());
-    if (name_count_ % num_test_image_ == 0) {
-      // Clean all outputs.
-      if (output_format_ == "VOC") {
-        boost::filesystem::path output_directory(output_directory_);
-        for (map<int, string>::iterator it = label_to_name_.begin();
-             it != label_to_name_.end(); ++it) {
-          if (it->first == background_label_id_) {
-            continue;
-          }
-          std::ofstream outfile;
-          boost::filesystem::path file(
-              output_name_prefix_ + it->second + ".txt");
-          boost::filesystem::path out_file = output_directory / file;
-          outfile.open(out_file.string().c_str(), std::ofstream::out);
-        }
-      }
-    }
-  }
   CHECK_EQ(bottom[0]->num(), bottom[1]->num());
   if (bbox_preds_.num() != bottom[0]->num() ||
       bbox_preds_.count(1) != bottom[0]->count(1)) {
@@ -180,99 +183,86 @@ template <typename Dtype>
 void DetectionOutputLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   const Dtype* loc_data = bottom[0]->cpu_data();
-  const Dtype* conf_data = bottom[1]->cpu_data();
   const Dtype* prior_data = bottom[2]->cpu_data();
   const int num = bottom[0]->num();
 
-  // Retrieve all location predictions.
-  vector<LabelBBox> all_loc_preds;
-  GetLocPredictions(loc_data, num, num_priors_, num_loc_classes_,
-                    share_location_, &all_loc_preds);
-
-  // Retrieve all confidences.
-  vector<map<int, vector<float> > > all_conf_scores;
-  GetConfidenceScores(conf_data, num, num_priors_, num_classes_,
-                      &all_conf_scores);
+  // Decode all loc predictions to bboxes, stored as
+  // num x num_loc_classes x num_priors x 4.
+  Dtype* bbox_data = bbox_preds_.mutable_cpu_data();
+  const bool clip_bbox = false;
+  priors_ = GetPriorBBoxes(prior_data, num_priors_, priors_);
+  DecodeBBoxesAll(loc_data, *priors_, num, share_location_, num_loc_classes_,
+                  background_label_id_, code_type_,
+                  variance_encoded_in_target_, clip_bbox, bbox_data);
 
-  // Retrieve all prior bboxes. It is same within a batch since we assume all
-  // images in a batch are of same dimension.
-  vector<NormalizedBBox> prior_bboxes;
-  vector<vector<float> > prior_variances;
-  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes, &prior_variances);
+  // Retrieve all confidences as num x num_classes x num_priors.
+  Dtype* conf_data = conf_permute_.mutable_cpu_data();
+  PermuteData(bottom[1]->count(), bottom[1]->cpu_data(), num_classes_,
+              num_priors_, 1, conf_data);
 
-  // Decode all loc predictions to bboxes.
-  vector<LabelBBox> all_decode_bboxes;
-  const bool clip_bbox = false;
-  DecodeBBoxesAll(all_loc_preds, prior_bboxes, prior_variances, num,
-                  share_location_, num_loc_classes_, background_label_id_,
-                  code_type_, variance_encoded_in_target_, clip_bbox,
-                  &all_decode_bboxes);
+  // Do nms for every (image, class) pair independently. Each thread uses its
+  // own scratch space, and the results do not depend on the scheduling.
+  const int num_tasks = num * num_classes_;
+  int num_threads = 1;
+#ifdef _OPENMP
+  num_threads = omp_get_max_threads();
+#endif
+  nms_buffers_.resize(num_threads);
+  nms_indices_.resize(num_tasks);
+  nms_scores_.resize(num_tasks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int task = 0; task < num_tasks; ++task) {
+    const int i = task / num_classes_;
+    const int c = task % num_classes_;
+    if (c == background_label_id_) {
+      // Ignore background class.
+      nms_indices_[task].clear();
+      nms_scores_[task].clear();
+      continue;
+    }
+    int thread_id = 0;
+#ifdef _OPENMP
+    thread_id = omp_get_thread_num();
+#endif
+    const int loc_label = share_location_ ? 0 : c;
+    ApplyNMS(bbox_data + (i * num_loc_classes_ + loc_label) * num_priors_ * 4,
+        conf_data + task * num_priors_, num_priors_, confidence_threshold_,
+        nms_param_, &(nms_buffers_[thread_id]), &(nms_indices_[task]),
+        &(nms_scores_[task]));
+  }
 
-  int num_kept = 0;
-  vector<map<int, vector<int> > > all_indices;
+  // Merge the classes of each image, keeping the keep_top_k_ best ones.
+  kept_.resize(num);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
   for (int i = 0; i < num; ++i) {
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    map<int, vector<int> > indices;
-    int num_det = 0;
+    vector<pair<Dtype, pair<int, int> > >& kept = kept_[i];
+    kept.clear();
     for (int c = 0; c < num_classes_; ++c) {
-      if (c == background_label_id_) {
-        // Ignore background class.
-        continue;
-      }
-      if (conf_scores.find(c) == conf_scores.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find confidence predictions for label " << c;
-      }
-      const vector<float>& scores = conf_scores.find(c)->second;
-      int label = share_location_ ? -1 : c;
-      if (decode_bboxes.find(label) == decode_bboxes.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find location predictions for label " << label;
-        continue;
+      const vector<int>& label_indices = nms_indices_[i * num_classes_ + c];
+      const vector<Dtype>& label_scores = nms_scores_[i * num_classes_ + c];
+      for (int j = 0; j < label_indices.size(); ++j) {
+        kept.push_back(std::make_pair(label_scores[j],
+                                      std::make_pair(c, label_indices[j])));
       }
-      const vector<NormalizedBBox>& bboxes = decode_bboxes.find(label)->second;
-      ApplyNMSFast(bboxes, scores, confidence_threshold_, nms_threshold_, eta_,
-          top_k_, &(indices[c]));
-      num_det += indices[c].size();
     }
-    if (keep_top_k_ > -1 && num_det > keep_top_k_) {
-      vector<pair<float, pair<int, int> > > score_index_pairs;
-      for (map<int, vector<int> >::iterator it = indices.begin();
-           it != indices.end(); ++it) {
-        int label = it->first;
-        const vector<int>& label_indices = it->second;
-        if (conf_scores.find(label) == conf_scores.end()) {
-          // Something bad happened for current label.
-          LOG(FATAL) << "Could not find location predictions for " << label;
-          continue;
-        }
-        const vector<float>& scores = conf_scores.find(label)->second;
-        for (int j = 0; j < label_indices.size(); ++j) {
-          int idx = label_indices[j];
-          CHECK_LT(idx, scores.size());
-          score_index_pairs.push_back(std::make_pair(
-                  scores[idx], std::make_pair(label, idx)));
-        }
-      }
-      // Keep top k results per image.
-      std::sort(score_index_pairs.begin(), score_index_pairs.end(),
-                SortScorePairDescend<pair<int, int> >);
-      score_index_pairs.resize(keep_top_k_);
-      // Store the new indices.
-      map<int, vector<int> > new_indices;
-      for (int j = 0; j < score_index_pairs.size(); ++j) {
-        int label = score_index_pairs[j].second.first;
-        int idx = score_index_pairs[j].second.second;
-        new_indices[label].push_back(idx);
-      }
-      all_indices.push_back(new_indices);
-      num_kept += keep_top_k_;
-    } else {
-      all_indices.push_back(indices);
-      num_kept += num_det;
+    if (keep_top_k_ > -1 && kept.size() > keep_top_k_) {
+      // Keep top k results per image, grouped by label.
+      std::partial_sort(kept.begin(), kept.begin() + keep_top_k_, kept.end(),
+                        SortScoreIndexDescend<Dtype, pair<int, int> >);
+      kept.resize(keep_top_k_);
+      std::sort(kept.begin(), kept.end(), SortDetectionByLabel<Dtype>);
     }
   }
+  kept_start_.resize(num + 1);
+  kept_start_[0] = 0;
+  for (int i = 0; i < num; ++i) {
+    kept_start_[i + 1] = kept_start_[i] + kept_[i].size();
+  }
+  const int num_kept = kept_start_[num];
 
   vector<int> top_shape(2, 1);
   top_shape.push_back(num_kept);
@@ -294,168 +284,51 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
     top_data = top[0]->mutable_cpu_data();
   }
 
-  int count = 0;
-  boost::filesystem::path output_directory(output_directory_);
   for (int i = 0; i < num; ++i) {
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
-    for (map<int, vector<int> >::iterator it = all_indices[i].begin();
-         it != all_indices[i].end(); ++it) {
-      int label = it->first;
-      if (conf_scores.find(label) == conf_scores.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find confidence predictions for " << label;
-        continue;
-      }
-      const vector<float>& scores = conf_scores.find(label)->second;
-      int loc_label = share_location_ ? -1 : label;
-      if (decode_bboxes.find(loc_label) == decode_bboxes.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find location predictions for " << loc_label;
-        continue;
-      }
-      const vector<NormalizedBBox>& bboxes =
-          decode_bboxes.find(loc_label)->second;
-      vector<int>& indices = it->second;
+    if (need_save_) {
+      CHECK_LT(name_count_, names_.size());
+      writer_->AddImage(names_[name_count_]);
+    }
+    for (int j = 0; j < kept_[i].size(); ++j) {
+      const int count = kept_start_[i] + j;
+      const int label = kept_[i][j].second.first;
+      const int idx = kept_[i][j].second.second;
+      const int loc_label = share_location_ ? 0 : label;
+      const Dtype* bbox = bbox_data +
+          ((i * num_loc_classes_ + loc_label) * num_priors_ + idx) * 4;
+      top_data[count * 7] = i;
+      top_data[count * 7 + 1] = label;
+      top_data[count * 7 + 2] = kept_[i][j].first;
+      top_data[count * 7 + 3] = bbox[0];
+      top_data[count * 7 + 4] = bbox[1];
+      top_data[count * 7 + 5] = bbox[2];
+      top_data[count * 7 + 6] = bbox[3];
       if (need_save_) {
         CHECK(label_to_name_.find(label) != label_to_name_.end())
           << "Cannot find label: " << label << " in the label map.";
-        CHECK_LT(name_count_, names_.size());
-      }
-      for (int j = 0; j < indices.size(); ++j) {
-        int idx = indices[j];
-        top_data[count * 7] = i;
-        top_data[count * 7 + 1] = label;
-        top_data[count * 7 + 2] = scores[idx];
-        const NormalizedBBox& bbox = bboxes[idx];
-        top_data[count * 7 + 3] = bbox.xmin();
-        top_data[count * 7 + 4] = bbox.ymin();
-        top_data[count * 7 + 5] = bbox.xmax();
-        top_data[count * 7 + 6] = bbox.ymax();
-        if (need_save_) {
-          NormalizedBBox out_bbox;
-          OutputBBox(bbox, sizes_[name_count_], has_resize_, resize_param_,
-                     &out_bbox);
-          float score = top_data[count * 7 + 2];
-          float xmin = out_bbox.xmin();
-          float ymin = out_bbox.ymin();
-          float xmax = out_bbox.xmax();
-          float ymax = out_bbox.ymax();
-          ptree pt_xmin, pt_ymin, pt_width, pt_height;
-          pt_xmin.put<float>("", round(xmin * 100) / 100.);
-          pt_ymin.put<float>("", round(ymin * 100) / 100.);
-          pt_width.put<float>("", round((xmax - xmin) * 100) / 100.);
-          pt_height.put<float>("", round((ymax - ymin) * 100) / 100.);
-
-          ptree cur_bbox;
-          cur_bbox.push_back(std::make_pair("", pt_xmin));
-          cur_bbox.push_back(std::make_pair("", pt_ymin));
-          cur_bbox.push_back(std::make_pair("", pt_width));
-          cur_bbox.push_back(std::make_pair("", pt_height));
-
-          ptree cur_det;
-          cur_det.put("image_id", names_[name_count_]);
-          if (output_format_ == "ILSVRC") {
-            cur_det.put<int>("category_id", label);
-          } else {
-            cur_det.put("category_id", label_to_name_[label].c_str());
-          }
-          cur_det.add_child("bbox", cur_bbox);
-          cur_det.put<float>("score", score);
-
-          detections_.push_back(std::make_pair("", cur_det));
-        }
-        ++count;
+        NormalizedBBox in_bbox;
+        in_bbox.set_xmin(bbox[0]);
+        in_bbox.set_ymin(bbox[1]);
+        in_bbox.set_xmax(bbox[2]);
+        in_bbox.set_ymax(bbox[3]);
+        NormalizedBBox out_bbox;
+        OutputBBox(in_bbox, sizes_[name_count_], has_resize_, resize_param_,
+                   &out_bbox);
+        writer_->AddDetection(label, top_data[count * 7 + 2], out_bbox.xmin(),
+            out_bbox.ymin(), out_bbox.xmax(), out_bbox.ymax());
       }
     }
     if (need_save_) {
       ++name_count_;
       if (name_count_ % num_test_image_ == 0) {
-        if (output_format_ == "VOC") {
-          map<string, std::ofstream*> outfiles;
-          for (int c = 0; c < num_classes_; ++c) {
-            if (c == background_label_id_) {
-              continue;
-            }
-            string label_name = label_to_name_[c];
-            boost::filesystem::path file(
-                output_name_prefix_ + label_name + ".txt");
-            boost::filesystem::path out_file = output_directory / file;
-            outfiles[label_name] = new std::ofstream(out_file.string().c_str(),
-                std::ofstream::out);
-          }
-          BOOST_FOREACH(ptree::value_type &det, detections_.get_child("")) {
-            ptree pt = det.second;
-            string label_name = pt.get<string>("category_id");
-            if (outfiles.find(label_name) == outfiles.end()) {
-              std::cout << "Cannot find " << label_name << std::endl;
-              continue;
-            }
-            string image_name = pt.get<string>("image_id");
-            float score = pt.get<float>("score");
-            vector<int> bbox;
-            BOOST_FOREACH(ptree::value_type &elem, pt.get_child("bbox")) {
-              bbox.push_back(static_cast<int>(elem.second.get_value<float>()));
-            }
-            *(outfiles[label_name]) << image_name;
-            *(outfiles[label_name]) << " " << score;
-            *(outfiles[label_name]) << " " << bbox[0] << " " << bbox[1];
-            *(outfiles[label_name]) << " " << bbox[0] + bbox[2];
-            *(outfiles[label_name]) << " " << bbox[1] + bbox[3];
-            *(outfiles[label_name]) << std::endl;
-          }
-          for (int c = 0; c < num_classes_; ++c) {
-            if (c == background_label_id_) {
-              continue;
-            }
-            string label_name = label_to_name_[c];
-            outfiles[label_name]->flush();
-            outfiles[label_name]->close();
-            delete outfiles[label_name];
-          }
-        } else if (output_format_ == "COCO") {
-          boost::filesystem::path output_directory(output_directory_);
-          boost::filesystem::path file(output_name_prefix_ + ".json");
-          boost::filesystem::path out_file = output_directory / file;
-          std::ofstream outfile;
-          outfile.open(out_file.string().c_str(), std::ofstream::out);
-
-          boost::regex exp("\"(null|true|false|-?[0-9]+(\\.[0-9]+)?)\"");
-          ptree output;
-          output.add_child("detections", detections_);
-          std::stringstream ss;
-          write_json(ss, output);
-          std::string rv = boost::regex_replace(ss.str(), exp, "$1");
-          outfile << rv.substr(rv.find("["), rv.rfind("]") - rv.find("["))
-              << std::endl << "]" << std::endl;
-        } else if (output_format_ == "ILSVRC") {
-          boost::filesystem::path output_directory(output_directory_);
-          boost::filesystem::path file(output_name_prefix_ + ".txt");
-          boost::filesystem::path out_file = output_directory / file;
-          std::ofstream outfile;
-          outfile.open(out_file.string().c_str(), std::ofstream::out);
-
-          BOOST_FOREACH(ptree::value_type &det, detections_.get_child("")) {
-            ptree pt = det.second;
-            int label = pt.get<int>("category_id");
-            string image_name = pt.get<string>("image_id");
-            float score = pt.get<float>("score");
-            vector<int> bbox;
-            BOOST_FOREACH(ptree::value_type &elem, pt.get_child("bbox")) {
-              bbox.push_back(static_cast<int>(elem.second.get_value<float>()));
-            }
-            outfile << image_name << " " << label << " " << score;
-            outfile << " " << bbox[0] << " " << bbox[1];
-            outfile << " " << bbox[0] + bbox[2];
-            outfile << " " << bbox[1] + bbox[3];
-            outfile << std::endl;
-          }
-        }
+        writer_->Commit(true);
         name_count_ = 0;
-        detections_.clear();
       }
     }
   }
+  if (need_save_) {
+    writer_->Commit(false);
+  }
   if (visualize_) {
 #ifdef USE_OPENCV
     vector<cv::Mat> cv_imgs;
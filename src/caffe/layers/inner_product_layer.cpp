@@ -39,9 +39,14 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
     
 	this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
-    this->blobs_[0]->setSparse();
-    this->blobs_[0]->Addmask(weight_shape);
-    LOG(INFO)<<this->blobs_[0]->sparse();
+    SparsityParameter::Mode sparsity = this->sparsity_mode(0);
+    if (transpose_ && sparsity == SparsityParameter::SPARSE) {
+      // The CSR rows must be the outputs; expand transposed weights instead.
+      LOG(WARNING) << "Sparse inference needs transpose: false; layer "
+          << this->layer_param_.name() << " uses dense weights.";
+      sparsity = SparsityParameter::PRUNE;
+    }
+    this->blobs_[0]->set_sparsity_mode(sparsity);
     // fill the weights
     shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
         this->layer_param_.inner_product_param().weight_filler()));
@@ -82,6 +87,14 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     bias_multiplier_.Reshape(bias_shape);
     caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
   }
+  // The batched CSR path works on transposed activations.
+  if (this->blobs_[0]->use_csr() && !transpose_ && M_ > 1) {
+    vector<int> buffer_shape(2, M_);
+    buffer_shape[0] = K_;
+    csr_bottom_buffer_.Reshape(buffer_shape);
+    buffer_shape[0] = N_;
+    csr_top_buffer_.Reshape(buffer_shape);
+  }
 }
 
 template <typename Dtype>
@@ -89,10 +102,32 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (this->blobs_[0]->use_csr() && !transpose_) {
+    // Pruned N_ x K_ weights in CSR form: only surviving connections are
+    // visited. For batches compute top^T = W * bottom^T so that the inner
+    // loop of the sparse product runs contiguously over the batch.
+    const Blob<Dtype>& weight = *this->blobs_[0];
+    if (M_ == 1) {
+      caffe_cpu_csrmv<Dtype>(CblasNoTrans, N_, K_, (Dtype)1.,
+          weight.cpu_csrval(), weight.cpu_csrrowptr(), weight.cpu_csrcolind(),
+          weight.nnz(), bottom_data, (Dtype)0., top_data);
+    } else {
+      caffe_cpu_transpose<Dtype>(M_, K_, bottom_data,
+          csr_bottom_buffer_.mutable_cpu_data());
+      caffe_cpu_csrmm<Dtype>(CblasNoTrans, N_, M_, K_, (Dtype)1.,
+          weight.cpu_csrval(), weight.cpu_csrrowptr(), weight.cpu_csrcolind(),
+          csr_bottom_buffer_.cpu_data(), (Dtype)0.,
+          csr_top_buffer_.mutable_cpu_data());
+      caffe_cpu_transpose<Dtype>(N_, M_, csr_top_buffer_.cpu_data(),
+          top_data);
+    }
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans,
+        transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -130,7 +165,25 @@ void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (propagate_down[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     // Gradient with respect to bottom data
-    if (transpose_) {
+    if (this->blobs_[0]->use_csr() && !transpose_) {
+      // bottom_diff^T = W^T * top_diff^T with W kept in CSR form.
+      const Blob<Dtype>& weight = *this->blobs_[0];
+      if (M_ == 1) {
+        caffe_cpu_csrmv<Dtype>(CblasTrans, N_, K_, (Dtype)1.,
+            weight.cpu_csrval(), weight.cpu_csrrowptr(),
+            weight.cpu_csrcolind(), weight.nnz(), top_diff, (Dtype)0.,
+            bottom[0]->mutable_cpu_diff());
+      } else {
+        caffe_cpu_transpose<Dtype>(M_, N_, top_diff,
+            csr_top_buffer_.mutable_cpu_diff());
+        caffe_cpu_csrmm<Dtype>(CblasTrans, K_, M_, N_, (Dtype)1.,
+            weight.cpu_csrval(), weight.cpu_csrrowptr(),
+            weight.cpu_csrcolind(), csr_top_buffer_.cpu_diff(), (Dtype)0.,
+            csr_bottom_buffer_.mutable_cpu_diff());
+        caffe_cpu_transpose<Dtype>(K_, M_, csr_bottom_buffer_.cpu_diff(),
+            bottom[0]->mutable_cpu_diff());
+      }
+    } else if (transpose_) {
       caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans,
           M_, K_, N_,
           (Dtype)1., top_diff, this->blobs_[0]->cpu_data(),
@@ -0,0 +1,72 @@
+#include <vector>
+
+#include "caffe/layers/multibox_head_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void MultiBoxHeadLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  num_ = bottom[0]->num();
+  top_dim_ = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    CHECK_EQ(bottom[i]->num_axes(), 4)
+        << "bottom[" << i << "] should be N x C x H x W.";
+    CHECK_EQ(bottom[i]->num(), num_)
+        << "All the bottoms should have the same num.";
+    top_dim_ += bottom[i]->count(1);
+  }
+  vector<int> top_shape(2);
+  top_shape[0] = num_;
+  top_shape[1] = top_dim_;
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void MultiBoxHeadLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  int offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    const int channels = bottom[i]->channels();
+    const int spatial_dim = bottom[i]->count(2);
+    const int dim = channels * spatial_dim;
+    for (int n = 0; n < num_; ++n) {
+      caffe_cpu_transpose(channels, spatial_dim, bottom_data + n * dim,
+                          top_data + n * top_dim_ + offset);
+    }
+    offset += dim;
+  }
+}
+
+template <typename Dtype>
+void MultiBoxHeadLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->cpu_diff();
+  int offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const int channels = bottom[i]->channels();
+    const int spatial_dim = bottom[i]->count(2);
+    const int dim = channels * spatial_dim;
+    if (propagate_down[i]) {
+      Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      for (int n = 0; n < num_; ++n) {
+        caffe_cpu_transpose(spatial_dim, channels,
+                            top_diff + n * top_dim_ + offset,
+                            bottom_diff + n * dim);
+      }
+    }
+    offset += dim;
+  }
+}
+
+#ifdef CPU_ONLY
+STUB_GPU(MultiBoxHeadLayer);
+#endif
+
+INSTANTIATE_CLASS(MultiBoxHeadLayer);
+REGISTER_LAYER_CLASS(MultiBoxHead);
+
+}  // namespace caffe
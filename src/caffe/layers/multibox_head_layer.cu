@@ -0,0 +1,73 @@
+#include <vector>
+
+#include "caffe/layers/multibox_head_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// One thread per element of the slice of the top, so that the writes of the
+// forward pass and the reads of the backward pass are coalesced.
+template <typename Dtype>
+__global__ void MultiBoxHead(const int nthreads, const Dtype* in_data,
+    const bool forward, const int channels, const int spatial_dim,
+    const int top_dim, const int offset, Dtype* out_data) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int dim = channels * spatial_dim;
+    const int n = index / dim;
+    const int top_index = index % dim;
+    const int s = top_index / channels;
+    const int c = top_index % channels;
+    const int bottom_index = (n * channels + c) * spatial_dim + s;
+    if (forward) {
+      out_data[n * top_dim + offset + top_index] = in_data[bottom_index];
+    } else {
+      out_data[bottom_index] = in_data[n * top_dim + offset + top_index];
+    }
+  }
+}
+
+template <typename Dtype>
+void MultiBoxHeadLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  Dtype* top_data = top[0]->mutable_gpu_data();
+  int offset = 0;
+  const bool kForward = true;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->gpu_data();
+    const int channels = bottom[i]->channels();
+    const int spatial_dim = bottom[i]->count(2);
+    const int nthreads = bottom[i]->count();
+    MultiBoxHead<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+        <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
+        nthreads, bottom_data, kForward, channels, spatial_dim, top_dim_,
+        offset, top_data);
+    offset += bottom[i]->count(1);
+  }
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template <typename Dtype>
+void MultiBoxHeadLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->gpu_diff();
+  int offset = 0;
+  const bool kForward = false;
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (propagate_down[i]) {
+      Dtype* bottom_diff = bottom[i]->mutable_gpu_diff();
+      const int channels = bottom[i]->channels();
+      const int spatial_dim = bottom[i]->count(2);
+      const int nthreads = bottom[i]->count();
+      MultiBoxHead<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+          <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
+          nthreads, top_diff, kForward, channels, spatial_dim, top_dim_,
+          offset, bottom_diff);
+    }
+    offset += bottom[i]->count(1);
+  }
+  CUDA_POST_KERNEL_CHECK;
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(MultiBoxHeadLayer);
+
+}  // namespace caffe
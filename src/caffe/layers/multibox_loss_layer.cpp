@@ -40,6 +40,7 @@ void MultiBoxLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
              mining_type_ != MultiBoxLossParameter_MiningType_NONE);
   }
   do_neg_mining_ = mining_type_ != MultiBoxLossParameter_MiningType_NONE;
+  use_prior_for_matching_ = multibox_loss_param.use_prior_for_matching();
 
   if (!this->layer_param_.loss_param().has_normalization() &&
       this->layer_param_.loss_param().has_normalize()) {
@@ -126,6 +127,22 @@ void MultiBoxLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   } else {
     LOG(FATAL) << "Unknown confidence loss type.";
   }
+  fuse_conf_loss_ =
+      mining_type_ == MultiBoxLossParameter_MiningType_MAX_NEGATIVE &&
+      conf_loss_type_ == MultiBoxLossParameter_ConfLossType_SOFTMAX &&
+      use_prior_for_matching_ &&
+      !multibox_loss_param.map_object_to_agnostic() &&
+      !(multibox_loss_param.has_nms_param() &&
+        multibox_loss_param.nms_param().nms_threshold() > 0);
+}
+
+// Set the gradient of the softmax loss of one prior, as SoftmaxWithLoss does.
+template <typename Dtype>
+static void SoftmaxLossDiff(const Dtype* prob, const int num_classes,
+    const int label, const Dtype loss_weight, Dtype* diff) {
+  caffe_copy(num_classes, prob, diff);
+  diff[label] -= 1;
+  caffe_scal(num_classes, loss_weight, diff);
 }
 
 template <typename Dtype>
@@ -157,9 +174,15 @@ void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 
   // Retrieve all prior bboxes. It is same within a batch since we assume all
   // images in a batch are of same dimension.
-  vector<NormalizedBBox> prior_bboxes;
-  vector<vector<float> > prior_variances;
-  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes, &prior_variances);
+  shared_ptr<const PriorBBoxes> priors =
+      GetPriorBBoxes(prior_data, num_priors_, priors_);
+  if (priors != priors_) {
+    priors_ = priors;
+    GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes_,
+                   &prior_variances_);
+  }
+  const vector<NormalizedBBox>& prior_bboxes = prior_bboxes_;
+  const vector<vector<float> >& prior_variances = prior_variances_;
 
   // Retrieve all predictions.
   vector<LabelBBox> all_loc_preds;
@@ -168,16 +191,47 @@ void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 
   // Find matches between source bboxes and ground truth bboxes.
   vector<map<int, vector<float> > > all_match_overlaps;
-  FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
-              multibox_loss_param_, &all_match_overlaps, &all_match_indices_);
+  if (use_prior_for_matching_) {
+    GetGroundTruth(gt_data, num_gt_, num_, background_label_id_,
+                   use_difficult_gt_, &gt_bboxes_, &gt_labels_, &gt_start_);
+    FindMatches(*priors_, gt_bboxes_, gt_labels_, gt_start_,
+                multibox_loss_param_, &match_buffers_, &all_match_overlaps,
+                &all_match_indices_);
+  } else {
+    FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
+                multibox_loss_param_, &all_match_overlaps,
+                &all_match_indices_);
+  }
 
+  // Mine the negatives of this batch, even if Backward did not run on the
+  // previous one.
+  all_neg_indices_.clear();
   num_matches_ = 0;
   int num_negs = 0;
-  // Sample hard negative (and positive) examples based on mining type.
-  MineHardExamples(*bottom[1], all_loc_preds, all_gt_bboxes, prior_bboxes,
-                   prior_variances, all_match_overlaps, multibox_loss_param_,
-                   &num_matches_, &num_negs, &all_match_indices_,
-                   &all_neg_indices_);
+  if (fuse_conf_loss_) {
+    // Mine hard negatives on the softmax loss of every prior, which also
+    // gives the confidence loss of the selected priors below.
+    conf_prob_.ReshapeLike(*bottom[1]);
+    vector<int> prior_shape(2);
+    prior_shape[0] = num_;
+    prior_shape[1] = num_priors_;
+    prior_conf_loss_.Reshape(prior_shape);
+    ComputeConfLossSoftmax(conf_data, num_, num_priors_, num_classes_,
+                           background_label_id_, all_match_indices_,
+                           gt_labels_, gt_start_,
+                           conf_prob_.mutable_cpu_data(),
+                           prior_conf_loss_.mutable_cpu_data());
+    num_matches_ = CountNumMatches(all_match_indices_, num_);
+    MineHardNegatives(prior_conf_loss_.cpu_data(), num_, num_priors_,
+                      all_match_overlaps, all_match_indices_,
+                      multibox_loss_param_, &num_negs, &all_neg_indices_);
+  } else {
+    // Sample hard negative (and positive) examples based on mining type.
+    MineHardExamples(*bottom[1], all_loc_preds, all_gt_bboxes, prior_bboxes,
+                     prior_variances, all_match_overlaps, multibox_loss_param_,
+                     &num_matches_, &num_negs, &all_match_indices_,
+                     &all_neg_indices_);
+  }
 
   if (num_matches_ >= 1) {
     // Form data to pass on to loc_loss_layer_.
@@ -203,7 +257,29 @@ void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   } else {
     num_conf_ = num_ * num_priors_;
   }
-  if (num_conf_ >= 1) {
+  if (fuse_conf_loss_) {
+    // Sum the losses of the matched and mined priors in the order of
+    // EncodeConfPrediction.
+    const Dtype* prior_conf_loss = prior_conf_loss_.cpu_data();
+    Dtype loss = 0;
+    for (int i = 0; i < num_; ++i) {
+      for (map<int, vector<int> >::const_iterator it =
+           all_match_indices_[i].begin();
+           it != all_match_indices_[i].end(); ++it) {
+        const vector<int>& match_index = it->second;
+        for (int j = 0; j < num_priors_; ++j) {
+          if (match_index[j] > -1) {
+            loss += prior_conf_loss[j];
+          }
+        }
+      }
+      for (int n = 0; n < all_neg_indices_[i].size(); ++n) {
+        loss += prior_conf_loss[all_neg_indices_[i][n]];
+      }
+      prior_conf_loss += num_priors_;
+    }
+    conf_loss_.mutable_cpu_data()[0] = loss;
+  } else if (num_conf_ >= 1) {
     // Reshape the confidence data.
     vector<int> conf_shape;
     if (conf_loss_type_ == MultiBoxLossParameter_ConfLossType_SOFTMAX) {
@@ -311,7 +387,36 @@ void MultiBoxLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (propagate_down[1]) {
     Dtype* conf_bottom_diff = bottom[1]->mutable_cpu_diff();
     caffe_set(bottom[1]->count(), Dtype(0), conf_bottom_diff);
-    if (num_conf_ >= 1) {
+    if (fuse_conf_loss_ && num_conf_ >= 1) {
+      // Compute the gradient from the probabilities of the forward pass.
+      Dtype normalizer = LossLayer<Dtype>::GetNormalizer(
+          normalization_, num_, num_priors_, num_matches_);
+      Dtype loss_weight = top[0]->cpu_diff()[0] / normalizer;
+      const Dtype* prob_data = conf_prob_.cpu_data();
+      for (int i = 0; i < num_; ++i) {
+        for (map<int, vector<int> >::const_iterator it =
+             all_match_indices_[i].begin();
+             it != all_match_indices_[i].end(); ++it) {
+          const vector<int>& match_index = it->second;
+          for (int j = 0; j < num_priors_; ++j) {
+            if (match_index[j] <= -1) {
+              continue;
+            }
+            const int label = gt_labels_[gt_start_[i] + match_index[j]];
+            SoftmaxLossDiff(prob_data + j * num_classes_, num_classes_, label,
+                            loss_weight, conf_bottom_diff + j * num_classes_);
+          }
+        }
+        for (int n = 0; n < all_neg_indices_[i].size(); ++n) {
+          const int j = all_neg_indices_[i][n];
+          SoftmaxLossDiff(prob_data + j * num_classes_, num_classes_,
+                          background_label_id_, loss_weight,
+                          conf_bottom_diff + j * num_classes_);
+        }
+        prob_data += bottom[1]->offset(1);
+        conf_bottom_diff += bottom[1]->offset(1);
+      }
+    } else if (num_conf_ >= 1) {
       vector<bool> conf_propagate_down;
       // Only back propagate on prediction, not ground truth.
       conf_propagate_down.push_back(true);
@@ -25,6 +25,13 @@ void Permute(const int count, Dtype* bottom_data, const bool forward,
     }
 }
 
+template void Permute(const int count, float* bottom_data, const bool forward,
+    const int* permute_order, const int* old_steps, const int* new_steps,
+    const int num_axes, float* top_data);
+template void Permute(const int count, double* bottom_data,
+    const bool forward, const int* permute_order, const int* old_steps,
+    const int* new_steps, const int num_axes, double* top_data);
+
 template <typename Dtype>
 void PermuteLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -59,6 +66,27 @@ void PermuteLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       break;
     }
   }
+  // Check if the order moves the axes from transpose_split_ on before those
+  // from transpose_axis_, i.e. is a transpose after the leading axes.
+  transpose_axis_ = -1;
+  transpose_split_ = -1;
+  if (need_permute_) {
+    int axis = 0;
+    while (orders[axis] == axis) {
+      ++axis;
+    }
+    const int split = orders[axis];
+    bool is_transpose = true;
+    for (int i = axis; i < num_axes_; ++i) {
+      const int order = i < axis + num_axes_ - split ?
+          split + i - axis : i - num_axes_ + split;
+      is_transpose &= orders[i] == order;
+    }
+    if (is_transpose) {
+      transpose_axis_ = axis;
+      transpose_split_ = split;
+    }
+  }
 
   vector<int> top_shape(num_axes_, 1);
   permute_order_.Reshape(num_axes_, 1, 1, 1);
@@ -92,21 +120,55 @@ void PermuteLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       new_steps_.mutable_cpu_data()[i] = top[0]->count(i + 1);
     }
   }
+
+  if (!need_permute_) {
+    return;
+  }
+  if (transpose_axis_ >= 0) {
+    transpose_num_ = bottom[0]->count(0, transpose_axis_);
+    transpose_rows_ = bottom[0]->count(transpose_axis_, transpose_split_);
+    transpose_cols_ = bottom[0]->count(transpose_split_);
+  } else {
+    // Decompose the index of each row of the top once and for all.
+    const int* permute_order = permute_order_.cpu_data();
+    const int* old_steps = old_steps_.cpu_data();
+    const int* new_steps = new_steps_.cpu_data();
+    inner_dim_ = top[0]->shape(num_axes_ - 1);
+    inner_step_ = old_steps[permute_order[num_axes_ - 1]];
+    const int num_rows = inner_dim_ > 0 ? top[0]->count() / inner_dim_ : 0;
+    row_offsets_.resize(num_rows);
+    for (int r = 0; r < num_rows; ++r) {
+      int old_idx = 0;
+      int idx = r * inner_dim_;
+      for (int j = 0; j < num_axes_ - 1; ++j) {
+        old_idx += (idx / new_steps[j]) * old_steps[permute_order[j]];
+        idx %= new_steps[j];
+      }
+      row_offsets_[r] = old_idx;
+    }
+  }
 }
 
 template <typename Dtype>
 void PermuteLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  if (need_permute_) {
-    Dtype* bottom_data = bottom[0]->mutable_cpu_data();
+  if (need_permute_ && transpose_axis_ >= 0) {
+    caffe_cpu_batch_transpose(transpose_num_, transpose_rows_,
+        transpose_cols_, bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
+  } else if (need_permute_) {
+    const Dtype* bottom_data = bottom[0]->cpu_data();
     Dtype* top_data = top[0]->mutable_cpu_data();
-    const int top_count = top[0]->count();
-    const int* permute_order = permute_order_.cpu_data();
-    const int* old_steps = old_steps_.cpu_data();
-    const int* new_steps = new_steps_.cpu_data();
-    bool forward = true;
-    Permute(top_count, bottom_data, forward, permute_order, old_steps,
-            new_steps, num_axes_, top_data);
+    const int num_rows = row_offsets_.size();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int r = 0; r < num_rows; ++r) {
+      const Dtype* bottom_row = bottom_data + row_offsets_[r];
+      Dtype* top_row = top_data + r * inner_dim_;
+      for (int i = 0; i < inner_dim_; ++i) {
+        top_row[i] = bottom_row[i * inner_step_];
+      }
+    }
   } else {
     // If there is no need to permute, we share data to save memory.
     top[0]->ShareData(*bottom[0]);
@@ -116,16 +178,24 @@ void PermuteLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PermuteLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (need_permute_) {
-    Dtype* top_diff = top[0]->mutable_cpu_diff();
+  if (need_permute_ && transpose_axis_ >= 0) {
+    // The inverse permute transposes the transposed matrices back.
+    caffe_cpu_batch_transpose(transpose_num_, transpose_cols_,
+        transpose_rows_, top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
+  } else if (need_permute_) {
+    const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int top_count = top[0]->count();
-    const int* permute_order = permute_order_.cpu_data();
-    const int* old_steps = old_steps_.cpu_data();
-    const int* new_steps = new_steps_.cpu_data();
-    bool forward = false;
-    Permute(top_count, bottom_diff, forward, permute_order, old_steps,
-            new_steps, num_axes_, top_diff);
+    const int num_rows = row_offsets_.size();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int r = 0; r < num_rows; ++r) {
+      Dtype* bottom_row = bottom_diff + row_offsets_[r];
+      const Dtype* top_row = top_diff + r * inner_dim_;
+      for (int i = 0; i < inner_dim_; ++i) {
+        bottom_row[i * inner_step_] = top_row[i];
+      }
+    }
   } else {
     // If there is no need to permute, we share diff to save memory.
     bottom[0]->ShareDiff(*top[0]);
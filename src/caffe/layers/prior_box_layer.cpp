@@ -1,5 +1,9 @@
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <functional>
+#include <map>
+#include <sstream>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -7,6 +11,18 @@
 
 namespace caffe {
 
+using boost::weak_ptr;
+
+template <>
+map<const string, weak_ptr<const vector<float> > >
+  PriorBoxLayer<float>::all_priors_
+  = map<const string, weak_ptr<const vector<float> > >();
+template <>
+map<const string, weak_ptr<const vector<double> > >
+  PriorBoxLayer<double>::all_priors_
+  = map<const string, weak_ptr<const vector<double> > >();
+static boost::mutex all_priors_mutex_;
+
 template <typename Dtype>
 void PriorBoxLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -114,13 +130,7 @@ void PriorBoxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top_shape[2] = layer_width * layer_height * num_priors_ * 4;
   CHECK_GT(top_shape[2], 0);
   top[0]->Reshape(top_shape);
-}
 
-template <typename Dtype>
-void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  const int layer_width = bottom[0]->width();
-  const int layer_height = bottom[0]->height();
   int img_width, img_height;
   if (img_h_ == 0 || img_w_ == 0) {
     img_width = bottom[1]->width();
@@ -129,6 +139,58 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     img_width = img_w_;
     img_height = img_h_;
   }
+  vector<int> priors_shape(4);
+  priors_shape[0] = layer_height;
+  priors_shape[1] = layer_width;
+  priors_shape[2] = img_height;
+  priors_shape[3] = img_width;
+  if (priors_ && priors_shape == priors_shape_) {
+    return;
+  }
+  priors_shape_ = priors_shape;
+  // Priors are uniquely identified by the parameters and the shapes.
+  std::ostringstream key;
+  key << layer_height << "x" << layer_width << ":" << img_height << "x"
+      << img_width << ":"
+      << this->layer_param_.prior_box_param().SerializeAsString();
+  boost::mutex::scoped_lock lock(all_priors_mutex_);
+  weak_ptr<const vector<Dtype> >& weak = all_priors_[key.str()];
+  priors_ = weak.lock();
+  if (!priors_) {
+    vector<Dtype>* priors = new vector<Dtype>(top[0]->count());
+    GeneratePriors(layer_height, layer_width, img_height, img_width,
+                   &(*priors)[0]);
+    priors_.reset(priors);
+    weak = priors_;
+  }
+  // Forget the priors no layer holds anymore.
+  typename map<const string, weak_ptr<const vector<Dtype> > >::iterator it =
+      all_priors_.begin();
+  while (it != all_priors_.end()) {
+    if (it->second.expired()) {
+      all_priors_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+template <typename Dtype>
+void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(priors_->size(), top[0]->count());
+  if (top_priors_ == priors_ && top_data_ == top[0]->data()) {
+    return;
+  }
+  caffe_copy(top[0]->count(), &(*priors_)[0], top[0]->mutable_cpu_data());
+  top_priors_ = priors_;
+  top_data_ = top[0]->data();
+}
+
+template <typename Dtype>
+void PriorBoxLayer<Dtype>::GeneratePriors(const int layer_height,
+    const int layer_width, const int img_height, const int img_width,
+    Dtype* prior_data) const {
   float step_w, step_h;
   if (step_w_ == 0 || step_h_ == 0) {
     step_w = static_cast<float>(img_width) / layer_width;
@@ -137,7 +199,6 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     step_w = step_w_;
     step_h = step_h_;
   }
-  Dtype* top_data = top[0]->mutable_cpu_data();
   int dim = layer_height * layer_width * num_priors_ * 4;
   int idx = 0;
   for (int h = 0; h < layer_height; ++h) {
@@ -150,13 +211,13 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         // first prior: aspect_ratio = 1, size = min_size
         box_width = box_height = min_size_;
         // xmin
-        top_data[idx++] = (center_x - box_width / 2.) / img_width;
+        prior_data[idx++] = (center_x - box_width / 2.) / img_width;
         // ymin
-        top_data[idx++] = (center_y - box_height / 2.) / img_height;
+        prior_data[idx++] = (center_y - box_height / 2.) / img_height;
         // xmax
-        top_data[idx++] = (center_x + box_width / 2.) / img_width;
+        prior_data[idx++] = (center_x + box_width / 2.) / img_width;
         // ymax
-        top_data[idx++] = (center_y + box_height / 2.) / img_height;
+        prior_data[idx++] = (center_y + box_height / 2.) / img_height;
 
         if (max_sizes_.size() > 0) {
           CHECK_EQ(min_sizes_.size(), max_sizes_.size());
@@ -164,13 +225,13 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
           // second prior: aspect_ratio = 1, size = sqrt(min_size * max_size)
           box_width = box_height = sqrt(min_size_ * max_size_);
           // xmin
-          top_data[idx++] = (center_x - box_width / 2.) / img_width;
+          prior_data[idx++] = (center_x - box_width / 2.) / img_width;
           // ymin
-          top_data[idx++] = (center_y - box_height / 2.) / img_height;
+          prior_data[idx++] = (center_y - box_height / 2.) / img_height;
           // xmax
-          top_data[idx++] = (center_x + box_width / 2.) / img_width;
+          prior_data[idx++] = (center_x + box_width / 2.) / img_width;
           // ymax
-          top_data[idx++] = (center_y + box_height / 2.) / img_height;
+          prior_data[idx++] = (center_y + box_height / 2.) / img_height;
         }
 
         // rest of priors
@@ -182,13 +243,13 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
           box_width = min_size_ * sqrt(ar);
           box_height = min_size_ / sqrt(ar);
           // xmin
-          top_data[idx++] = (center_x - box_width / 2.) / img_width;
+          prior_data[idx++] = (center_x - box_width / 2.) / img_width;
           // ymin
-          top_data[idx++] = (center_y - box_height / 2.) / img_height;
+          prior_data[idx++] = (center_y - box_height / 2.) / img_height;
           // xmax
-          top_data[idx++] = (center_x + box_width / 2.) / img_width;
+          prior_data[idx++] = (center_x + box_width / 2.) / img_width;
           // ymax
-          top_data[idx++] = (center_y + box_height / 2.) / img_height;
+          prior_data[idx++] = (center_y + box_height / 2.) / img_height;
         }
       }
     }
@@ -196,20 +257,20 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   // clip the prior's coordidate such that it is within [0, 1]
   if (clip_) {
     for (int d = 0; d < dim; ++d) {
-      top_data[d] = std::min<Dtype>(std::max<Dtype>(top_data[d], 0.), 1.);
+      prior_data[d] = std::min<Dtype>(std::max<Dtype>(prior_data[d], 0.), 1.);
     }
   }
   // set the variance.
-  top_data += top[0]->offset(0, 1);
+  prior_data += dim;
   if (variance_.size() == 1) {
-    caffe_set<Dtype>(dim, Dtype(variance_[0]), top_data);
+    caffe_set<Dtype>(dim, Dtype(variance_[0]), prior_data);
   } else {
     int count = 0;
     for (int h = 0; h < layer_height; ++h) {
       for (int w = 0; w < layer_width; ++w) {
         for (int i = 0; i < num_priors_; ++i) {
           for (int j = 0; j < 4; ++j) {
-            top_data[count] = variance_[j];
+            prior_data[count] = variance_[j];
             ++count;
           }
         }
@@ -2,6 +2,7 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include <boost/thread.hpp>
 #include <stdint.h>
 #include <algorithm>
 #include <csignal>
@@ -12,6 +13,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/video_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -23,6 +25,7 @@ VideoDataLayer<Dtype>::VideoDataLayer(const LayerParameter& param)
 template <typename Dtype>
 VideoDataLayer<Dtype>::~VideoDataLayer() {
   this->StopInternalThread();
+  capture_.reset();
   if (cap_.isOpened()) {
     cap_.release();
   }
@@ -37,6 +40,8 @@ void VideoDataLayer<Dtype>::DataLayerSetUp(
   video_type_ = video_data_param.video_type();
   skip_frames_ = video_data_param.skip_frames();
   CHECK_GE(skip_frames_, 0);
+  CHECK_GT(video_data_param.frame_buffer_size(), 0);
+  start_time_ = boost::posix_time::microsec_clock::universal_time();
 
   // Read an image, and use it to initialize the top blob.
   cv::Mat cv_img;
@@ -67,8 +72,8 @@ void VideoDataLayer<Dtype>::DataLayerSetUp(
   this->transformed_data_.Reshape(top_shape_);
   top_shape_[0] = batch_size;
   top[0]->Reshape(top_shape_);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape_);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape_);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -77,10 +82,61 @@ void VideoDataLayer<Dtype>::DataLayerSetUp(
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
+
+  // Start decoding frames ahead of the prefetch thread.
+  frames_.resize(video_data_param.frame_buffer_size());
+  for (int i = 0; i < frames_.size(); ++i) {
+    free_frames_.push(i);
+  }
+  finished_ = false;
+  dropped_frames_ = 0;
+  capture_.reset(new Capture(this));
+}
+
+template <typename Dtype>
+double VideoDataLayer<Dtype>::elapsed_ms() const {
+  return (boost::posix_time::microsec_clock::universal_time() - start_time_)
+      .total_microseconds() / 1000.;
+}
+
+// This function is called on the capture thread
+template <typename Dtype>
+bool VideoDataLayer<Dtype>::capture_frame() {
+  const bool is_webcam = video_type_ == VideoDataParameter_VideoType_WEBCAM;
+  int index;
+  if (!free_frames_.try_pop(&index)) {
+    // The buffer is full. A webcam drops its oldest frame rather than wait,
+    // so that the buffer never holds stale frames.
+    if (!is_webcam || !full_frames_.try_pop(&index)) {
+      index = free_frames_.pop();
+    }
+  }
+  Frame& frame = frames_[index];
+  // Skipped frames are grabbed without being decoded.
+  bool success = true;
+  for (int i = 0; i <= skip_frames_ && success; ++i) {
+    if (!is_webcam) {
+      if (processed_frames_ >= total_frames_) {
+        success = false;
+        break;
+      }
+      ++processed_frames_;
+    }
+    success = i < skip_frames_ ? cap_.grab() : cap_.read(frame.image);
+  }
+  if (success && frame.image.data) {
+    frame.timestamp = is_webcam ? elapsed_ms() :
+        cap_.get(CV_CAP_PROP_POS_MSEC);
+  } else {
+    frame.image.release();
+    success = false;
+  }
+  full_frames_.push(index);
+  return success;
 }
 
 // This function is called on prefetch thread
@@ -109,53 +165,84 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     top_label = batch->label_.mutable_cpu_data();
   }
 
-  int skip_frames = skip_frames_;
+  const bool is_webcam = video_type_ == VideoDataParameter_VideoType_WEBCAM;
+  double latency = 0;
   for (int item_id = 0; item_id < batch_size; ++item_id) {
+    const int offset = batch->data_.offset(item_id);
+    if (finished_) {
+      caffe_set(this->transformed_data_.count(), Dtype(0), top_data + offset);
+      if (this->output_labels_) {
+        top_label[item_id] = -1;
+      }
+      continue;
+    }
     timer.Start();
-    cv::Mat cv_img;
-    if (video_type_ == VideoDataParameter_VideoType_WEBCAM) {
-      cap_ >> cv_img;
-    } else if (video_type_ == VideoDataParameter_VideoType_VIDEO) {
-      if (processed_frames_ >= total_frames_) {
-        LOG(INFO) << "Finished processing video.";
-        raise(SIGINT);
+    int index = full_frames_.pop();
+    if (is_webcam) {
+      // Only process the latest frame.
+      int newer;
+      while (full_frames_.try_pop(&newer)) {
+        free_frames_.push(index);
+        index = newer;
+        ++dropped_frames_;
       }
-      ++processed_frames_;
-      cap_ >> cv_img;
-    } else {
-      LOG(FATAL) << "Unknown video type.";
     }
-    CHECK(cv_img.data) << "Could not load image!";
+    Frame& frame = frames_[index];
     read_time += timer.MicroSeconds();
-    if (skip_frames > 0) {
-      --skip_frames;
+    if (!frame.image.data) {
+      CHECK(!is_webcam) << "Could not load image!";
+      LOG(INFO) << "Finished processing video.";
+      finished_ = true;
+      raise(SIGINT);
       --item_id;
-    } else {
-      skip_frames = skip_frames_;
-      timer.Start();
-      // Apply transformations (mirror, crop...) to the image
-      int offset = batch->data_.offset(item_id);
-      this->transformed_data_.set_cpu_data(top_data + offset);
-      this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-      trans_time += timer.MicroSeconds();
+      continue;
     }
-    CHECK(cv_img.data) << "Could not load image!";
-    read_time += timer.MicroSeconds();
     timer.Start();
     // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
     this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    this->data_transformer_->Transform(frame.image, &(this->transformed_data_));
     trans_time += timer.MicroSeconds();
     if (this->output_labels_) {
-      top_label[item_id] = 0;
+      // A float keeps the millisecond only for the first 2^24 ms.
+      top_label[item_id] = frame.timestamp;
+    }
+    if (is_webcam) {
+      latency = std::max(latency, elapsed_ms() - frame.timestamp);
     }
+    free_frames_.push(index);
   }
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  if (is_webcam) {
+    DLOG(INFO) << " Frame latency: " << latency << " ms, "
+        << dropped_frames_ << " frames dropped so far.";
+  }
+}
+
+template <typename Dtype>
+VideoDataLayer<Dtype>::Capture::Capture(VideoDataLayer<Dtype>* layer)
+    : layer_(layer) {
+  StartInternalThread();
+}
+
+template <typename Dtype>
+VideoDataLayer<Dtype>::Capture::~Capture() {
+  StopInternalThread();
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::Capture::InternalThreadEntry() {
+  try {
+    bool success = true;
+    while (!must_stop() && success) {
+      success = layer_->capture_frame();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
 }
 
 INSTANTIATE_CLASS(VideoDataLayer);
@@ -81,6 +81,12 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     if (!param.layer(layer_id).has_phase()) {
       param.mutable_layer(layer_id)->set_phase(phase_);
     }
+    // Inherit sparsity from net if unset.
+    if (param.has_sparsity_param() &&
+        !param.layer(layer_id).has_sparsity_param()) {
+      param.mutable_layer(layer_id)->mutable_sparsity_param()->CopyFrom(
+          param.sparsity_param());
+    }
     // Setup layer.
     const LayerParameter& layer_param = param.layer(layer_id);
     if (layer_param.propagate_down_size() > 0) {
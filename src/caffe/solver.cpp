@@ -10,6 +10,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/pruning.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -72,12 +73,52 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   InitTrainNet();
   if (Caffe::root_solver()) {
     InitTestNets();
+    InitPruning();
     LOG(INFO) << "Solver scaffolding done.";
   }
   iter_ = 0;
   current_step_ = 0;
 }
 
+template <typename Dtype>
+void Solver<Dtype>::InitPruning() {
+  pruned_blobs_.clear();
+  for (int i = 0; i < param_.pruning_size(); ++i) {
+    const PruningParameter& pruning = param_.pruning(i);
+    CHECK(net_->has_layer(pruning.layer()))
+        << "Unknown layer to prune: " << pruning.layer();
+    const shared_ptr<Layer<Dtype> > layer = net_->layer_by_name(
+        pruning.layer());
+    CHECK_GT(layer->blobs().size(), 0)
+        << "Layer " << pruning.layer() << " has no weights to prune.";
+    Blob<Dtype>* weights = layer->blobs()[0].get();
+    CHECK_EQ(weights->sparsity_mode(), SparsityParameter::PRUNE)
+        << "Layer " << pruning.layer() << " must be in PRUNE sparsity mode; "
+        << "set sparsity_param { mode: PRUNE } on it or on the net.";
+    CHECK_GT(pruning.end_iter(), pruning.start_iter());
+    CHECK_GT(pruning.frequency(), 0);
+    CHECK_GE(pruning.target_sparsity(), 0);
+    CHECK_LE(pruning.target_sparsity(), 1);
+    pruned_blobs_.push_back(weights);
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::PruneWeights(const bool force) {
+  for (int i = 0; i < pruned_blobs_.size(); ++i) {
+    const PruningParameter& pruning = param_.pruning(i);
+    if (!force && !IsPruningIter(pruning, iter_)) {
+      continue;
+    }
+    const float sparsity = PruningSparsity(pruning, iter_);
+    const int kept = PruneBlob(pruning.criterion(), sparsity,
+                               pruned_blobs_[i]);
+    LOG(INFO) << "Iteration " << iter_ << ", pruned " << pruning.layer()
+        << " to sparsity " << sparsity << " (" << kept << " of "
+        << pruned_blobs_[i]->count() << " weights kept)";
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::InitTrainNet() {
   const int num_train_nets = param_.has_net() + param_.has_net_param() +
@@ -216,6 +257,9 @@ void Solver<Dtype>::Step(int iters) {
   while (iter_ < stop_iter) {
     // zero-init the params
     net_->ClearParamDiffs();
+    if (Caffe::root_solver()) {
+      PruneWeights(false);
+    }
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())
         && Caffe::root_solver()) {
@@ -300,6 +344,9 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (resume_file) {
     LOG(INFO) << "Restoring previous solver status from " << resume_file;
     Restore(resume_file);
+    // Bring the masks back in line with the schedule; dense snapshots do
+    // not store them.
+    PruneWeights(true);
   }
 
   // For a network that is trained by the solver, no bottom or top vecs
@@ -595,6 +642,8 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
+  // Sparse weights recompute their CSR arrays (and nnz) from the pruned
+  // weights here.
   net_->ToProto(&net_param, param_.snapshot_diff());
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
@@ -1,12 +1,111 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <boost/thread.hpp>
+#include <map>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// Size of the huge pages reserved for MAP_HUGETLB on x86-64 and ARM64.
+static const size_t kHugePageSize = 2 << 20;
+// Memory policy of mbind, from linux/mempolicy.h.
+static const int kMPolBind = 2;
+
+class PageAllocator::sync {
+ public:
+  boost::mutex mutex_;
+};
+
+PageAllocator::PageAllocator(bool huge_pages, int numa_node)
+    : huge_pages_(huge_pages), numa_node_(numa_node), sync_(new sync()) {
+  CHECK_LT(numa_node, 64) << "NUMA node out of range.";
+}
+
+PageAllocator::~PageAllocator() {
+  CHECK(mappings_.empty()) << "PageAllocator destroyed before its memory.";
+}
+
+void* PageAllocator::Allocate(size_t size) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  Mapping mapping;
+  mapping.size = (std::max<size_t>(size, 1) + page_size - 1) / page_size *
+      page_size;
+  mapping.pinned = false;
+  void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (huge_pages_) {
+    const size_t huge_size = (mapping.size + kHugePageSize - 1) /
+        kHugePageSize * kHugePageSize;
+    ptr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+      mapping.size = huge_size;
+    } else {
+      LOG_FIRST_N(WARNING, 1) << "No huge page reserved for " << huge_size
+          << " bytes, using transparent huge pages instead.";
+    }
+  }
+#endif
+  if (ptr == MAP_FAILED) {
+    ptr = mmap(NULL, mapping.size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(ptr != MAP_FAILED) << "host allocation of size " << size
+        << " failed";
+#ifdef MADV_HUGEPAGE
+    if (huge_pages_) {
+      madvise(ptr, mapping.size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+#if defined(__linux__) && defined(SYS_mbind)
+  if (numa_node_ >= 0) {
+    // Bind before the pages are touched, so that they are placed on the node.
+    const unsigned long node_mask = 1UL << numa_node_;  // NOLINT(runtime/int)
+    if (syscall(SYS_mbind, ptr, mapping.size, kMPolBind, &node_mask,
+                sizeof(node_mask) * 8, 0) != 0) {
+      LOG_FIRST_N(WARNING, 1) << "Failed to bind host memory to NUMA node "
+          << numa_node_;
+    }
+  }
+#endif
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaHostRegister(ptr, mapping.size, cudaHostRegisterDefault));
+    mapping.pinned = true;
+  }
+#endif
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  mappings_[ptr] = mapping;
+  return ptr;
+}
+
+void PageAllocator::Free(void* ptr, size_t size) {
+  Mapping mapping;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    map<void*, Mapping>::iterator it = mappings_.find(ptr);
+    CHECK(it != mappings_.end()) << "Freeing memory not from this allocator.";
+    mapping = it->second;
+    mappings_.erase(it);
+  }
+#ifndef CPU_ONLY
+  if (mapping.pinned) {
+    CUDA_CHECK(cudaHostUnregister(ptr));
+  }
+#endif
+  CHECK_EQ(munmap(ptr, mapping.size), 0);
+}
+
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    free_host();
   }
 
 #ifndef CPU_ONLY
@@ -22,10 +121,32 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+void SyncedMemory::set_host_allocator(
+    const shared_ptr<HostAllocator>& allocator) {
+  CHECK(cpu_ptr_ == NULL) << "Host memory is already allocated.";
+  host_allocator_ = allocator;
+}
+
+void SyncedMemory::malloc_host() {
+  if (host_allocator_) {
+    cpu_ptr_ = host_allocator_->Allocate(size_);
+  } else {
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+  }
+}
+
+void SyncedMemory::free_host() {
+  if (host_allocator_) {
+    host_allocator_->Free(cpu_ptr_, size_);
+  } else {
+    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+  }
+}
+
 inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    malloc_host();
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
@@ -33,7 +154,7 @@ inline void SyncedMemory::to_cpu() {
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+      malloc_host();
       own_cpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
@@ -84,7 +205,7 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    free_host();
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
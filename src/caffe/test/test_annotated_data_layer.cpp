@@ -11,6 +11,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/annotated_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/bbox_util.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
 
@@ -56,7 +57,11 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
         channels_(2),
         height_(10),
         width_(10),
-        eps_(1e-6) {}
+        eps_(1e-6),
+        num_workers_(1),
+        fixed_label_capacity_(false),
+        encoded_(false),
+        random_order_prob_(0) {}
 
   virtual void SetUp() {
     spatial_dim_ = height_ * width_;
@@ -101,6 +106,15 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
         int elem = unique_pixel ? j : i;
         data->push_back(static_cast<uint8_t>(elem));
       }
+      if (encoded_) {
+        // PNG is lossless, so the decoded image has the same pixels.
+        cv::Mat img(height_, width_, CV_8UC(channels_));
+        for (int j = 0; j < size_; ++j) {
+          const int c = j / spatial_dim_;
+          img.data[(j % spatial_dim_) * channels_ + c] = (*data)[j];
+        }
+        EncodeCVMatToDatum(img, "png", datum);
+      }
       // Fill annotation.
       if (use_rich_annotation) {
         anno_datum.set_type(type);
@@ -141,6 +155,16 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(num_);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_num_workers(num_workers_);
+    param.mutable_annotated_data_param()->set_fixed_label_capacity(
+        fixed_label_capacity_);
+    // With a fixed capacity, the label starts with a header row, and the
+    // capacity of 1 bbox is doubled until all the bboxes fit.
+    const int first_row = fixed_label_capacity_ ? 1 : 0;
+    int capacity = 1;
+    while (capacity < BBoxNum(num_)) {
+      capacity *= 2;
+    }
 
     const Dtype scale = 3;
     TransformationParameter* transform_param =
@@ -158,7 +182,7 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
         case AnnotatedDatum_AnnotationType_BBOX:
           EXPECT_EQ(blob_top_label_->num(), 1);
           EXPECT_EQ(blob_top_label_->channels(), 1);
-          EXPECT_EQ(blob_top_label_->height(), 1);
+          EXPECT_EQ(blob_top_label_->height(), 1 + first_row);
           EXPECT_EQ(blob_top_label_->width(), 8);
           break;
         default:
@@ -176,13 +200,25 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
       layer.Forward(blob_bottom_vec_, blob_top_vec_);
       // Check label.
       const Dtype* label_data = blob_top_label_->cpu_data();
+      if (use_rich_annotation_ && fixed_label_capacity_) {
+        EXPECT_EQ(kLabelHeaderId, label_data[0]);
+        EXPECT_EQ(BBoxNum(num_), label_data[1]);
+        EXPECT_EQ(capacity, label_data[2]);
+        // The rows after the bboxes are unused.
+        for (int j = (first_row + BBoxNum(num_)) * 8;
+             j < blob_top_label_->count(); ++j) {
+          EXPECT_EQ(-1, label_data[j]);
+        }
+        label_data += first_row * 8;
+      }
       int cur_bbox = 0;
       for (int i = 0; i < num_; ++i) {
         if (use_rich_annotation_) {
           if (type_ == AnnotatedDatum_AnnotationType_BBOX) {
             EXPECT_EQ(blob_top_label_->num(), 1);
             EXPECT_EQ(blob_top_label_->channels(), 1);
-            EXPECT_EQ(blob_top_label_->height(), BBoxNum(num_));
+            EXPECT_EQ(blob_top_label_->height(), fixed_label_capacity_ ?
+                      first_row + capacity : BBoxNum(num_));
             EXPECT_EQ(blob_top_label_->width(), 8);
             for (int g = 0; g < i; ++g) {
               for (int a = 0; a < g; ++a) {
@@ -431,11 +467,16 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(num_);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_num_workers(num_workers_);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
     transform_param->set_crop_size(1);
     transform_param->set_mirror(true);
+    if (random_order_prob_ > 0) {
+      transform_param->mutable_distort_param()->set_random_order_prob(
+          random_order_prob_);
+    }
 
     // Get crop sequence with Caffe seed 1701.
     Caffe::set_random_seed(seed_);
@@ -556,6 +597,10 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
   Dtype eps_;
   int spatial_dim_;
   int size_;
+  int num_workers_;
+  bool fixed_label_capacity_;
+  bool encoded_;
+  float random_order_prob_;
   bool unique_pixel_;
   bool unique_annotation_;
   bool use_rich_annotation_;
@@ -729,6 +774,52 @@ TYPED_TEST(AnnotatedDataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop(TEST);
 }
 
+TYPED_TEST(AnnotatedDataLayerTest, TestReadFixedLabelCapacityLMDB) {
+  const AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  this->fixed_label_capacity_ = true;
+  this->num_workers_ = 2;
+  for (int r = 0; r < kNumChoices; ++r) {
+    bool use_rich_annotation = kBoolChoices[r];
+    this->Fill(DataParameter_DB_LMDB, false, false, use_rich_annotation,
+               type);
+    this->TestRead();
+  }
+}
+
+TYPED_TEST(AnnotatedDataLayerTest, TestReadMultipleWorkersLMDB) {
+  const AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  // More workers than items per worker, and some workers without any item.
+  const int num_workers[] = {2, 4, 8};
+  for (int w = 0; w < 3; ++w) {
+    this->num_workers_ = num_workers[w];
+    for (int r = 0; r < kNumChoices; ++r) {
+      bool use_rich_annotation = kBoolChoices[r];
+      this->Fill(DataParameter_DB_LMDB, false, false, use_rich_annotation,
+                 type);
+      this->TestRead();
+    }
+  }
+}
+
+// Test that the sequence of random crops and channel orders does not depend
+// on the scheduling of the workers.
+TYPED_TEST(AnnotatedDataLayerTest,
+           TestReadCropTrainSequenceSeededMultipleWorkersLMDB) {
+  const bool unique_pixel = true;  // all pixels the same; images different
+  const bool unique_annotation = false;  // all anno the same; groups different
+  const bool use_rich_annotation = false;
+  AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  // Channel reordering is only applied to encoded color images.
+  this->channels_ = 3;
+  this->size_ = this->channels_ * this->spatial_dim_;
+  this->encoded_ = true;
+  this->random_order_prob_ = 0.5;
+  this->Fill(DataParameter_DB_LMDB, unique_pixel, unique_annotation,
+             use_rich_annotation, type);
+  this->num_workers_ = 3;
+  this->TestReadCropTrainSequenceSeeded();
+}
+
 #endif  // USE_LMDB
 }  // namespace caffe
 #endif  // USE_OPENCV
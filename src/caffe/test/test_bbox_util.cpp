@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <map>
 #include <utility>
 #include <vector>
@@ -6,6 +7,8 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -574,6 +577,74 @@ TEST_F(CPUBBoxUtilTest, TestDecodeBBoxesCenterSize) {
   }
 }
 
+TEST_F(CPUBBoxUtilTest, TestDecodeBBoxesAllRaw) {
+  const int num = 2;
+  const int num_priors = 5;
+  const int num_loc_classes = 3;
+  const int background_label_id = 0;
+  Blob<float> prior_blob(1, 2, num_priors * 4, 1);
+  float* prior_data = prior_blob.mutable_cpu_data();
+  for (int p = 0; p < num_priors; ++p) {
+    prior_data[p * 4] = 0.1 * p;
+    prior_data[p * 4 + 1] = 0.05 * p;
+    prior_data[p * 4 + 2] = 0.1 * p + 0.3;
+    prior_data[p * 4 + 3] = 0.05 * p + 0.2;
+    for (int j = 0; j < 4; ++j) {
+      prior_data[(num_priors + p) * 4 + j] = j < 2 ? 0.1 : 0.2;
+    }
+  }
+  Blob<float> loc_blob(num, num_priors * num_loc_classes * 4, 1, 1);
+  float* loc_data = loc_blob.mutable_cpu_data();
+  for (int i = 0; i < loc_blob.count(); ++i) {
+    loc_data[i] = 0.1 * ((i * 7) % 11) - 0.5;
+  }
+  vector<NormalizedBBox> prior_bboxes;
+  vector<vector<float> > prior_variances;
+  GetPriorBBoxes(prior_data, num_priors, &prior_bboxes, &prior_variances);
+
+  const CodeType code_types[] = {PriorBoxParameter_CodeType_CORNER,
+      PriorBoxParameter_CodeType_CENTER_SIZE,
+      PriorBoxParameter_CodeType_CORNER_SIZE};
+  Blob<float> bbox_blob;
+  bbox_blob.ReshapeLike(loc_blob);
+  for (int t = 0; t < 3; ++t) {
+    for (int k = 0; k < 4; ++k) {
+      const bool share_location = k / 2;
+      const bool variance_encoded_in_target = k % 2;
+      const int loc_classes = share_location ? 1 : num_loc_classes;
+      vector<LabelBBox> all_loc_preds;
+      GetLocPredictions(loc_data, num, num_priors, loc_classes,
+                        share_location, &all_loc_preds);
+      vector<LabelBBox> all_decode_bboxes;
+      DecodeBBoxesAll(all_loc_preds, prior_bboxes, prior_variances, num,
+                      share_location, loc_classes, background_label_id,
+                      code_types[t], variance_encoded_in_target, false,
+                      &all_decode_bboxes);
+      float* bbox_data = bbox_blob.mutable_cpu_data();
+      DecodeBBoxesAll(loc_data, prior_data, num, num_priors, share_location,
+                      loc_classes, background_label_id, code_types[t],
+                      variance_encoded_in_target, false, bbox_data);
+      for (int i = 0; i < num; ++i) {
+        for (int c = 0; c < loc_classes; ++c) {
+          const int label = share_location ? -1 : c;
+          if (label == background_label_id) {
+            continue;
+          }
+          const vector<NormalizedBBox>& bboxes = all_decode_bboxes[i][label];
+          for (int p = 0; p < num_priors; ++p) {
+            const float* bbox =
+                bbox_data + ((i * loc_classes + c) * num_priors + p) * 4;
+            EXPECT_NEAR(bboxes[p].xmin(), bbox[0], eps);
+            EXPECT_NEAR(bboxes[p].ymin(), bbox[1], eps);
+            EXPECT_NEAR(bboxes[p].xmax(), bbox[2], eps);
+            EXPECT_NEAR(bboxes[p].ymax(), bbox[3], eps);
+          }
+        }
+      }
+    }
+  }
+}
+
 TEST_F(CPUBBoxUtilTest, TestMatchBBoxLableOneBipartite) {
   vector<NormalizedBBox> gt_bboxes;
   vector<NormalizedBBox> pred_bboxes;
@@ -885,6 +956,329 @@ TEST_F(CPUBBoxUtilTest, TestGetGroundTruthLabelBBox) {
   EXPECT_NEAR(all_gt_bboxes[1].find(2)->second[0].size(), 0.04, eps);
 }
 
+TEST_F(CPUBBoxUtilTest, TestGetGroundTruthLabelHeader) {
+  const int num_gt = 4;
+  const int capacity = 6;
+  Blob<float> gt_blob(1, 1, num_gt, 8);
+  Blob<float> header_blob(1, 1, capacity + 1, 8);
+  float* gt_data = gt_blob.mutable_cpu_data();
+  for (int i = 0; i < 4; ++i) {
+    int image_id = ceil(i / 2.);
+    gt_data[i * 8] = image_id;
+    gt_data[i * 8 + 1] = i;
+    gt_data[i * 8 + 2] = 0;
+    gt_data[i * 8 + 3] = 0.1 * i;
+    gt_data[i * 8 + 4] = 0.1;
+    gt_data[i * 8 + 5] = 0.3 + 0.1 * i;
+    gt_data[i * 8 + 6] = 0.3;
+    gt_data[i * 8 + 7] = i % 2;
+  }
+  float* header_data = header_blob.mutable_cpu_data();
+  caffe_set(header_blob.count(), -1.f, header_data);
+  header_data[0] = kLabelHeaderId;
+  header_data[1] = num_gt;
+  header_data[2] = capacity;
+  caffe_copy(gt_blob.count(), gt_data, header_data + 8);
+
+  const float* rows = header_data;
+  EXPECT_EQ(num_gt, SkipLabelHeader(capacity + 1, &rows));
+  EXPECT_EQ(header_data + 8, rows);
+  rows = gt_data;
+  EXPECT_EQ(num_gt, SkipLabelHeader(num_gt, &rows));
+  EXPECT_EQ(gt_data, rows);
+
+  for (int use_difficult = 0; use_difficult < 2; ++use_difficult) {
+    map<int, vector<NormalizedBBox> > expected_bboxes, all_gt_bboxes;
+    GetGroundTruth(gt_data, num_gt, -1, use_difficult, &expected_bboxes);
+    GetGroundTruth(header_data, capacity + 1, -1, use_difficult,
+                   &all_gt_bboxes);
+    EXPECT_EQ(expected_bboxes.size(), all_gt_bboxes.size());
+    for (map<int, vector<NormalizedBBox> >::iterator it =
+         expected_bboxes.begin(); it != expected_bboxes.end(); ++it) {
+      ASSERT_EQ(it->second.size(), all_gt_bboxes[it->first].size());
+      for (int i = 0; i < it->second.size(); ++i) {
+        EXPECT_EQ(it->second[i].DebugString(),
+                  all_gt_bboxes[it->first][i].DebugString());
+      }
+    }
+    map<int, LabelBBox> expected_label_bboxes, all_label_bboxes;
+    GetGroundTruth(gt_data, num_gt, -1, use_difficult,
+                   &expected_label_bboxes);
+    GetGroundTruth(header_data, capacity + 1, -1, use_difficult,
+                   &all_label_bboxes);
+    EXPECT_EQ(expected_label_bboxes.size(), all_label_bboxes.size());
+    for (map<int, LabelBBox>::iterator it = expected_label_bboxes.begin();
+         it != expected_label_bboxes.end(); ++it) {
+      EXPECT_EQ(it->second.size(), all_label_bboxes[it->first].size());
+    }
+  }
+}
+
+TEST_F(CPUBBoxUtilTest, TestGetGroundTruthFlat) {
+  const int num = 4;
+  const int num_gt = 5;
+  Blob<float> gt_blob(1, 1, num_gt + 1, 8);
+  float* gt_data = gt_blob.mutable_cpu_data();
+  caffe_set(gt_blob.count(), -1.f, gt_data);
+  gt_data[0] = kLabelHeaderId;
+  gt_data[1] = num_gt;
+  gt_data[2] = num_gt;
+  // Images 0, 2, 2, 0 and 3; image 1 has no ground truth.
+  const int image_ids[] = {0, 2, 2, 0, 3};
+  for (int i = 0; i < num_gt; ++i) {
+    float* row = gt_data + (i + 1) * 8;
+    row[0] = image_ids[i];
+    row[1] = i + 1;
+    row[2] = 0;
+    row[3] = 0.1 * i;
+    row[4] = 0.2;
+    row[5] = 0.1 * i + 0.3;
+    row[6] = 0.4;
+    row[7] = i == 2;
+  }
+
+  vector<float> gt_bboxes;
+  vector<int> gt_labels, gt_start;
+  GetGroundTruth(gt_data, num_gt + 1, num, 0, true, &gt_bboxes, &gt_labels,
+                 &gt_start);
+  ASSERT_EQ(num + 1, gt_start.size());
+  EXPECT_EQ(0, gt_start[0]);
+  EXPECT_EQ(2, gt_start[1]);
+  EXPECT_EQ(2, gt_start[2]);
+  EXPECT_EQ(4, gt_start[3]);
+  EXPECT_EQ(5, gt_start[4]);
+  const int order[] = {0, 3, 1, 2, 4};
+  ASSERT_EQ(num_gt, gt_labels.size());
+  ASSERT_EQ(num_gt * 4, gt_bboxes.size());
+  for (int j = 0; j < num_gt; ++j) {
+    const int i = order[j];
+    EXPECT_EQ(i + 1, gt_labels[j]);
+    EXPECT_NEAR(0.1 * i, gt_bboxes[j * 4], eps);
+    EXPECT_NEAR(0.2, gt_bboxes[j * 4 + 1], eps);
+    EXPECT_NEAR(0.1 * i + 0.3, gt_bboxes[j * 4 + 2], eps);
+    EXPECT_NEAR(0.4, gt_bboxes[j * 4 + 3], eps);
+  }
+
+  // Skip difficult ground truth, without the header.
+  GetGroundTruth(gt_data + 8, num_gt, num, 0, false, &gt_bboxes, &gt_labels,
+                 &gt_start);
+  EXPECT_EQ(0, gt_start[0]);
+  EXPECT_EQ(2, gt_start[1]);
+  EXPECT_EQ(2, gt_start[2]);
+  EXPECT_EQ(3, gt_start[3]);
+  EXPECT_EQ(4, gt_start[4]);
+  ASSERT_EQ(4, gt_labels.size());
+  EXPECT_EQ(1, gt_labels[0]);
+  EXPECT_EQ(4, gt_labels[1]);
+  EXPECT_EQ(2, gt_labels[2]);
+  EXPECT_EQ(5, gt_labels[3]);
+}
+
+// Random priors, some of them crossing the image boundary and some of them
+// repeated, and num_gt[i] random ground truth rows for each image i, with
+// repeated ones too, followed by their item ids and labels.
+static void FillMatchingData(const int num_priors, const vector<int>& num_gt,
+    vector<float>* prior_data, vector<float>* gt_data) {
+  prior_data->resize(num_priors * 8);
+  for (int p = 0; p < num_priors; ++p) {
+    float* prior = &(*prior_data)[p * 4];
+    if (p % 10 == 9) {
+      std::copy(prior - 4, prior, prior);
+      continue;
+    }
+    float center[2], size[2];
+    caffe_rng_uniform(2, 0.f, 1.f, center);
+    caffe_rng_uniform(2, 0.05f, 0.5f, size);
+    prior[0] = center[0] - size[0] / 2;
+    prior[1] = center[1] - size[1] / 2;
+    prior[2] = center[0] + size[0] / 2;
+    prior[3] = center[1] + size[1] / 2;
+  }
+  std::fill(prior_data->begin() + num_priors * 4, prior_data->end(), 0.1);
+  gt_data->clear();
+  for (int i = 0; i < num_gt.size(); ++i) {
+    for (int j = 0; j < num_gt[i]; ++j) {
+      float row[8] = {static_cast<float>(i), 1.f + j % 2, 0, 0, 0, 0, 0, 0};
+      if (j % 4 == 3) {
+        std::copy(gt_data->end() - 5, gt_data->end() - 1, row + 3);
+      } else {
+        caffe_rng_uniform(2, 0.f, 0.7f, row + 3);
+        caffe_rng_uniform(1, row[3] + 0.05f, 1.f, row + 5);
+        caffe_rng_uniform(1, row[4] + 0.05f, 1.f, row + 6);
+      }
+      gt_data->insert(gt_data->end(), row, row + 8);
+    }
+  }
+}
+
+TEST_F(CPUBBoxUtilTest, TestFindMatchesFlat) {
+  Caffe::set_random_seed(1701);
+  const int num_priors = 300;
+  vector<int> num_gt;
+  for (int i = 0; i < 5; ++i) {
+    num_gt.push_back(i * 3);
+  }
+  const int num = num_gt.size();
+  vector<float> prior_data, gt_data;
+  FillMatchingData(num_priors, num_gt, &prior_data, &gt_data);
+  const int num_rows = gt_data.size() / 8;
+
+  map<int, vector<NormalizedBBox> > all_gt_bboxes;
+  GetGroundTruth(&gt_data[0], num_rows, 0, true, &all_gt_bboxes);
+  vector<NormalizedBBox> prior_bboxes;
+  vector<vector<float> > prior_variances;
+  GetPriorBBoxes(&prior_data[0], num_priors, &prior_bboxes, &prior_variances);
+  vector<LabelBBox> all_loc_preds(num);
+  vector<float> gt_bboxes;
+  vector<int> gt_labels, gt_start;
+  GetGroundTruth(&gt_data[0], num_rows, num, 0, true, &gt_bboxes, &gt_labels,
+                 &gt_start);
+  vector<vector<float> > buffers;
+
+  MultiBoxLossParameter param;
+  param.set_num_classes(3);
+  for (int k = 0; k < 8; ++k) {
+    param.set_share_location(k % 2 == 0);
+    param.set_match_type(k / 2 % 2 == 0 ?
+        MultiBoxLossParameter_MatchType_BIPARTITE :
+        MultiBoxLossParameter_MatchType_PER_PREDICTION);
+    param.set_ignore_cross_boundary_bbox(k / 4 == 1);
+    vector<map<int, vector<float> > > expected_overlaps, match_overlaps;
+    vector<map<int, vector<int> > > expected_indices, match_indices;
+    FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
+                param, &expected_overlaps, &expected_indices);
+    FindMatches(&prior_data[0], num_priors, gt_bboxes, gt_labels, gt_start,
+                param, &buffers, &match_overlaps, &match_indices);
+    EXPECT_EQ(expected_indices, match_indices) << "case " << k;
+    EXPECT_EQ(expected_overlaps, match_overlaps) << "case " << k;
+    EXPECT_GT(CountNumMatches(match_indices, num), num_gt[num - 1]);
+  }
+}
+
+TEST_F(CPUBBoxUtilTest, DISABLED_TestFindMatchesBenchmark) {
+  // Match the priors of SSD300 with a batch of 8 images.
+  Caffe::set_random_seed(1701);
+  const int num_priors = 8732;
+  const vector<int> num_gt(8, 20);
+  const int num = num_gt.size();
+  vector<float> prior_data, gt_data;
+  FillMatchingData(num_priors, num_gt, &prior_data, &gt_data);
+  const int num_rows = gt_data.size() / 8;
+  MultiBoxLossParameter param;
+  param.set_num_classes(21);
+  vector<map<int, vector<float> > > match_overlaps;
+  vector<map<int, vector<int> > > match_indices;
+
+  const int iters = 5;
+  CPUTimer timer;
+  timer.Start();
+  for (int it = 0; it < iters; ++it) {
+    map<int, vector<NormalizedBBox> > all_gt_bboxes;
+    GetGroundTruth(&gt_data[0], num_rows, 0, true, &all_gt_bboxes);
+    vector<NormalizedBBox> prior_bboxes;
+    vector<vector<float> > prior_variances;
+    GetPriorBBoxes(&prior_data[0], num_priors, &prior_bboxes,
+                   &prior_variances);
+    vector<LabelBBox> all_loc_preds(num);
+    match_overlaps.clear();
+    match_indices.clear();
+    FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
+                param, &match_overlaps, &match_indices);
+  }
+  LOG(INFO) << "FindMatches on NormalizedBBox: "
+            << timer.MicroSeconds() / iters << " us";
+  const int num_matches = CountNumMatches(match_indices, num);
+
+  vector<float> gt_bboxes;
+  vector<int> gt_labels, gt_start;
+  vector<vector<float> > buffers;
+  timer.Start();
+  for (int it = 0; it < iters; ++it) {
+    GetGroundTruth(&gt_data[0], num_rows, num, 0, true, &gt_bboxes,
+                   &gt_labels, &gt_start);
+    FindMatches(&prior_data[0], num_priors, gt_bboxes, gt_labels, gt_start,
+                param, &buffers, &match_overlaps, &match_indices);
+  }
+  LOG(INFO) << "FindMatches on flat arrays: "
+            << timer.MicroSeconds() / iters << " us";
+  EXPECT_EQ(num_matches, CountNumMatches(match_indices, num));
+}
+
+TEST_F(CPUBBoxUtilTest, TestMineHardNegatives) {
+  Caffe::set_random_seed(1701);
+  const int num_priors = 300;
+  const int num_classes = 3;
+  vector<int> num_gt;
+  for (int i = 0; i < 4; ++i) {
+    num_gt.push_back(i * 3);
+  }
+  const int num = num_gt.size();
+  vector<float> prior_data, gt_data;
+  FillMatchingData(num_priors, num_gt, &prior_data, &gt_data);
+  const int num_rows = gt_data.size() / 8;
+  Blob<float> conf_blob(num, num_priors * num_classes, 1, 1);
+  caffe_rng_gaussian(conf_blob.count(), 0.f, 2.f,
+                     conf_blob.mutable_cpu_data());
+
+  MultiBoxLossParameter param;
+  param.set_num_classes(num_classes);
+  param.set_mining_type(MultiBoxLossParameter_MiningType_MAX_NEGATIVE);
+  vector<float> gt_bboxes;
+  vector<int> gt_labels, gt_start;
+  GetGroundTruth(&gt_data[0], num_rows, num, 0, true, &gt_bboxes, &gt_labels,
+                 &gt_start);
+  vector<vector<float> > buffers;
+  vector<map<int, vector<float> > > match_overlaps;
+  vector<map<int, vector<int> > > match_indices;
+  FindMatches(&prior_data[0], num_priors, gt_bboxes, gt_labels, gt_start,
+              param, &buffers, &match_overlaps, &match_indices);
+
+  // Mine with the protobuf ground truth and priors.
+  map<int, vector<NormalizedBBox> > all_gt_bboxes;
+  GetGroundTruth(&gt_data[0], num_rows, 0, true, &all_gt_bboxes);
+  vector<NormalizedBBox> prior_bboxes;
+  vector<vector<float> > prior_variances;
+  GetPriorBBoxes(&prior_data[0], num_priors, &prior_bboxes, &prior_variances);
+  vector<LabelBBox> all_loc_preds(num);
+  vector<vector<float> > expected_conf_loss;
+  ComputeConfLoss(conf_blob.cpu_data(), num, num_priors, num_classes, 0,
+                  MultiBoxLossParameter_ConfLossType_SOFTMAX, match_indices,
+                  all_gt_bboxes, &expected_conf_loss);
+  vector<map<int, vector<int> > > expected_match_indices = match_indices;
+  vector<vector<int> > expected_neg_indices;
+  int expected_num_matches, expected_num_negs;
+  MineHardExamples(conf_blob, all_loc_preds, all_gt_bboxes, prior_bboxes,
+                   prior_variances, match_overlaps, param,
+                   &expected_num_matches, &expected_num_negs,
+                   &expected_match_indices, &expected_neg_indices);
+
+  Blob<float> prob(num, num_priors, num_classes, 1);
+  Blob<float> conf_loss(num, num_priors, 1, 1);
+  ComputeConfLossSoftmax(conf_blob.cpu_data(), num, num_priors, num_classes,
+                         0, match_indices, gt_labels, gt_start,
+                         prob.mutable_cpu_data(), conf_loss.mutable_cpu_data());
+  for (int i = 0; i < num; ++i) {
+    for (int p = 0; p < num_priors; ++p) {
+      EXPECT_NEAR(expected_conf_loss[i][p], conf_loss.data_at(i, p, 0, 0),
+                  eps);
+      float sum = 0;
+      for (int c = 0; c < num_classes; ++c) {
+        sum += prob.data_at(i, p, c, 0);
+      }
+      EXPECT_NEAR(1, sum, eps);
+    }
+  }
+  vector<vector<int> > neg_indices;
+  int num_negs;
+  MineHardNegatives(conf_loss.cpu_data(), num, num_priors, match_overlaps,
+                    match_indices, param, &num_negs, &neg_indices);
+  EXPECT_EQ(expected_match_indices, match_indices);
+  EXPECT_EQ(expected_num_matches, CountNumMatches(match_indices, num));
+  EXPECT_EQ(expected_num_negs, num_negs);
+  EXPECT_EQ(expected_neg_indices, neg_indices);
+  EXPECT_EQ(expected_num_matches * 3, num_negs);
+}
+
 TEST_F(CPUBBoxUtilTest, TestGetLocPredictionsShared) {
   const int num = 2;
   const int num_preds_per_class = 2;
@@ -1205,6 +1599,57 @@ TEST_F(CPUBBoxUtilTest, TestGetPriorBBoxes) {
   }
 }
 
+TEST_F(CPUBBoxUtilTest, TestGetPriorBBoxesFlat) {
+  const int num_priors = 2;
+  const int dim = num_priors * 4;
+  Blob<float> prior_blob(1, 2, dim, 1);
+  float* prior_data = prior_blob.mutable_cpu_data();
+  for (int i = 0; i < num_priors; ++i) {
+    prior_data[i * 4] = i * 0.1;
+    prior_data[i * 4 + 1] = i * 0.1;
+    prior_data[i * 4 + 2] = i * 0.1 + 0.2;
+    prior_data[i * 4 + 3] = i * 0.1 + 0.1;
+    for (int j = 0; j < 4; ++j) {
+      prior_data[dim + i * 4 + j]  = 0.1 * (j + 1);
+    }
+  }
+
+  shared_ptr<const PriorBBoxes> priors =
+      GetPriorBBoxes(prior_data, num_priors);
+  EXPECT_EQ(priors->num_priors, num_priors);
+  for (int i = 0; i < num_priors; ++i) {
+    EXPECT_NEAR(priors->xmin[i], i * 0.1, eps);
+    EXPECT_NEAR(priors->ymin[i], i * 0.1, eps);
+    EXPECT_NEAR(priors->xmax[i], i * 0.1 + 0.2, eps);
+    EXPECT_NEAR(priors->ymax[i], i * 0.1 + 0.1, eps);
+    EXPECT_NEAR(priors->center_x[i], i * 0.1 + 0.1, eps);
+    EXPECT_NEAR(priors->center_y[i], i * 0.1 + 0.05, eps);
+    EXPECT_NEAR(priors->width[i], 0.2, eps);
+    EXPECT_NEAR(priors->height[i], 0.1, eps);
+    EXPECT_NEAR(priors->size[i], 0.02, eps);
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_NEAR(priors->variances()[i * 4 + j], 0.1 * (j + 1), eps);
+    }
+  }
+
+  // The same priors are shared while they are held.
+  Blob<float> same_blob(1, 2, dim, 1);
+  same_blob.CopyFrom(prior_blob);
+  EXPECT_EQ(priors, GetPriorBBoxes(same_blob.cpu_data(), num_priors));
+  prior_data[dim] = 0.5;
+  shared_ptr<const PriorBBoxes> other_priors =
+      GetPriorBBoxes(prior_data, num_priors);
+  EXPECT_NE(priors, other_priors);
+  EXPECT_NEAR(other_priors->variances()[0], 0.5, eps);
+
+  // The last priors of the caller are kept while the data is the same, and
+  // replaced by the shared ones when it changes.
+  EXPECT_EQ(other_priors,
+            GetPriorBBoxes(prior_data, num_priors, other_priors));
+  EXPECT_EQ(priors,
+            GetPriorBBoxes(same_blob.cpu_data(), num_priors, other_priors));
+}
+
 TEST_F(CPUBBoxUtilTest, TestGetDetectionResults) {
   const int num = 4;
   const int num_det = (1 + num) * num / 2;
@@ -1419,6 +1864,264 @@ TEST_F(CPUBBoxUtilTest, TestApplyNMSFast) {
   EXPECT_EQ(indices[0], 0);
 }
 
+TEST_F(CPUBBoxUtilTest, TestApplyNMSFastRaw) {
+  // The bboxes of TestApplyNMSFast, plus a copy of the first one with the
+  // same score.
+  const float bboxes[] = {0.1, 0.1, 0.3, 0.3,
+                          0.2, 0.1, 0.4, 0.3,
+                          0.2, 0.0, 0.4, 0.2,
+                          0.1, 0.2, 0.4, 0.4,
+                          0.1, 0.1, 0.3, 0.3};
+  const float scores[] = {0.8, 0.7, 0.4, 0.5, 0.8};
+  vector<pair<float, int> > score_index_vec;
+  vector<int> indices;
+
+  ApplyNMSFast(bboxes, scores, 4, 0., 0.3, 1., -1, &score_index_vec,
+               &indices);
+  EXPECT_EQ(indices.size(), 3);
+  EXPECT_EQ(indices[0], 0);
+  EXPECT_EQ(indices[1], 3);
+  EXPECT_EQ(indices[2], 2);
+
+  // Ties are broken by index, so the copy is suppressed.
+  ApplyNMSFast(bboxes, scores, 5, 0., 0.3, 1., -1, &score_index_vec,
+               &indices);
+  EXPECT_EQ(indices.size(), 3);
+  EXPECT_EQ(indices[0], 0);
+  EXPECT_EQ(indices[1], 3);
+  EXPECT_EQ(indices[2], 2);
+
+  ApplyNMSFast(bboxes, scores, 5, 0., 0.3, 1., 2, &score_index_vec,
+               &indices);
+  EXPECT_EQ(indices.size(), 1);
+  EXPECT_EQ(indices[0], 0);
+
+  ApplyNMSFast(bboxes, scores, 5, 0.5, 0.2, 1., -1, &score_index_vec,
+               &indices);
+  EXPECT_EQ(indices.size(), 1);
+  EXPECT_EQ(indices[0], 0);
+}
+
+// Fill num random bboxes inside [0, 1] and their scores.
+static void FillRandomBBoxes(const int num, vector<float>* bboxes,
+                             vector<float>* scores) {
+  bboxes->resize(num * 4);
+  scores->resize(num);
+  caffe_rng_uniform(num * 4, 0.f, 1.f, &(*bboxes)[0]);
+  caffe_rng_uniform(num, 0.f, 1.f, &(*scores)[0]);
+  for (int i = 0; i < num; ++i) {
+    float* bbox = &(*bboxes)[i * 4];
+    // Small bboxes so that there are both overlapping and separate ones.
+    bbox[2] = std::min(1.f, bbox[0] + 0.2f * bbox[2]);
+    bbox[3] = std::min(1.f, bbox[1] + 0.2f * bbox[3]);
+  }
+}
+
+TEST_F(CPUBBoxUtilTest, TestApplyNMSBitmask) {
+  Caffe::set_random_seed(1701);
+  vector<float> bboxes;
+  vector<float> scores;
+  NMSBuffer<float> buffer;
+  vector<int> indices;
+  vector<int> expected_indices;
+  // Sizes around the 32 bit blocks of the mask.
+  const int nums[] = {1, 31, 32, 33, 100, 257};
+  for (int k = 0; k < 6; ++k) {
+    FillRandomBBoxes(nums[k], &bboxes, &scores);
+    for (int top_k = -1; top_k < 60; top_k += 50) {
+      ApplyNMSFast(&bboxes[0], &scores[0], nums[k], 0.2, 0.3, 1., top_k,
+                   &expected_indices);
+      ApplyNMSBitmask(&bboxes[0], &scores[0], nums[k], 0.2, 0.3, top_k,
+                      &buffer, &indices);
+      EXPECT_EQ(expected_indices.size(), indices.size());
+      for (int i = 0; i < std::min(indices.size(), expected_indices.size());
+           ++i) {
+        EXPECT_EQ(expected_indices[i], indices[i]);
+      }
+    }
+  }
+}
+
+// Three bboxes in a row, where each overlaps its neighbours by 1/3.
+static const float kRowBBoxes[] = {0.0, 0.0, 0.2, 0.2,
+                                   0.1, 0.0, 0.3, 0.2,
+                                   0.2, 0.0, 0.4, 0.2};
+static const float kRowScores[] = {0.9, 0.8, 0.7};
+
+TEST_F(CPUBBoxUtilTest, TestApplySoftNMS) {
+  NMSBuffer<float> buffer;
+  vector<int> indices;
+  vector<float> new_scores;
+  ApplySoftNMS(kRowBBoxes, kRowScores, 3, 0., 0.3, -1,
+               NonMaximumSuppressionParameter_Decay_LINEAR, 0.5, &buffer,
+               &indices, &new_scores);
+  EXPECT_EQ(3, indices.size());
+  EXPECT_EQ(0, indices[0]);
+  EXPECT_EQ(2, indices[1]);
+  EXPECT_EQ(1, indices[2]);
+  EXPECT_NEAR(0.9, new_scores[0], eps);
+  EXPECT_NEAR(0.7, new_scores[1], eps);
+  EXPECT_NEAR(0.8 * 2 / 3 * 2 / 3, new_scores[2], eps);
+
+  ApplySoftNMS(kRowBBoxes, kRowScores, 3, 0., 0.3, -1,
+               NonMaximumSuppressionParameter_Decay_GAUSSIAN, 0.5, &buffer,
+               &indices, &new_scores);
+  EXPECT_EQ(3, indices.size());
+  EXPECT_EQ(1, indices[2]);
+  EXPECT_NEAR(0.8 * exp(-2. / 9 * 2), new_scores[2], eps);
+
+  // The decayed score of bbox 1 falls below the threshold.
+  ApplySoftNMS(kRowBBoxes, kRowScores, 3, 0.4, 0.3, -1,
+               NonMaximumSuppressionParameter_Decay_LINEAR, 0.5, &buffer,
+               &indices, &new_scores);
+  EXPECT_EQ(2, indices.size());
+  EXPECT_EQ(0, indices[0]);
+  EXPECT_EQ(2, indices[1]);
+}
+
+TEST_F(CPUBBoxUtilTest, TestApplyMatrixNMS) {
+  NMSBuffer<float> buffer;
+  vector<int> indices;
+  vector<float> new_scores;
+  // Bbox 1 is suppressed by bbox 0. Bbox 2 overlaps bbox 1 as much as bbox 1
+  // overlaps bbox 0, so it is not suppressed.
+  ApplyMatrixNMS(kRowBBoxes, kRowScores, 3, 0., -1,
+                 NonMaximumSuppressionParameter_Decay_LINEAR, 0.5, &buffer,
+                 &indices, &new_scores);
+  EXPECT_EQ(3, indices.size());
+  EXPECT_EQ(0, indices[0]);
+  EXPECT_EQ(2, indices[1]);
+  EXPECT_EQ(1, indices[2]);
+  EXPECT_NEAR(0.9, new_scores[0], eps);
+  EXPECT_NEAR(0.7, new_scores[1], eps);
+  EXPECT_NEAR(0.8 * 2 / 3, new_scores[2], eps);
+
+  ApplyMatrixNMS(kRowBBoxes, kRowScores, 3, 0., -1,
+                 NonMaximumSuppressionParameter_Decay_GAUSSIAN, 0.5, &buffer,
+                 &indices, &new_scores);
+  EXPECT_EQ(3, indices.size());
+  EXPECT_NEAR(0.7, new_scores[1], eps);
+  EXPECT_NEAR(0.8 * exp(-2. / 9), new_scores[2], eps);
+
+  // top_k only considers bboxes 0 and 1.
+  ApplyMatrixNMS(kRowBBoxes, kRowScores, 3, 0.6, 2,
+                 NonMaximumSuppressionParameter_Decay_LINEAR, 0.5, &buffer,
+                 &indices, &new_scores);
+  EXPECT_EQ(1, indices.size());
+  EXPECT_EQ(0, indices[0]);
+}
+
+TEST_F(CPUBBoxUtilTest, DISABLED_TestNMSBenchmark) {
+  // Compare the nms algorithms on the candidates of one class of SSD300.
+  Caffe::set_random_seed(1701);
+  const int num = 8732;
+  const float score_threshold = 0.9;
+  vector<float> bboxes;
+  vector<float> scores;
+  FillRandomBBoxes(num, &bboxes, &scores);
+  vector<NormalizedBBox> bbox_protos(num);
+  for (int i = 0; i < num; ++i) {
+    bbox_protos[i].set_xmin(bboxes[i * 4]);
+    bbox_protos[i].set_ymin(bboxes[i * 4 + 1]);
+    bbox_protos[i].set_xmax(bboxes[i * 4 + 2]);
+    bbox_protos[i].set_ymax(bboxes[i * 4 + 3]);
+  }
+
+  const int iters = 5;
+  vector<int> indices;
+  CPUTimer timer;
+  timer.Start();
+  for (int it = 0; it < iters; ++it) {
+    ApplyNMSFast(bbox_protos, scores, score_threshold, 0.45, 1., -1,
+                 &indices);
+  }
+  LOG(INFO) << "ApplyNMSFast on NormalizedBBox: "
+            << timer.MicroSeconds() / iters << " us, kept " << indices.size();
+
+  NonMaximumSuppressionParameter nms_param;
+  nms_param.set_nms_threshold(0.45);
+  NMSBuffer<float> buffer;
+  vector<float> new_scores;
+  const char* names[] = {"GREEDY", "BITMASK", "SOFT", "MATRIX"};
+  for (int algorithm = 0; algorithm < 4; ++algorithm) {
+    nms_param.set_algorithm(
+        static_cast<NonMaximumSuppressionParameter_Algorithm>(algorithm));
+    timer.Start();
+    for (int it = 0; it < iters; ++it) {
+      ApplyNMS(&bboxes[0], &scores[0], num, score_threshold, nms_param,
+               &buffer, &indices, &new_scores);
+    }
+    LOG(INFO) << names[algorithm] << " nms: "
+              << timer.MicroSeconds() / iters << " us, kept "
+              << indices.size();
+    EXPECT_GT(indices.size(), 0);
+  }
+}
+
+TEST_F(CPUBBoxUtilTest, DISABLED_TestMiningBenchmark) {
+  // Mine the hard negatives of SSD300 on VOC with a batch of 8 images.
+  Caffe::set_random_seed(1701);
+  const int num_priors = 8732;
+  const int num_classes = 21;
+  const vector<int> num_gt(8, 5);
+  const int num = num_gt.size();
+  vector<float> prior_data, gt_data;
+  FillMatchingData(num_priors, num_gt, &prior_data, &gt_data);
+  const int num_rows = gt_data.size() / 8;
+  Blob<float> conf_blob(num, num_priors * num_classes, 1, 1);
+  caffe_rng_gaussian(conf_blob.count(), 0.f, 2.f,
+                     conf_blob.mutable_cpu_data());
+  MultiBoxLossParameter param;
+  param.set_num_classes(num_classes);
+  param.set_mining_type(MultiBoxLossParameter_MiningType_MAX_NEGATIVE);
+  vector<float> gt_bboxes;
+  vector<int> gt_labels, gt_start;
+  GetGroundTruth(&gt_data[0], num_rows, num, 0, true, &gt_bboxes, &gt_labels,
+                 &gt_start);
+  vector<vector<float> > buffers;
+  vector<map<int, vector<float> > > match_overlaps;
+  vector<map<int, vector<int> > > match_indices;
+  FindMatches(&prior_data[0], num_priors, gt_bboxes, gt_labels, gt_start,
+              param, &buffers, &match_overlaps, &match_indices);
+  map<int, vector<NormalizedBBox> > all_gt_bboxes;
+  GetGroundTruth(&gt_data[0], num_rows, 0, true, &all_gt_bboxes);
+  vector<NormalizedBBox> prior_bboxes;
+  vector<vector<float> > prior_variances;
+  GetPriorBBoxes(&prior_data[0], num_priors, &prior_bboxes, &prior_variances);
+  vector<LabelBBox> all_loc_preds(num);
+
+  const int iters = 5;
+  vector<vector<int> > neg_indices;
+  int num_matches, num_negs;
+  CPUTimer timer;
+  timer.Start();
+  for (int it = 0; it < iters; ++it) {
+    neg_indices.clear();
+    MineHardExamples(conf_blob, all_loc_preds, all_gt_bboxes, prior_bboxes,
+                     prior_variances, match_overlaps, param, &num_matches,
+                     &num_negs, &match_indices, &neg_indices);
+  }
+  LOG(INFO) << "MineHardExamples: " << timer.MicroSeconds() / iters
+            << " us, " << num_negs << " negatives";
+  const int expected_num_negs = num_negs;
+
+  Blob<float> prob(num, num_priors, num_classes, 1);
+  Blob<float> conf_loss(num, num_priors, 1, 1);
+  timer.Start();
+  for (int it = 0; it < iters; ++it) {
+    ComputeConfLossSoftmax(conf_blob.cpu_data(), num, num_priors, num_classes,
+                           0, match_indices, gt_labels, gt_start,
+                           prob.mutable_cpu_data(),
+                           conf_loss.mutable_cpu_data());
+    MineHardNegatives(conf_loss.cpu_data(), num, num_priors, match_overlaps,
+                      match_indices, param, &num_negs, &neg_indices);
+  }
+  LOG(INFO) << "ComputeConfLossSoftmax and MineHardNegatives: "
+            << timer.MicroSeconds() / iters << " us, " << num_negs
+            << " negatives";
+  EXPECT_EQ(expected_num_negs, num_negs);
+}
+
 TEST_F(CPUBBoxUtilTest, TestCumSum) {
   vector<pair<float, int> > pairs;
   vector<int> cumsum;
@@ -112,6 +112,125 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestSparseProtoRoundTrip) {
+  vector<int> shape(4);
+  shape[0] = 4;
+  shape[1] = 3;
+  shape[2] = 5;
+  shape[3] = 5;
+  Blob<TypeParam> source(shape);
+  source.set_sparsity_mode(SparsityParameter::PRUNE);
+  TypeParam* data = source.mutable_cpu_data();
+  int nnz = 0;
+  for (int i = 0; i < source.count(); ++i) {
+    data[i] = (i % 3 == 0) ? TypeParam(i + 1) : TypeParam(0);
+    nnz += (data[i] != 0);
+  }
+  BlobProto blob_proto;
+  source.ToProto(&blob_proto);
+  // Only the CSR form is stored.
+  EXPECT_EQ(BlobProto::CSR, blob_proto.storage());
+  EXPECT_EQ(nnz, blob_proto.nnz());
+  EXPECT_EQ(0, blob_proto.data_size() + blob_proto.double_data_size());
+  EXPECT_EQ(0, blob_proto.mask_size() + blob_proto.double_mask_size());
+  EXPECT_EQ(nnz, blob_proto.csrcolind_delta_size());
+  EXPECT_EQ(shape[0] + 1, blob_proto.csrrowptr_size());
+
+  Blob<TypeParam> target(shape);
+  target.set_sparsity_mode(SparsityParameter::PRUNE);
+  target.FromProto(blob_proto, false);
+  EXPECT_EQ(nnz, target.nnz());
+  EXPECT_EQ(nnz, target.mask_nnz());
+  EXPECT_FALSE(target.use_csr());
+  for (int i = 0; i < source.count(); ++i) {
+    EXPECT_EQ(data[i], target.cpu_data()[i]);
+    const bool kept = (target.cpu_mask()[i / 32] >> (i % 32)) & 1;
+    EXPECT_EQ(data[i] != 0, kept);
+  }
+
+  // A SPARSE blob keeps the CSR arrays and writes them back unchanged.
+  Blob<TypeParam> sparse(shape);
+  sparse.set_sparsity_mode(SparsityParameter::SPARSE);
+  sparse.FromProto(blob_proto, false);
+  EXPECT_TRUE(sparse.use_csr());
+  BlobProto sparse_proto;
+  sparse.ToProto(&sparse_proto);
+  EXPECT_EQ(blob_proto.SerializeAsString(), sparse_proto.SerializeAsString());
+}
+
+TYPED_TEST(BlobSimpleTest, TestLegacyCsrProto) {
+  // Older models store the CSR arrays with absolute column indices, and
+  // neither dense data nor a storage field.
+  const int rows = 3;
+  const int cols = 4;
+  const float values[] = {1, 2, 3, 4};
+  const int colind[] = {0, 3, 1, 2};
+  const int rowptr[] = {0, 2, 2, 4};
+  BlobProto blob_proto;
+  blob_proto.mutable_shape()->add_dim(rows);
+  blob_proto.mutable_shape()->add_dim(cols);
+  for (int i = 0; i < 4; ++i) {
+    blob_proto.add_csrval(values[i]);
+    blob_proto.add_csrcolind(colind[i]);
+  }
+  for (int i = 0; i <= rows; ++i) {
+    blob_proto.add_csrrowptr(rowptr[i]);
+  }
+  blob_proto.set_nnz(4);
+  EXPECT_FALSE(blob_proto.has_storage());
+  const SparsityParameter::Mode modes[] = {SparsityParameter::DENSE,
+                                           SparsityParameter::PRUNE};
+  vector<int> shape(2);
+  shape[0] = rows;
+  shape[1] = cols;
+  for (int m = 0; m < 2; ++m) {
+    Blob<TypeParam> blob(shape);
+    blob.set_sparsity_mode(modes[m]);
+    caffe_set(blob.count(), TypeParam(7), blob.mutable_cpu_data());
+    blob.FromProto(blob_proto, false);
+    for (int i = 0; i < blob.count(); ++i) {
+      TypeParam expected = 0;
+      for (int j = 0; j < 4; ++j) {
+        if (rowptr[i / cols] <= j && j < rowptr[i / cols + 1] &&
+            colind[j] == i % cols) {
+          expected = values[j];
+        }
+      }
+      EXPECT_EQ(expected, blob.cpu_data()[i]);
+      if (modes[m] == SparsityParameter::PRUNE) {
+        const bool kept = (blob.cpu_mask()[i / 32] >> (i % 32)) & 1;
+        EXPECT_EQ(expected != 0, kept);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestPrunedUpdate) {
+  Blob<TypeParam> blob(1, 1, 1, 70);
+  blob.set_sparsity_mode(SparsityParameter::PRUNE);
+  EXPECT_EQ(blob.count(), blob.mask_nnz());
+  uint32_t* mask = blob.mutable_cpu_mask();
+  for (int i = 0; i < blob.count(); i += 5) {
+    mask[i / 32] &= ~(1u << (i % 32));
+  }
+  TypeParam* data = blob.mutable_cpu_data();
+  TypeParam* diff = blob.mutable_cpu_diff();
+  for (int i = 0; i < blob.count(); ++i) {
+    data[i] = TypeParam(i);
+    diff[i] = TypeParam(0.5);
+  }
+  blob.Update();
+  for (int i = 0; i < blob.count(); ++i) {
+    if (i % 5 == 0) {
+      EXPECT_EQ(0, blob.cpu_data()[i]);
+      EXPECT_FALSE(blob.mask_at(0, 0, 0, i));
+    } else {
+      EXPECT_EQ(TypeParam(i) - TypeParam(0.5), blob.cpu_data()[i]);
+    }
+  }
+  EXPECT_EQ(blob.count() - (blob.count() + 4) / 5, blob.mask_nnz());
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -467,6 +467,48 @@ TYPED_TEST(ConvolutionLayerTest, Test1x1Convolution) {
   }
 }
 
+// A SPARSE layer loading CSR-only filters computes as the dense filters, on
+// CPU with the CSR arrays and on GPU with the filters expanded to dense.
+TYPED_TEST(ConvolutionLayerTest, TestSparseConvolutionFromCsr) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  layer_param.mutable_sparsity_param()->set_mode(SparsityParameter::DENSE);
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weights = layer.blobs()[0].get();
+  for (int i = 0; i < weights->count(); i += 3) {
+    weights->mutable_cpu_data()[i] = 0;
+  }
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+
+  Blob<Dtype> pruned;
+  pruned.set_sparsity_mode(SparsityParameter::PRUNE);
+  pruned.CopyFrom(*weights, false, true);
+  BlobProto weights_proto;
+  pruned.ToProto(&weights_proto);
+  ASSERT_EQ(BlobProto::CSR, weights_proto.storage());
+  layer_param.mutable_sparsity_param()->set_mode(SparsityParameter::SPARSE);
+  ConvolutionLayer<Dtype> sparse_layer(layer_param);
+  sparse_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  sparse_layer.blobs()[0]->FromProto(weights_proto, false);
+  EXPECT_TRUE(sparse_layer.blobs()[0]->use_csr());
+  sparse_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
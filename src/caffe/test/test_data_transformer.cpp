@@ -1,4 +1,6 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
 #include <algorithm>
 #include <string>
 #include <vector>
@@ -75,6 +77,26 @@ class DataTransformTest : public ::testing::Test {
     }
   }
 
+  void ExpectSameAnnotation(const RepeatedPtrField<AnnotationGroup>& expected,
+                            const RepeatedPtrField<AnnotationGroup>& actual) {
+    const float eps = 1e-6;
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int g = 0; g < expected.size(); ++g) {
+      EXPECT_EQ(expected.Get(g).group_label(), actual.Get(g).group_label());
+      ASSERT_EQ(expected.Get(g).annotation_size(),
+                actual.Get(g).annotation_size());
+      for (int a = 0; a < expected.Get(g).annotation_size(); ++a) {
+        const Annotation& anno = expected.Get(g).annotation(a);
+        const Annotation& actual_anno = actual.Get(g).annotation(a);
+        EXPECT_EQ(anno.instance_id(), actual_anno.instance_id());
+        EXPECT_NEAR(anno.bbox().xmin(), actual_anno.bbox().xmin(), eps);
+        EXPECT_NEAR(anno.bbox().ymin(), actual_anno.bbox().ymin(), eps);
+        EXPECT_NEAR(anno.bbox().xmax(), actual_anno.bbox().xmax(), eps);
+        EXPECT_NEAR(anno.bbox().ymax(), actual_anno.bbox().ymax(), eps);
+      }
+    }
+  }
+
   int NumSequenceMatches(const TransformationParameter transform_param,
       const Datum& datum, Phase phase) {
     // Get crop sequence with Caffe seed 1701.
@@ -455,5 +477,123 @@ TYPED_TEST(DataTransformTest, TestRichLabelCropMirror) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestRichLabelExpandCropMat) {
+  TransformationParameter transform_param;
+  const int label = 3;
+  AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  transform_param.mutable_expand_param()->set_prob(1);
+  transform_param.mutable_expand_param()->set_max_expand_ratio(2);
+
+  AnnotatedDatum anno_datum;
+  this->FillAnnotatedDatum(label, false, true, type, &anno_datum);
+  cv::Mat img(this->height_, this->width_, CV_8UC2, cv::Scalar(label, label));
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+
+  // The cv::Mat versions move the annotation like the AnnotatedDatum ones.
+  Caffe::set_random_seed(this->seed_);
+  AnnotatedDatum expand_datum;
+  transformer.ExpandImage(anno_datum, &expand_datum);
+  Caffe::set_random_seed(this->seed_);
+  cv::Mat expand_img;
+  RepeatedPtrField<AnnotationGroup> expand_anno;
+  transformer.ExpandImage(img, anno_datum.annotation_group(), &expand_img,
+                          &expand_anno);
+  EXPECT_EQ(expand_datum.datum().height(), expand_img.rows);
+  EXPECT_EQ(expand_datum.datum().width(), expand_img.cols);
+  this->ExpectSameAnnotation(expand_datum.annotation_group(), expand_anno);
+
+  NormalizedBBox crop_bbox;
+  crop_bbox.set_xmin(0.2);
+  crop_bbox.set_ymin(0.1);
+  crop_bbox.set_xmax(0.7);
+  crop_bbox.set_ymax(0.9);
+  AnnotatedDatum crop_datum;
+  transformer.CropImage(expand_datum, crop_bbox, &crop_datum);
+  cv::Mat crop_img;
+  RepeatedPtrField<AnnotationGroup> crop_anno;
+  transformer.CropImage(expand_img, expand_anno, crop_bbox, &crop_img,
+                        &crop_anno);
+  EXPECT_EQ(crop_datum.datum().height(), crop_img.rows);
+  EXPECT_EQ(crop_datum.datum().width(), crop_img.cols);
+  this->ExpectSameAnnotation(crop_datum.annotation_group(), crop_anno);
+
+  // So does the final transformation of the annotation.
+  Blob<TypeParam> datum_blob(1, this->channels_, crop_img.rows, crop_img.cols);
+  Blob<TypeParam> mat_blob(1, this->channels_, crop_img.rows, crop_img.cols);
+  RepeatedPtrField<AnnotationGroup> datum_anno;
+  RepeatedPtrField<AnnotationGroup> mat_anno;
+  transformer.Transform(crop_datum, &datum_blob, &datum_anno);
+  transformer.Transform(crop_img, crop_anno, &mat_blob, &mat_anno);
+  this->ExpectSameAnnotation(datum_anno, mat_anno);
+  for (int i = 0; i < datum_blob.count(); ++i) {
+    EXPECT_EQ(mat_blob.cpu_data()[i], datum_blob.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestExpandCropRawDatum) {
+  TransformationParameter transform_param;
+  transform_param.add_mean_value(7);
+  transform_param.add_mean_value(9);
+  const int label = 0;
+  const bool unique_pixels = true;
+  Datum datum;
+  this->FillDatum(label, unique_pixels, &datum);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  Caffe::set_random_seed(this->seed_);
+
+  // The background is filled with the mean values.
+  NormalizedBBox expand_bbox;
+  Datum expand_datum;
+  transformer.ExpandImage(datum, 1.5, &expand_bbox, &expand_datum);
+  const int height = expand_datum.height();
+  const int width = expand_datum.width();
+  EXPECT_EQ(this->channels_, expand_datum.channels());
+  EXPECT_EQ(15, height);
+  EXPECT_EQ(15, width);
+  ASSERT_EQ(this->channels_ * height * width, expand_datum.data().size());
+  const int h_off = static_cast<int>(-expand_bbox.ymin() * this->height_);
+  const int w_off = static_cast<int>(-expand_bbox.xmin() * this->width_);
+  for (int c = 0; c < this->channels_; ++c) {
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const int y = h - h_off;
+        const int x = w - w_off;
+        int expected = c == 0 ? 7 : 9;
+        if (y >= 0 && y < this->height_ && x >= 0 && x < this->width_) {
+          expected = (c * this->height_ + y) * this->width_ + x;
+        }
+        EXPECT_EQ(expected, static_cast<uint8_t>(
+            expand_datum.data()[(c * height + h) * width + w]));
+      }
+    }
+  }
+
+  // Crop twice into the same datum.
+  NormalizedBBox crop_bbox;
+  crop_bbox.set_xmin(0.2);
+  crop_bbox.set_ymin(0.1);
+  crop_bbox.set_xmax(0.7);
+  crop_bbox.set_ymax(0.9);
+  Datum crop_datum;
+  transformer.CropImage(datum, crop_bbox, &crop_datum);
+  crop_bbox.set_xmax(0.5);
+  transformer.CropImage(datum, crop_bbox, &crop_datum);
+  EXPECT_EQ(this->channels_, crop_datum.channels());
+  EXPECT_EQ(8, crop_datum.height());
+  EXPECT_EQ(3, crop_datum.width());
+  ASSERT_EQ(this->channels_ * 8 * 3, crop_datum.data().size());
+  for (int c = 0; c < this->channels_; ++c) {
+    for (int h = 0; h < 8; ++h) {
+      for (int w = 0; w < 3; ++w) {
+        EXPECT_EQ((c * this->height_ + h + 1) * this->width_ + w + 2,
+                  static_cast<uint8_t>(
+                      crop_datum.data()[(c * 8 + h) * 3 + w]));
+      }
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
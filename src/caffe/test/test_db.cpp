@@ -117,6 +117,25 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueData) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(cursor->valid());
+    string value = cursor->value();
+    EXPECT_EQ(value.size(), cursor->value_size());
+    EXPECT_EQ(value, string(cursor->value_data(), cursor->value_size()));
+    Datum datum, expected_datum;
+    EXPECT_TRUE(cursor->ParseValue(&datum));
+    expected_datum.ParseFromString(value);
+    EXPECT_EQ(expected_datum.SerializeAsString(), datum.SerializeAsString());
+    EXPECT_EQ(i, datum.label());
+    cursor->Next();
+  }
+  EXPECT_FALSE(cursor->valid());
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
@@ -336,4 +336,88 @@ TYPED_TEST(DetectionOutputLayerTest, TestForwardNoShareLocationNeg0TopK) {
   this->CheckEqual(*(this->blob_top_), 2, "1 1 0.6 0.40 0.40 0.70 0.70");
 }
 
+TYPED_TEST(DetectionOutputLayerTest, TestForwardBatchMatchesSingleImages) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num = 6;
+  const int num_priors = 16;
+  const int num_classes = 5;
+  LayerParameter layer_param;
+  DetectionOutputParameter* detection_output_param =
+      layer_param.mutable_detection_output_param();
+  detection_output_param->set_num_classes(num_classes);
+  detection_output_param->set_share_location(false);
+  detection_output_param->set_background_label_id(0);
+  detection_output_param->set_keep_top_k(7);
+  detection_output_param->set_confidence_threshold(0.3);
+  detection_output_param->mutable_nms_param()->set_nms_threshold(0.45);
+
+  // Random priors inside [0, 1] and random predictions.
+  Blob<Dtype> prior(1, 2, num_priors * 4, 1);
+  FillerParameter filler_param;
+  filler_param.set_min(0);
+  filler_param.set_max(0.5);
+  UniformFiller<Dtype> uniform_filler(filler_param);
+  uniform_filler.Fill(&prior);
+  Dtype* prior_data = prior.mutable_cpu_data();
+  for (int i = 0; i < num_priors * 4; ++i) {
+    if (i % 4 >= 2) {
+      prior_data[i] += 0.5;
+    }
+    prior_data[num_priors * 4 + i] = i % 4 < 2 ? 0.1 : 0.2;
+  }
+  Blob<Dtype> loc(num, num_priors * num_classes * 4, 1, 1);
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> gaussian_filler(filler_param);
+  gaussian_filler.Fill(&loc);
+  Blob<Dtype> conf(num, num_priors * num_classes, 1, 1);
+  filler_param.set_max(1);
+  UniformFiller<Dtype> conf_filler(filler_param);
+  conf_filler.Fill(&conf);
+
+  vector<Blob<Dtype>*> bottom_vec;
+  bottom_vec.push_back(&loc);
+  bottom_vec.push_back(&conf);
+  bottom_vec.push_back(&prior);
+  DetectionOutputLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  const Blob<Dtype>& batch_top = *(this->blob_top_);
+
+  // The detections of each image in the batch are the same as when the image
+  // is processed on its own.
+  Blob<Dtype> single_loc(1, loc.count(1), 1, 1);
+  Blob<Dtype> single_conf(1, conf.count(1), 1, 1);
+  Blob<Dtype> single_top;
+  vector<Blob<Dtype>*> single_bottom_vec;
+  single_bottom_vec.push_back(&single_loc);
+  single_bottom_vec.push_back(&single_conf);
+  single_bottom_vec.push_back(&prior);
+  vector<Blob<Dtype>*> single_top_vec(1, &single_top);
+  DetectionOutputLayer<Dtype> single_layer(layer_param);
+  single_layer.SetUp(single_bottom_vec, single_top_vec);
+  int row = 0;
+  for (int i = 0; i < num; ++i) {
+    caffe_copy(loc.count(1), loc.cpu_data() + loc.offset(i),
+               single_loc.mutable_cpu_data());
+    caffe_copy(conf.count(1), conf.cpu_data() + conf.offset(i),
+               single_conf.mutable_cpu_data());
+    single_layer.Forward(single_bottom_vec, single_top_vec);
+    for (int j = 0; j < single_top.height(); ++j) {
+      const Dtype* single_det = single_top.cpu_data() + j * 7;
+      if (single_det[1] == -1) {
+        // No detections for this image.
+        continue;
+      }
+      ASSERT_LT(row, batch_top.height());
+      const Dtype* batch_det = batch_top.cpu_data() + row * 7;
+      EXPECT_EQ(i, batch_det[0]);
+      for (int k = 1; k < 7; ++k) {
+        EXPECT_NEAR(single_det[k], batch_det[k], eps);
+      }
+      ++row;
+    }
+  }
+  EXPECT_EQ(row, batch_top.height());
+}
+
 }  // namespace caffe
@@ -0,0 +1,111 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/detection_writer.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DetectionWriterTest : public ::testing::Test {
+ protected:
+  DetectionWriterTest() {
+    MakeTempDir(&output_directory_);
+    label_to_name_[0] = "background";
+    label_to_name_[1] = "cat";
+    label_to_name_[2] = "18";
+  }
+
+  DetectionWriter* NewWriter(const string& output_format) {
+    return new DetectionWriter(output_directory_, "det_", output_format,
+                               label_to_name_, 3, 0);
+  }
+
+  // Add a pass of three images in two commits; "img2" has no detection.
+  void AddDetections(DetectionWriter* writer) {
+    writer->AddImage("42");
+    writer->AddDetection(1, 0.9, 10.123, 20.456, 50.789, 60.5);
+    writer->AddDetection(2, 0.25, 0, 1.5, 99.999, 7);
+    writer->Commit(false);
+    writer->AddImage("img2");
+    writer->AddImage("img 3");
+    writer->AddDetection(1, 0.5, 3.3, 4.4, 5.5, 6.6);
+    writer->Commit(true);
+  }
+
+  string ReadFile(const string& name) {
+    std::ifstream infile((output_directory_ + "/" + name).c_str());
+    EXPECT_TRUE(infile.good()) << name;
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    return ss.str();
+  }
+
+  string output_directory_;
+  map<int, string> label_to_name_;
+};
+
+TEST_F(DetectionWriterTest, TestVOC) {
+  shared_ptr<DetectionWriter> writer(NewWriter("VOC"));
+  AddDetections(writer.get());
+  writer.reset();
+  EXPECT_EQ("42 0.9 10 20 50 60\nimg 3 0.5 3 4 5 6\n", ReadFile("det_cat.txt"));
+  EXPECT_EQ("42 0.25 0 1 100 6\n", ReadFile("det_18.txt"));
+}
+
+TEST_F(DetectionWriterTest, TestCOCO) {
+  shared_ptr<DetectionWriter> writer(NewWriter("COCO"));
+  AddDetections(writer.get());
+  writer.reset();
+  EXPECT_EQ("[\n"
+      "{\"image_id\": 42, \"category_id\": \"cat\", "
+      "\"bbox\": [10.12, 20.46, 40.67, 40.04], \"score\": 0.9},\n"
+      "{\"image_id\": 42, \"category_id\": 18, "
+      "\"bbox\": [0, 1.5, 100, 5.5], \"score\": 0.25},\n"
+      "{\"image_id\": \"img 3\", \"category_id\": \"cat\", "
+      "\"bbox\": [3.3, 4.4, 2.2, 2.2], \"score\": 0.5}\n"
+      "]\n", ReadFile("det_.json"));
+}
+
+TEST_F(DetectionWriterTest, TestILSVRC) {
+  shared_ptr<DetectionWriter> writer(NewWriter("ILSVRC"));
+  AddDetections(writer.get());
+  writer.reset();
+  EXPECT_EQ("42 1 0.9 10 20 50 60\n42 2 0.25 0 1 100 6\nimg 3 1 0.5 3 4 5 6\n",
+            ReadFile("det_.txt"));
+}
+
+TEST_F(DetectionWriterTest, TestPassesOverwrite) {
+  shared_ptr<DetectionWriter> writer(NewWriter("VOC"));
+  AddDetections(writer.get());
+  writer->AddImage("img4");
+  writer->AddDetection(2, 0.75, 1, 2, 3, 4);
+  writer->Commit(true);
+  // An empty pass still truncates the files.
+  writer->AddImage("img5");
+  writer->Commit(true);
+  writer.reset();
+  EXPECT_EQ("", ReadFile("det_cat.txt"));
+  EXPECT_EQ("", ReadFile("det_18.txt"));
+}
+
+TEST_F(DetectionWriterTest, TestLastPassIsWritten) {
+  shared_ptr<DetectionWriter> writer(NewWriter("COCO"));
+  AddDetections(writer.get());
+  writer->AddImage("img4");
+  writer->AddDetection(2, 0.75, 1, 2, 3, 4);
+  writer->Commit(true);
+  writer.reset();
+  EXPECT_EQ("[\n"
+      "{\"image_id\": \"img4\", \"category_id\": 18, "
+      "\"bbox\": [1, 2, 2, 2], \"score\": 0.75}\n"
+      "]\n", ReadFile("det_.json"));
+}
+
+}  // namespace caffe
@@ -1,7 +1,15 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
+#include <cstdlib>
+
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/im_transforms.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -92,6 +100,118 @@ TEST_F(ImTransformsTest, TestApplyResize) {
   CHECK_EQ(out_img.cols, 30);
   CHECK_EQ(out_img.rows, 30);
 }
+
+// The distortions of ApplyDistort applied one at a time.
+static cv::Mat ApplyDistortSteps(const cv::Mat& in_img,
+                                 const DistortionParameter& param) {
+  cv::Mat out_img = in_img.clone();
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool contrast_first = prob > 0.5;
+  RandomBrightness(out_img, &out_img, param.brightness_prob(),
+                   param.brightness_delta());
+  if (contrast_first) {
+    RandomContrast(out_img, &out_img, param.contrast_prob(),
+                   param.contrast_lower(), param.contrast_upper());
+  }
+  RandomSaturation(out_img, &out_img, param.saturation_prob(),
+                   param.saturation_lower(), param.saturation_upper());
+  RandomHue(out_img, &out_img, param.hue_prob(), param.hue_delta());
+  if (!contrast_first) {
+    RandomContrast(out_img, &out_img, param.contrast_prob(),
+                   param.contrast_lower(), param.contrast_upper());
+  }
+  RandomOrderChannels(out_img, &out_img, param.random_order_prob());
+  return out_img;
+}
+
+static cv::Mat RandomImage(const int height, const int width) {
+  cv::Mat img(height, width, CV_8UC3);
+  cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(256));
+  return img;
+}
+
+static DistortionParameter FullDistortion() {
+  DistortionParameter param;
+  param.set_brightness_prob(1);
+  param.set_brightness_delta(32);
+  param.set_contrast_prob(1);
+  param.set_contrast_lower(0.5);
+  param.set_contrast_upper(1.5);
+  param.set_saturation_prob(1);
+  param.set_saturation_lower(0.5);
+  param.set_saturation_upper(1.5);
+  param.set_hue_prob(1);
+  param.set_hue_delta(18);
+  param.set_random_order_prob(1);
+  return param;
+}
+
+TEST_F(ImTransformsTest, TestApplyDistortBrightnessContrast) {
+  // Without saturation and hue, the distortions are the same as when they
+  // are applied one at a time.
+  DistortionParameter param = FullDistortion();
+  param.set_saturation_prob(0);
+  param.set_hue_prob(0);
+  const cv::Mat in_img = RandomImage(20, 30);
+  const cv::Mat in_copy = in_img.clone();
+  for (int i = 0; i < 10; ++i) {
+    Caffe::set_random_seed(1701 + i);
+    std::srand(1701 + i);
+    cv::Mat out_img = ApplyDistort(in_img, param);
+    Caffe::set_random_seed(1701 + i);
+    std::srand(1701 + i);
+    cv::Mat expected_img = ApplyDistortSteps(in_img, param);
+    ASSERT_EQ(expected_img.size(), out_img.size());
+    ASSERT_EQ(expected_img.type(), out_img.type());
+    EXPECT_EQ(0, cv::norm(expected_img, out_img, cv::NORM_INF));
+    // The input is left untouched.
+    EXPECT_EQ(0, cv::norm(in_copy, in_img, cv::NORM_INF));
+  }
+}
+
+TEST_F(ImTransformsTest, TestApplyDistort) {
+  // Saturation and hue skip a trip through BGR, which only changes the
+  // rounding.
+  DistortionParameter param = FullDistortion();
+  const cv::Mat in_img = RandomImage(20, 30);
+  for (int i = 0; i < 10; ++i) {
+    Caffe::set_random_seed(1701 + i);
+    std::srand(1701 + i);
+    cv::Mat out_img = ApplyDistort(in_img, param);
+    Caffe::set_random_seed(1701 + i);
+    std::srand(1701 + i);
+    cv::Mat expected_img = ApplyDistortSteps(in_img, param);
+    ASSERT_EQ(expected_img.size(), out_img.size());
+    ASSERT_EQ(expected_img.type(), out_img.type());
+    const double mean_diff = cv::norm(expected_img, out_img, cv::NORM_L1) /
+        out_img.total() / out_img.channels();
+    EXPECT_LT(mean_diff, 1);
+    cv::Scalar expected_mean = cv::mean(expected_img);
+    cv::Scalar mean = cv::mean(out_img);
+    for (int c = 0; c < 3; ++c) {
+      EXPECT_NEAR(expected_mean[c], mean[c], 0.5);
+    }
+  }
+}
+
+TEST_F(ImTransformsTest, DISABLED_TestApplyDistortBenchmark) {
+  const DistortionParameter param = FullDistortion();
+  const cv::Mat in_img = RandomImage(300, 500);
+  const int iters = 20;
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < iters; ++i) {
+    ApplyDistortSteps(in_img, param);
+  }
+  LOG(INFO) << "Distortions one at a time: "
+            << timer.MicroSeconds() / iters << " us";
+  timer.Start();
+  for (int i = 0; i < iters; ++i) {
+    ApplyDistort(in_img, param);
+  }
+  LOG(INFO) << "ApplyDistort: " << timer.MicroSeconds() / iters << " us";
+}
 #endif  // USE_OPENCV
 
 }  // namespace caffe
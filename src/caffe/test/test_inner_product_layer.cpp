@@ -135,6 +135,63 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestDenseByDefault) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.mutable_inner_product_param()->set_num_output(10);
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // No mask, and the weights are saved as plain dense data.
+  EXPECT_FALSE(layer.blobs()[0]->sparse());
+  BlobProto weights_proto;
+  layer.blobs()[0]->ToProto(&weights_proto);
+  EXPECT_EQ(BlobProto::DENSE, weights_proto.storage());
+  EXPECT_EQ(layer.blobs()[0]->count(),
+            weights_proto.data_size() + weights_proto.double_data_size());
+}
+
+// A SPARSE layer loading CSR-only weights computes as the dense layer, on
+// CPU with the CSR arrays and on GPU with the weights expanded to dense.
+TYPED_TEST(InnerProductLayerTest, TestForwardSparseFromCsr) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("uniform");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  layer_param.mutable_sparsity_param()->set_mode(SparsityParameter::DENSE);
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weights = layer.blobs()[0].get();
+  for (int i = 0; i < weights->count(); i += 3) {
+    weights->mutable_cpu_data()[i] = 0;
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->blob_top_, false, true);
+
+  Blob<Dtype> pruned;
+  pruned.set_sparsity_mode(SparsityParameter::PRUNE);
+  pruned.CopyFrom(*weights, false, true);
+  BlobProto weights_proto;
+  pruned.ToProto(&weights_proto);
+  ASSERT_EQ(BlobProto::CSR, weights_proto.storage());
+  layer_param.mutable_sparsity_param()->set_mode(SparsityParameter::SPARSE);
+  InnerProductLayer<Dtype> sparse_layer(layer_param);
+  sparse_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  sparse_layer.blobs()[0]->FromProto(weights_proto, false);
+  sparse_layer.blobs()[1]->CopyFrom(*layer.blobs()[1]);
+  EXPECT_TRUE(sparse_layer.blobs()[0]->use_csr());
+  sparse_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], this->blob_top_->cpu_data()[i],
+                1e-4);
+  }
+}
+
 /**
  * @brief Init. an IP layer without transpose + random weights,
  * run Forward, save the result.
@@ -1,6 +1,7 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +120,100 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+// Keeps every 7th entry of the first rows x cols bottom values, returning the
+// pruned dense matrix and its CSR form.
+template <typename Dtype>
+void MakeSparseMatrix(const Dtype* x, const int rows, const int cols,
+    vector<Dtype>* dense, vector<Dtype>* csrval, vector<int>* csrrowptr,
+    vector<int>* csrcolind) {
+  dense->assign(rows * cols, Dtype(0));
+  csrrowptr->assign(1, 0);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      if ((r * cols + c) % 7 == 0) {
+        (*dense)[r * cols + c] = x[r * cols + c];
+        csrval->push_back(x[r * cols + c]);
+        csrcolind->push_back(c);
+      }
+    }
+    csrrowptr->push_back(csrval->size());
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestCsrmv) {
+  const int M = 17, N = 23;
+  vector<TypeParam> dense, csrval;
+  vector<int> csrrowptr, csrcolind;
+  MakeSparseMatrix(this->blob_bottom_->cpu_data(), M, N, &dense, &csrval,
+                   &csrrowptr, &csrcolind);
+  const TypeParam* x = this->blob_top_->cpu_data();
+  for (int trans = 0; trans < 2; ++trans) {
+    const CBLAS_TRANSPOSE TransA = trans ? CblasTrans : CblasNoTrans;
+    const int y_size = trans ? N : M;
+    vector<TypeParam> y(y_size, TypeParam(1)), y_ref(y_size, TypeParam(1));
+    caffe_cpu_gemv<TypeParam>(TransA, M, N, TypeParam(2), &dense[0], x,
+                              TypeParam(0.5), &y_ref[0]);
+    caffe_cpu_csrmv<TypeParam>(TransA, M, N, TypeParam(2), &csrval[0],
+                               &csrrowptr[0], &csrcolind[0], csrval.size(),
+                               x, TypeParam(0.5), &y[0]);
+    for (int i = 0; i < y_size; ++i) {
+      EXPECT_NEAR(y_ref[i], y[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestCsrmm) {
+  const int rows = 17, cols = 23, N = 19;
+  vector<TypeParam> dense, csrval;
+  vector<int> csrrowptr, csrcolind;
+  MakeSparseMatrix(this->blob_bottom_->cpu_data(), rows, cols, &dense,
+                   &csrval, &csrrowptr, &csrcolind);
+  const TypeParam* B = this->blob_top_->cpu_data();
+  for (int trans = 0; trans < 2; ++trans) {
+    const CBLAS_TRANSPOSE TransA = trans ? CblasTrans : CblasNoTrans;
+    const int M = trans ? cols : rows;
+    const int K = trans ? rows : cols;
+    vector<TypeParam> C(M * N, TypeParam(0)), C_ref(M * N, TypeParam(0));
+    caffe_cpu_gemm<TypeParam>(TransA, CblasNoTrans, M, N, K, TypeParam(1),
+                              &dense[0], B, TypeParam(0), &C_ref[0]);
+    caffe_cpu_csrmm<TypeParam>(TransA, M, N, K, TypeParam(1), &csrval[0],
+                               &csrrowptr[0], &csrcolind[0], B, TypeParam(0),
+                               &C[0]);
+    for (int i = 0; i < M * N; ++i) {
+      EXPECT_NEAR(C_ref[i], C[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestTranspose) {
+  const int rows = 11 * 17, cols = 19 * 23;
+  const TypeParam* A = this->blob_bottom_->cpu_data();
+  TypeParam* B = this->blob_top_->mutable_cpu_data();
+  caffe_cpu_transpose<TypeParam>(rows, cols, A, B);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      EXPECT_EQ(A[r * cols + c], B[c * rows + r]);
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestBitmaskAxpy) {
+  const int n = this->blob_bottom_->count();
+  // Mix all-kept, all-pruned and partial words.
+  vector<uint32_t> mask((n + 31) / 32);
+  for (int w = 0; w < mask.size(); ++w) {
+    mask[w] = (w % 3 == 0) ? 0xFFFFFFFFu : (w % 3 == 1) ? 0u : 0x5A5A5A5Au;
+  }
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  TypeParam* y = this->blob_top_->mutable_cpu_data();
+  caffe_copy(n, x, y);
+  caffe_cpu_bitmask_axpy<TypeParam>(n, TypeParam(-2), x, &mask[0], y);
+  for (int i = 0; i < n; ++i) {
+    const bool kept = (mask[i / 32] >> (i % 32)) & 1;
+    EXPECT_EQ(kept ? x[i] - 2 * x[i] : TypeParam(0), y[i]);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -197,6 +292,29 @@ TYPED_TEST(GPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(GPUMathFunctionsTest, TestBitmaskAxpy) {
+  const int n = this->blob_bottom_->count();
+  vector<uint32_t> mask((n + 31) / 32);
+  for (int w = 0; w < mask.size(); ++w) {
+    mask[w] = (w % 3 == 0) ? 0xFFFFFFFFu : (w % 3 == 1) ? 0u : 0x5A5A5A5Au;
+  }
+  SyncedMemory mask_mem(mask.size() * sizeof(uint32_t));
+  caffe_copy(mask.size(), &mask[0],
+             static_cast<uint32_t*>(mask_mem.mutable_cpu_data()));
+  caffe_copy(n, this->blob_bottom_->gpu_data(),
+             this->blob_top_->mutable_gpu_data());
+  caffe_gpu_bitmask_axpy<TypeParam>(n, TypeParam(-2),
+      this->blob_bottom_->gpu_data(),
+      static_cast<const uint32_t*>(mask_mem.gpu_data()),
+      this->blob_top_->mutable_gpu_data());
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  const TypeParam* y = this->blob_top_->cpu_data();
+  for (int i = 0; i < n; ++i) {
+    const bool kept = (mask[i / 32] >> (i % 32)) & 1;
+    EXPECT_EQ(kept ? x[i] - 2 * x[i] : TypeParam(0), y[i]);
+  }
+}
+
 #endif
 
 
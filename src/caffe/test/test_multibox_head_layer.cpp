@@ -0,0 +1,137 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/concat_layer.hpp"
+#include "caffe/layers/flatten_layer.hpp"
+#include "caffe/layers/multibox_head_layer.hpp"
+#include "caffe/layers/permute_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class MultiBoxHeadLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+ protected:
+  MultiBoxHeadLayerTest()
+    : blob_bottom_0_(new Blob<Dtype>(2, 8, 5, 4)),
+      blob_bottom_1_(new Blob<Dtype>(2, 12, 3, 3)),
+      blob_bottom_2_(new Blob<Dtype>(2, 8, 1, 1)),
+      blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_0_);
+    filler.Fill(this->blob_bottom_1_);
+    filler.Fill(this->blob_bottom_2_);
+    blob_bottom_vec_.push_back(blob_bottom_0_);
+    blob_bottom_vec_.push_back(blob_bottom_1_);
+    blob_bottom_vec_.push_back(blob_bottom_2_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual ~MultiBoxHeadLayerTest() {
+    delete blob_bottom_0_;
+    delete blob_bottom_1_;
+    delete blob_bottom_2_;
+    delete blob_top_;
+  }
+
+  // Gathers the heads with Permute, Flatten and Concat, as the SSD models
+  // used to.
+  void ReferenceForward(Blob<Dtype>* top) {
+    LayerParameter permute_param;
+    permute_param.mutable_permute_param()->add_order(0);
+    permute_param.mutable_permute_param()->add_order(2);
+    permute_param.mutable_permute_param()->add_order(3);
+    permute_param.mutable_permute_param()->add_order(1);
+    LayerParameter flatten_param;
+    flatten_param.mutable_flatten_param()->set_axis(1);
+    vector<shared_ptr<Layer<Dtype> > > layers;
+    vector<shared_ptr<Blob<Dtype> > > blobs;
+    vector<Blob<Dtype>*> flat_vec;
+    for (int i = 0; i < blob_bottom_vec_.size(); ++i) {
+      vector<Blob<Dtype>*> bottom_vec(1, blob_bottom_vec_[i]);
+      blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      vector<Blob<Dtype>*> permute_vec(1, blobs.back().get());
+      layers.push_back(shared_ptr<Layer<Dtype> >(
+          new PermuteLayer<Dtype>(permute_param)));
+      layers.back()->SetUp(bottom_vec, permute_vec);
+      layers.back()->Forward(bottom_vec, permute_vec);
+      blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      flat_vec.push_back(blobs.back().get());
+      vector<Blob<Dtype>*> flatten_vec(1, blobs.back().get());
+      layers.push_back(shared_ptr<Layer<Dtype> >(
+          new FlattenLayer<Dtype>(flatten_param)));
+      layers.back()->SetUp(permute_vec, flatten_vec);
+      layers.back()->Forward(permute_vec, flatten_vec);
+    }
+    LayerParameter concat_param;
+    ConcatLayer<Dtype> concat_layer(concat_param);
+    vector<Blob<Dtype>*> top_vec(1, top);
+    concat_layer.SetUp(flat_vec, top_vec);
+    concat_layer.Forward(flat_vec, top_vec);
+  }
+
+  Blob<Dtype>* const blob_bottom_0_;
+  Blob<Dtype>* const blob_bottom_1_;
+  Blob<Dtype>* const blob_bottom_2_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MultiBoxHeadLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(MultiBoxHeadLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxHeadLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num_axes(), 2);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 8 * 5 * 4 + 12 * 3 * 3 + 8);
+}
+
+TYPED_TEST(MultiBoxHeadLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxHeadLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected_top;
+  this->ReferenceForward(&expected_top);
+  ASSERT_EQ(expected_top.count(), this->blob_top_->count());
+  for (int i = 0; i < expected_top.count(); ++i) {
+    EXPECT_EQ(expected_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+  // Reshaping a head moves the slices of the following ones.
+  this->blob_bottom_1_->Reshape(2, 12, 2, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_1_);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->ReferenceForward(&expected_top);
+  ASSERT_EQ(expected_top.count(), this->blob_top_->count());
+  for (int i = 0; i < expected_top.count(); ++i) {
+    EXPECT_EQ(expected_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(MultiBoxHeadLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxHeadLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
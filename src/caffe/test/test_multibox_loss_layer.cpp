@@ -405,6 +405,37 @@ TYPED_TEST(MultiBoxLossLayerTest, TestLocGradient) {
   }
 }
 
+TYPED_TEST(MultiBoxLossLayerTest, TestForwardMinesEachBatch) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxLossParameter* multibox_loss_param =
+      layer_param.mutable_multibox_loss_param();
+  multibox_loss_param->set_num_classes(this->num_classes_);
+  multibox_loss_param->set_mining_type(
+      MultiBoxLossParameter_MiningType_MAX_NEGATIVE);
+  multibox_loss_param->set_neg_pos_ratio(1);
+  FillerParameter filler_param;
+  filler_param.set_std(2);
+  GaussianFiller<Dtype> filler(filler_param);
+  // The fused softmax loss, then the separate logistic loss layer.
+  for (int c = 0; c < 2; ++c) {
+    multibox_loss_param->set_conf_loss_type(kConfLossTypes[c]);
+    this->Fill(true);
+    MultiBoxLossLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Without Backward, as in the TEST phase, the next batch is scored with
+    // its own negatives.
+    filler.Fill(this->blob_bottom_conf_);
+    const Dtype loss = layer.Forward(this->blob_bottom_vec_,
+                                     this->blob_top_vec_);
+    MultiBoxLossLayer<Dtype> fresh_layer(layer_param);
+    fresh_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_NEAR(loss, fresh_layer.Forward(this->blob_bottom_vec_,
+                                          this->blob_top_vec_), 1e-5);
+  }
+}
+
 TYPED_TEST(MultiBoxLossLayerTest, TestConfGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -414,6 +445,9 @@ TYPED_TEST(MultiBoxLossLayerTest, TestConfGradient) {
   MultiBoxLossParameter* multibox_loss_param =
       layer_param.mutable_multibox_loss_param();
   multibox_loss_param->set_num_classes(this->num_classes_);
+  // Mine all the eligible negatives, as the negatives are mined again on each
+  // forward and the steps of the checker must not change them.
+  multibox_loss_param->set_neg_pos_ratio(this->num_priors_);
   for (int c = 0; c < 2; ++c) {
     MultiBoxLossParameter_ConfLossType conf_loss_type = kConfLossTypes[c];
     for (int i = 0; i < 2; ++i) {
@@ -554,4 +554,81 @@ TYPED_TEST(PriorBoxLayerTest, TestCPUFixStep) {
   }
 }
 
+TYPED_TEST(PriorBoxLayerTest, TestCPUSharedPriors) {
+  LayerParameter layer_param;
+  PriorBoxParameter* prior_box_param = layer_param.mutable_prior_box_param();
+  prior_box_param->add_min_size(this->min_size_);
+  prior_box_param->add_max_size(this->max_size_);
+  prior_box_param->add_aspect_ratio(2.);
+  PriorBoxLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Another layer with the same parameters and shapes, e.g. of the test net,
+  // shares the priors.
+  Blob<TypeParam> other_top;
+  vector<Blob<TypeParam>*> other_top_vec(1, &other_top);
+  PriorBoxLayer<TypeParam> other_layer(layer_param);
+  other_layer.SetUp(this->blob_bottom_vec_, other_top_vec);
+  other_layer.Forward(this->blob_bottom_vec_, other_top_vec);
+  EXPECT_EQ(&layer.priors(), &other_layer.priors());
+  ASSERT_EQ(this->blob_top_->count(), other_top.count());
+  for (int i = 0; i < other_top.count(); ++i) {
+    EXPECT_EQ(this->blob_top_->cpu_data()[i], other_top.cpu_data()[i]);
+  }
+  // The priors follow the shapes when the other layer is reshaped.
+  this->blob_bottom_->Reshape(10, 10, 20, 5);
+  other_layer.Reshape(this->blob_bottom_vec_, other_top_vec);
+  other_layer.Forward(this->blob_bottom_vec_, other_top_vec);
+  // Setting the default offset makes the priors generated anew.
+  Blob<TypeParam> expected_top;
+  vector<Blob<TypeParam>*> expected_top_vec(1, &expected_top);
+  prior_box_param->set_offset(0.5);
+  PriorBoxLayer<TypeParam> expected_layer(layer_param);
+  expected_layer.SetUp(this->blob_bottom_vec_, expected_top_vec);
+  expected_layer.Forward(this->blob_bottom_vec_, expected_top_vec);
+  EXPECT_NE(&other_layer.priors(), &expected_layer.priors());
+  ASSERT_EQ(expected_top.count(), other_top.count());
+  EXPECT_EQ(other_top.height(), 20 * 5 * 4 * 4);
+  for (int i = 0; i < other_top.count(); ++i) {
+    EXPECT_EQ(expected_top.cpu_data()[i], other_top.cpu_data()[i]);
+  }
+  // While the first layer keeps its priors.
+  EXPECT_NE(&layer.priors(), &other_layer.priors());
+  this->blob_bottom_->Reshape(10, 10, 10, 10);
+  const vector<TypeParam>* priors = &layer.priors();
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(priors, &layer.priors());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], i < 2 ? 0.03 : 0.07, 1e-6);
+  }
+}
+
+TYPED_TEST(PriorBoxLayerTest, TestCPUCopyPriorsOnce) {
+  LayerParameter layer_param;
+  PriorBoxParameter* prior_box_param = layer_param.mutable_prior_box_param();
+  prior_box_param->add_min_size(this->min_size_);
+  PriorBoxLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam prior = this->blob_top_->cpu_data()[0];
+  // The top still holds the priors, so they are not copied again. This
+  // marker shows whether they were.
+  this->blob_top_->mutable_cpu_data()[0] = -1;
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(-1, this->blob_top_->cpu_data()[0]);
+  // Another top gets them.
+  Blob<TypeParam> other_top;
+  vector<Blob<TypeParam>*> other_top_vec(1, &other_top);
+  layer.Reshape(this->blob_bottom_vec_, other_top_vec);
+  layer.Forward(this->blob_bottom_vec_, other_top_vec);
+  EXPECT_EQ(prior, other_top.cpu_data()[0]);
+  // And so does the first top when the priors change.
+  this->blob_bottom_->Reshape(10, 10, 5, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam expected_top_data[] = {0.08, 0.08, 0.12, 0.12};
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], expected_top_data[i], 1e-6);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,145 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/pruning.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static const float eps = 1e-6;
+
+class PruningScheduleTest : public ::testing::Test {
+ protected:
+  PruningScheduleTest() {
+    param_.set_target_sparsity(0.8);
+    param_.set_initial_sparsity(0.2);
+    param_.set_start_iter(100);
+    param_.set_end_iter(1100);
+    param_.set_frequency(300);
+    param_.set_power(3);
+  }
+
+  PruningParameter param_;
+};
+
+TEST_F(PruningScheduleTest, TestIsPruningIter) {
+  EXPECT_FALSE(IsPruningIter(param_, 0));
+  EXPECT_TRUE(IsPruningIter(param_, 100));
+  EXPECT_FALSE(IsPruningIter(param_, 101));
+  EXPECT_TRUE(IsPruningIter(param_, 400));
+  EXPECT_TRUE(IsPruningIter(param_, 1000));
+  // end_iter is always a pruning iteration.
+  EXPECT_TRUE(IsPruningIter(param_, 1100));
+  EXPECT_FALSE(IsPruningIter(param_, 1300));
+}
+
+TEST_F(PruningScheduleTest, TestPruningSparsity) {
+  EXPECT_NEAR(0.2, PruningSparsity(param_, 0), eps);
+  EXPECT_NEAR(0.2, PruningSparsity(param_, 100), eps);
+  const float expected = 0.8 - 0.6 * std::pow(0.7f, 3.f);
+  EXPECT_NEAR(expected, PruningSparsity(param_, 400), eps);
+  // Held until the next pruning iteration.
+  EXPECT_NEAR(expected, PruningSparsity(param_, 699), eps);
+  EXPECT_NEAR(0.8, PruningSparsity(param_, 1100), eps);
+  EXPECT_NEAR(0.8, PruningSparsity(param_, 5000), eps);
+}
+
+template <typename Dtype>
+class PruneBlobTest : public ::testing::Test {
+ protected:
+  PruneBlobTest() : blob_(4, 3, 2, 5) {
+    blob_.set_sparsity_mode(SparsityParameter::PRUNE);
+    // Distinct magnitudes with alternating signs.
+    Dtype* data = blob_.mutable_cpu_data();
+    for (int i = 0; i < blob_.count(); ++i) {
+      data[i] = (i % 2 ? -1 : 1) * Dtype((i * 37) % blob_.count() + 1);
+    }
+  }
+
+  bool kept(const int i) {
+    return (blob_.cpu_mask()[i / 32] >> (i % 32)) & 1;
+  }
+
+  Blob<Dtype> blob_;
+};
+
+TYPED_TEST_CASE(PruneBlobTest, TestDtypes);
+
+TYPED_TEST(PruneBlobTest, TestMagnitude) {
+  const int count = this->blob_.count();
+  vector<TypeParam> before(this->blob_.cpu_data(),
+                           this->blob_.cpu_data() + count);
+  const int kept = PruneBlob(PruningParameter_Criterion_MAGNITUDE, 0.25f,
+                             &this->blob_);
+  EXPECT_EQ(count - count / 4, kept);
+  for (int i = 0; i < count; ++i) {
+    // Magnitudes are 1..count, so the smallest quarter is pruned.
+    const bool expect_kept = std::fabs(before[i]) > count / 4;
+    EXPECT_EQ(expect_kept, this->kept(i));
+    EXPECT_EQ(expect_kept ? before[i] : TypeParam(0),
+              this->blob_.cpu_data()[i]);
+  }
+  // Raising the sparsity keeps the earlier pruned weights pruned.
+  EXPECT_EQ(count / 2, PruneBlob(PruningParameter_Criterion_MAGNITUDE, 0.5f,
+                                 &this->blob_));
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(std::fabs(before[i]) > count / 2, this->kept(i));
+  }
+}
+
+TYPED_TEST(PruneBlobTest, TestMagnitudeTies) {
+  caffe_set(this->blob_.count(), TypeParam(1), this->blob_.mutable_cpu_data());
+  EXPECT_EQ(this->blob_.count() - 30,
+            PruneBlob(PruningParameter_Criterion_MAGNITUDE, 0.25f,
+                      &this->blob_));
+  // Ties are pruned in index order.
+  for (int i = 0; i < this->blob_.count(); ++i) {
+    EXPECT_EQ(i >= 30, this->kept(i));
+  }
+}
+
+TYPED_TEST(PruneBlobTest, TestChannelL1) {
+  const int cols = this->blob_.count(1);
+  TypeParam* data = this->blob_.mutable_cpu_data();
+  // Row 2 has the smallest L1 norm, then row 0.
+  caffe_scal(cols, TypeParam(0.01), data + 2 * cols);
+  caffe_scal(cols, TypeParam(0.1), data);
+  EXPECT_EQ(2 * cols, PruneBlob(PruningParameter_Criterion_CHANNEL_L1, 0.5f,
+                                &this->blob_));
+  for (int i = 0; i < this->blob_.count(); ++i) {
+    const int row = i / cols;
+    const bool expect_kept = row == 1 || row == 3;
+    EXPECT_EQ(expect_kept, this->kept(i));
+    if (!expect_kept) {
+      EXPECT_EQ(0, this->blob_.cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(PruneBlobTest, TestInputChannelL1) {
+  // 4 rows x 3 input channels x 10 spatial weights.
+  const int channels = this->blob_.shape(1);
+  const int inner = this->blob_.count(2);
+  TypeParam* data = this->blob_.mutable_cpu_data();
+  for (int r = 0; r < this->blob_.shape(0); ++r) {
+    caffe_scal(inner, TypeParam(0.01), data + (r * channels + 1) * inner);
+  }
+  EXPECT_EQ(this->blob_.count() * 2 / 3,
+            PruneBlob(PruningParameter_Criterion_INPUT_CHANNEL_L1, 0.3f,
+                      &this->blob_));
+  for (int i = 0; i < this->blob_.count(); ++i) {
+    const int channel = (i / inner) % channels;
+    EXPECT_EQ(channel != 1, this->kept(i));
+    if (channel == 1) {
+      EXPECT_EQ(0, this->blob_.cpu_data()[i]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,199 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sampler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SamplerTest : public ::testing::Test {
+ protected:
+  SamplerTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Random object bboxes of at least 0.05 x 0.05.
+  void FillObjectBBoxes(int num, vector<NormalizedBBox>* bboxes) {
+    bboxes->clear();
+    for (int i = 0; i < num; ++i) {
+      float corner[2], size[2];
+      caffe_rng_uniform(2, 0.f, 0.9f, corner);
+      caffe_rng_uniform(1, 0.05f, 1 - corner[0], &size[0]);
+      caffe_rng_uniform(1, 0.05f, 1 - corner[1], &size[1]);
+      NormalizedBBox bbox;
+      bbox.set_xmin(corner[0]);
+      bbox.set_ymin(corner[1]);
+      bbox.set_xmax(corner[0] + size[0]);
+      bbox.set_ymax(corner[1] + size[1]);
+      bboxes->push_back(bbox);
+    }
+  }
+
+  // The batch samplers of the SSD training models.
+  void FillBatchSamplers(vector<BatchSampler>* batch_samplers) {
+    batch_samplers->clear();
+    batch_samplers->push_back(BatchSampler());
+    batch_samplers->back().set_max_sample(1);
+    batch_samplers->back().set_max_trials(1);
+    const float min_jaccard_overlaps[] = {0.1, 0.3, 0.5, 0.7, 0.9};
+    for (int i = 0; i < 6; ++i) {
+      BatchSampler batch_sampler;
+      Sampler* sampler = batch_sampler.mutable_sampler();
+      sampler->set_min_scale(0.3);
+      sampler->set_min_aspect_ratio(0.5);
+      sampler->set_max_aspect_ratio(2);
+      if (i < 5) {
+        batch_sampler.mutable_sample_constraint()->set_min_jaccard_overlap(
+            min_jaccard_overlaps[i]);
+      } else {
+        batch_sampler.mutable_sample_constraint()->set_max_jaccard_overlap(
+            1);
+      }
+      batch_sampler.set_max_sample(1);
+      batch_sampler.set_max_trials(50);
+      batch_samplers->push_back(batch_sampler);
+    }
+  }
+
+  // GenerateBatchSamples with one NormalizedBBox per trial, as it used to be.
+  void GenerateBatchSamplesReference(
+      const vector<NormalizedBBox>& object_bboxes,
+      const vector<BatchSampler>& batch_samplers,
+      vector<NormalizedBBox>* sampled_bboxes) {
+    sampled_bboxes->clear();
+    NormalizedBBox unit_bbox;
+    unit_bbox.set_xmin(0);
+    unit_bbox.set_ymin(0);
+    unit_bbox.set_xmax(1);
+    unit_bbox.set_ymax(1);
+    for (int i = 0; i < batch_samplers.size(); ++i) {
+      const BatchSampler& batch_sampler = batch_samplers[i];
+      int found = 0;
+      for (int j = 0; j < batch_sampler.max_trials(); ++j) {
+        if (batch_sampler.has_max_sample() &&
+            found >= batch_sampler.max_sample()) {
+          break;
+        }
+        NormalizedBBox sampled_bbox;
+        SampleBBox(batch_sampler.sampler(), &sampled_bbox);
+        LocateBBox(unit_bbox, sampled_bbox, &sampled_bbox);
+        if (SatisfySampleConstraint(sampled_bbox, object_bboxes,
+                                    batch_sampler.sample_constraint())) {
+          ++found;
+          sampled_bboxes->push_back(sampled_bbox);
+        }
+      }
+    }
+  }
+
+  AnnotatedDatum AnnotatedDatumOf(const vector<NormalizedBBox>& bboxes) {
+    AnnotatedDatum anno_datum;
+    AnnotationGroup* anno_group = anno_datum.add_annotation_group();
+    anno_group->set_group_label(1);
+    for (int i = 0; i < bboxes.size(); ++i) {
+      Annotation* anno = anno_group->add_annotation();
+      anno->set_instance_id(i);
+      anno->mutable_bbox()->CopyFrom(bboxes[i]);
+    }
+    return anno_datum;
+  }
+};
+
+TEST_F(SamplerTest, TestSampleConstraintChecker) {
+  vector<NormalizedBBox> object_bboxes;
+  FillObjectBBoxes(10, &object_bboxes);
+  SampleConstraintChecker checker(object_bboxes);
+  vector<SampleConstraint> constraints(5);
+  constraints[1].set_min_jaccard_overlap(0.3);
+  constraints[2].set_max_jaccard_overlap(0.1);
+  constraints[2].set_min_sample_coverage(0.2);
+  constraints[3].set_min_object_coverage(0.5);
+  constraints[3].set_max_sample_coverage(0.9);
+  constraints[4].set_min_jaccard_overlap(0.1);
+  constraints[4].set_max_object_coverage(0.8);
+  Sampler sampler;
+  sampler.set_min_scale(0.1);
+  int num_satisfied = 0;
+  for (int i = 0; i < 200; ++i) {
+    NormalizedBBox sampled_bbox;
+    SampleBBox(sampler, &sampled_bbox);
+    const float bbox[4] = {sampled_bbox.xmin(), sampled_bbox.ymin(),
+                           sampled_bbox.xmax(), sampled_bbox.ymax()};
+    for (int c = 0; c < constraints.size(); ++c) {
+      const bool satisfied = SatisfySampleConstraint(sampled_bbox,
+          object_bboxes, constraints[c]);
+      EXPECT_EQ(satisfied, checker.Satisfy(bbox, constraints[c]));
+      num_satisfied += satisfied;
+    }
+  }
+  // Not all the checks are trivial.
+  EXPECT_GT(num_satisfied, 200);
+  EXPECT_LT(num_satisfied, 1000);
+}
+
+TEST_F(SamplerTest, TestSampleConstraintCheckerNoObject) {
+  vector<NormalizedBBox> object_bboxes;
+  SampleConstraintChecker checker(object_bboxes);
+  const float bbox[4] = {0.1, 0.2, 0.6, 0.8};
+  SampleConstraint constraint;
+  EXPECT_TRUE(checker.Satisfy(bbox, constraint));
+  constraint.set_min_jaccard_overlap(0.1);
+  EXPECT_FALSE(checker.Satisfy(bbox, constraint));
+}
+
+TEST_F(SamplerTest, TestGenerateBatchSamples) {
+  vector<BatchSampler> batch_samplers;
+  FillBatchSamplers(&batch_samplers);
+  for (int num_objects = 0; num_objects < 20; num_objects += 3) {
+    vector<NormalizedBBox> object_bboxes;
+    FillObjectBBoxes(num_objects, &object_bboxes);
+    const AnnotatedDatum anno_datum = AnnotatedDatumOf(object_bboxes);
+    for (int i = 0; i < batch_samplers.size(); ++i) {
+      batch_samplers[i].set_max_sample(1 + num_objects % 2);
+    }
+    Caffe::set_random_seed(1000 + num_objects);
+    vector<NormalizedBBox> expected_bboxes;
+    GenerateBatchSamplesReference(object_bboxes, batch_samplers,
+                                  &expected_bboxes);
+    Caffe::set_random_seed(1000 + num_objects);
+    vector<NormalizedBBox> sampled_bboxes;
+    GenerateBatchSamples(anno_datum, batch_samplers, &sampled_bboxes);
+    ASSERT_EQ(expected_bboxes.size(), sampled_bboxes.size());
+    for (int i = 0; i < sampled_bboxes.size(); ++i) {
+      EXPECT_EQ(expected_bboxes[i].DebugString(),
+                sampled_bboxes[i].DebugString());
+    }
+  }
+}
+
+TEST_F(SamplerTest, DISABLED_TestGenerateBatchSamplesBenchmark) {
+  vector<BatchSampler> batch_samplers;
+  FillBatchSamplers(&batch_samplers);
+  vector<NormalizedBBox> object_bboxes;
+  FillObjectBBoxes(50, &object_bboxes);
+  const AnnotatedDatum anno_datum = AnnotatedDatumOf(object_bboxes);
+  vector<NormalizedBBox> sampled_bboxes;
+  const int iters = 100;
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < iters; ++i) {
+    GenerateBatchSamplesReference(object_bboxes, batch_samplers,
+                                  &sampled_bboxes);
+  }
+  LOG(INFO) << "NormalizedBBox sampling: " << timer.MicroSeconds() / iters
+            << " us";
+  timer.Start();
+  for (int i = 0; i < iters; ++i) {
+    GenerateBatchSamples(anno_datum, batch_samplers, &sampled_bboxes);
+  }
+  LOG(INFO) << "GenerateBatchSamples: " << timer.MicroSeconds() / iters
+            << " us";
+}
+
+}  // namespace caffe
@@ -0,0 +1,330 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/shrink_net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ShrinkNetTest : public ::testing::Test {
+ protected:
+  ShrinkNetTest() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    const string proto =
+        "name: 'ShrinkNetTest' "
+        "layer { "
+        "  name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 9 dim: 9 } } "
+        "} "
+        "layer { "
+        "  name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 6 kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn1' type: 'BatchNorm' bottom: 'conv1' top: 'conv1' "
+        "  batch_norm_param { use_global_stats: true } "
+        "} "
+        "layer { "
+        "  name: 'scale1' type: 'Scale' bottom: 'conv1' top: 'conv1' "
+        "  scale_param { "
+        "    bias_term: true "
+        "    filler { type: 'gaussian' std: 1 } "
+        "    bias_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' "
+        "  relu_param { negative_slope: 0.1 } "
+        "} "
+        "layer { "
+        "  name: 'conv2' type: 'Convolution' bottom: 'conv1' top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' type: 'InnerProduct' bottom: 'conv2' top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+  }
+
+  // Set the channel slice [c] of axis 1 of a blob to zero.
+  void ZeroInputChannel(const int c, Blob<float>* blob) {
+    const int channels = blob->shape(1);
+    const int inner = blob->count(2);
+    for (int o = 0; o < blob->shape(0); ++o) {
+      caffe_set(inner, 0.f,
+                blob->mutable_cpu_data() + (o * channels + c) * inner);
+    }
+  }
+
+  NetParameter param_;
+};
+
+TEST_F(ShrinkNetTest, TestShrinkMatchesOriginal) {
+  Net<float> net(param_);
+  // Give the BatchNorm layer non-trivial statistics.
+  const vector<shared_ptr<Blob<float> > >& bn =
+      net.layer_by_name("bn1")->blobs();
+  FillerParameter filler_param;
+  filler_param.set_std(0.5);
+  GaussianFiller<float> mean_filler(filler_param);
+  mean_filler.Fill(bn[0].get());
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<float> var_filler(filler_param);
+  var_filler.Fill(bn[1].get());
+  bn[2]->mutable_cpu_data()[0] = 1;
+
+  // Filters 1 and 4 of conv1 and filter 2 of conv2 are pruned; their biases
+  // are not, so their outputs are non-zero constants. No layer reads channel
+  // 0 of conv2.
+  Blob<float>* conv1 = net.layer_by_name("conv1")->blobs()[0].get();
+  const int dim1 = conv1->count(1);
+  caffe_set(dim1, 0.f, conv1->mutable_cpu_data() + 1 * dim1);
+  caffe_set(dim1, 0.f, conv1->mutable_cpu_data() + 4 * dim1);
+  Blob<float>* conv2 = net.layer_by_name("conv2")->blobs()[0].get();
+  const int dim2 = conv2->count(1);
+  caffe_set(dim2, 0.f, conv2->mutable_cpu_data() + 2 * dim2);
+  Blob<float> ip_weights;
+  ip_weights.CopyFrom(*net.layer_by_name("ip")->blobs()[0], false, true);
+  ip_weights.Reshape(5, 4, 5, 5);
+  ZeroInputChannel(0, &ip_weights);
+  caffe_copy(ip_weights.count(), ip_weights.cpu_data(),
+             net.layer_by_name("ip")->blobs()[0]->mutable_cpu_data());
+
+  Blob<float>* data = net.input_blobs()[0];
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<float> data_filler(filler_param);
+  data_filler.Fill(data);
+  net.Forward();
+  Blob<float> expected;
+  expected.CopyFrom(*net.blob_by_name("ip"), false, true);
+
+  NetParameter weights;
+  net.ToProto(&weights);
+  NetParameter shrunk_param;
+  NetParameter shrunk_weights;
+  EXPECT_EQ(4, ShrinkNet(param_, weights, &shrunk_param, &shrunk_weights));
+  EXPECT_EQ(4, shrunk_param.layer(1).convolution_param().num_output());
+  EXPECT_EQ(2, shrunk_param.layer(5).convolution_param().num_output());
+  EXPECT_EQ(5, shrunk_param.layer(6).inner_product_param().num_output());
+
+  Net<float> shrunk(shrunk_param);
+  shrunk.CopyTrainedLayersFrom(shrunk_weights);
+  EXPECT_EQ(2 * 25, shrunk.layer_by_name("ip")->blobs()[0]->shape(1));
+  shrunk.input_blobs()[0]->CopyFrom(*data);
+  shrunk.Forward();
+  const Blob<float>* result = shrunk.blob_by_name("ip").get();
+  ASSERT_EQ(expected.count(), result->count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], result->cpu_data()[i], 1e-4);
+  }
+}
+
+TEST_F(ShrinkNetTest, TestOutputsAreKept) {
+  // The channels of a net output are visible and must not be removed.
+  Net<float> net(param_);
+  Blob<float>* ip = net.layer_by_name("ip")->blobs()[0].get();
+  caffe_set(ip->count(1), 0.f, ip->mutable_cpu_data());
+  NetParameter weights;
+  net.ToProto(&weights);
+  NetParameter shrunk_param;
+  NetParameter shrunk_weights;
+  EXPECT_EQ(0, ShrinkNet(param_, weights, &shrunk_param, &shrunk_weights));
+  EXPECT_EQ(5, shrunk_param.layer(6).inner_product_param().num_output());
+}
+
+TEST_F(ShrinkNetTest, TestShrinkMultiBoxHeads) {
+  // An SSD source layer feeding PriorBox and padded loc/conf heads.
+  const string proto =
+      "name: 'ShrinkNetHeads' "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 9 dim: 9 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 6 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv1_mbox_loc' type: 'Convolution' bottom: 'conv1' "
+      "  top: 'conv1_mbox_loc' "
+      "  convolution_param { "
+      "    num_output: 8 kernel_size: 3 pad: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1_mbox_conf' type: 'Convolution' bottom: 'conv1' "
+      "  top: 'conv1_mbox_conf' "
+      "  convolution_param { "
+      "    num_output: 6 kernel_size: 3 pad: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1_mbox_priorbox' type: 'PriorBox' bottom: 'conv1' "
+      "  bottom: 'data' top: 'conv1_mbox_priorbox' "
+      "  prior_box_param { min_size: 4 max_size: 8 aspect_ratio: 2 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<float> net(param);
+  // Filter 2 of conv1 is pruned with a negative bias, so its output is zero
+  // after ReLU. Filter 5 is pruned with a positive bias, which the padded
+  // heads would see differently on the borders, but they both ignore it.
+  Blob<float>* conv1 = net.layer_by_name("conv1")->blobs()[0].get();
+  const int dim = conv1->count(1);
+  caffe_set(dim, 0.f, conv1->mutable_cpu_data() + 2 * dim);
+  caffe_set(dim, 0.f, conv1->mutable_cpu_data() + 5 * dim);
+  Blob<float>* bias = net.layer_by_name("conv1")->blobs()[1].get();
+  bias->mutable_cpu_data()[2] = -1;
+  bias->mutable_cpu_data()[5] = 1;
+  ZeroInputChannel(5,
+      net.layer_by_name("conv1_mbox_loc")->blobs()[0].get());
+  ZeroInputChannel(5,
+      net.layer_by_name("conv1_mbox_conf")->blobs()[0].get());
+
+  Blob<float>* data = net.input_blobs()[0];
+  FillerParameter filler_param;
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<float> data_filler(filler_param);
+  data_filler.Fill(data);
+  net.Forward();
+  const string outputs[] = {"conv1_mbox_loc", "conv1_mbox_conf",
+                            "conv1_mbox_priorbox"};
+  vector<shared_ptr<Blob<float> > > expected;
+  for (int i = 0; i < 3; ++i) {
+    expected.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+    expected.back()->CopyFrom(*net.blob_by_name(outputs[i]), false, true);
+  }
+
+  NetParameter weights;
+  net.ToProto(&weights);
+  NetParameter shrunk_param;
+  NetParameter shrunk_weights;
+  EXPECT_EQ(2, ShrinkNet(param, weights, &shrunk_param, &shrunk_weights));
+  EXPECT_EQ(4, shrunk_param.layer(1).convolution_param().num_output());
+
+  Net<float> shrunk(shrunk_param);
+  shrunk.CopyTrainedLayersFrom(shrunk_weights);
+  EXPECT_EQ(4, shrunk.layer_by_name("conv1_mbox_loc")->blobs()[0]->shape(1));
+  EXPECT_EQ(4,
+      shrunk.layer_by_name("conv1_mbox_conf")->blobs()[0]->shape(1));
+  shrunk.input_blobs()[0]->CopyFrom(*data);
+  shrunk.Forward();
+  for (int i = 0; i < 3; ++i) {
+    const Blob<float>* result = shrunk.blob_by_name(outputs[i]).get();
+    ASSERT_EQ(expected[i]->count(), result->count());
+    for (int j = 0; j < result->count(); ++j) {
+      EXPECT_NEAR(expected[i]->cpu_data()[j], result->cpu_data()[j], 1e-4);
+    }
+  }
+}
+
+TEST_F(ShrinkNetTest, TestPaddedAvePoolingKeepsConstantChannels) {
+  const string proto =
+      "name: 'ShrinkNetPool' "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 9 dim: 9 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 6 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'pool1' type: 'Pooling' bottom: 'conv1' top: 'pool1' "
+      "  pooling_param { pool: AVE kernel_size: 3 stride: 1 pad: 1 } "
+      "} "
+      "layer { "
+      "  name: 'conv2' type: 'Convolution' bottom: 'pool1' top: 'conv2' "
+      "  convolution_param { "
+      "    num_output: 4 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<float> net(param);
+  // Filter 2 of conv1 is pruned with a negative bias, so its output is zero
+  // after ReLU. Filter 5 is pruned with a positive bias, whose constant output
+  // is averaged with the padding zeros on the borders, so it must stay.
+  Blob<float>* conv1 = net.layer_by_name("conv1")->blobs()[0].get();
+  const int dim = conv1->count(1);
+  caffe_set(dim, 0.f, conv1->mutable_cpu_data() + 2 * dim);
+  caffe_set(dim, 0.f, conv1->mutable_cpu_data() + 5 * dim);
+  Blob<float>* bias = net.layer_by_name("conv1")->blobs()[1].get();
+  bias->mutable_cpu_data()[2] = -1;
+  bias->mutable_cpu_data()[5] = 1;
+
+  Blob<float>* data = net.input_blobs()[0];
+  FillerParameter filler_param;
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<float> data_filler(filler_param);
+  data_filler.Fill(data);
+  net.Forward();
+  Blob<float> expected;
+  expected.CopyFrom(*net.blob_by_name("conv2"), false, true);
+
+  NetParameter weights;
+  net.ToProto(&weights);
+  NetParameter shrunk_param;
+  NetParameter shrunk_weights;
+  EXPECT_EQ(1, ShrinkNet(param, weights, &shrunk_param, &shrunk_weights));
+  EXPECT_EQ(5, shrunk_param.layer(1).convolution_param().num_output());
+
+  Net<float> shrunk(shrunk_param);
+  shrunk.CopyTrainedLayersFrom(shrunk_weights);
+  shrunk.input_blobs()[0]->CopyFrom(*data);
+  shrunk.Forward();
+  const Blob<float>* result = shrunk.blob_by_name("conv2").get();
+  ASSERT_EQ(expected.count(), result->count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], result->cpu_data()[i], 1e-4);
+  }
+}
+
+}  // namespace caffe
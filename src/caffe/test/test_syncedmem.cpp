@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -67,6 +69,64 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+// Counts the allocations made through a PageAllocator.
+class CountingAllocator : public PageAllocator {
+ public:
+  CountingAllocator() : PageAllocator(false, -1), allocated_(0) {}
+  virtual void* Allocate(size_t size) {
+    allocated_ += size;
+    return PageAllocator::Allocate(size);
+  }
+  virtual void Free(void* ptr, size_t size) {
+    allocated_ -= size;
+    PageAllocator::Free(ptr, size);
+  }
+  size_t allocated_;
+};
+
+TEST_F(SyncedMemoryTest, TestHostAllocator) {
+  shared_ptr<CountingAllocator> allocator(new CountingAllocator());
+  {
+    SyncedMemory mem(10);
+    mem.set_host_allocator(allocator);
+    EXPECT_EQ(allocator->allocated_, 0);
+    void* cpu_data = mem.mutable_cpu_data();
+    EXPECT_EQ(allocator->allocated_, 10);
+    for (int i = 0; i < mem.size(); ++i) {
+      EXPECT_EQ((static_cast<char*>(cpu_data))[i], 0);
+    }
+    // Data set from outside are not freed by the allocator.
+    char data[10];
+    mem.set_cpu_data(data);
+    EXPECT_EQ(allocator->allocated_, 0);
+    EXPECT_EQ(mem.cpu_data(), data);
+  }
+  EXPECT_EQ(allocator->allocated_, 0);
+  {
+    SyncedMemory mem(20);
+    mem.set_host_allocator(allocator);
+    mem.cpu_data();
+    EXPECT_EQ(allocator->allocated_, 20);
+  }
+  EXPECT_EQ(allocator->allocated_, 0);
+}
+
+TEST_F(SyncedMemoryTest, TestPageAllocator) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  // Huge pages and NUMA binding fall back to plain pages where unavailable.
+  for (int i = 0; i < 4; ++i) {
+    PageAllocator allocator(i % 2, i < 2 ? -1 : 0);
+    const size_t sizes[] = {1, page_size, 3 * page_size + 5};
+    for (int j = 0; j < 3; ++j) {
+      void* ptr = allocator.Allocate(sizes[j]);
+      EXPECT_EQ(reinterpret_cast<size_t>(ptr) % page_size, 0);
+      caffe_memset(sizes[j], 3, ptr);
+      EXPECT_EQ(static_cast<char*>(ptr)[sizes[j] - 1], 3);
+      allocator.Free(ptr, sizes[j]);
+    }
+  }
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,153 @@
+#ifdef USE_OPENCV
+#if OPENCV_VERSION == 3
+#include <opencv2/videoio.hpp>
+#else
+#include <opencv2/opencv.hpp>
+#endif  // OPENCV_VERSION == 3
+
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/video_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class VideoDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  VideoDataLayerTest()
+      : num_frames_(10),
+        height_(24),
+        width_(32),
+        blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    // The layer raises SIGINT at the end of the video to stop the solver.
+    old_sigint_handler_ = std::signal(SIGINT, SIG_IGN);
+    // Create a video whose i-th frame is filled with FrameValue(i). MJPG is
+    // encoded by OpenCV itself, so the video does not depend on the codecs
+    // of the system.
+    MakeTempFilename(&filename_);
+    filename_ += ".avi";
+    LOG(INFO) << "Using temporary file " << filename_;
+#if OPENCV_VERSION == 3
+    const int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+#else
+    const int fourcc = CV_FOURCC('M', 'J', 'P', 'G');
+#endif  // OPENCV_VERSION == 3
+    cv::VideoWriter writer(filename_, fourcc, 25, cv::Size(width_, height_));
+    CHECK(writer.isOpened()) << "Failed to create video: " << filename_;
+    for (int i = 0; i < num_frames_; ++i) {
+      writer << cv::Mat(height_, width_, CV_8UC3, cv::Scalar::all(
+          FrameValue(i)));
+    }
+  }
+
+  virtual void TearDown() {
+    std::signal(SIGINT, old_sigint_handler_);
+    std::remove(filename_.c_str());
+  }
+
+  virtual ~VideoDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  static int FrameValue(int frame) { return 20 * (frame + 1); }
+
+  void FillParam(const int batch_size, const int skip_frames,
+                 LayerParameter* param) {
+    param->mutable_data_param()->set_batch_size(batch_size);
+    VideoDataParameter* video_data_param = param->mutable_video_data_param();
+    video_data_param->set_video_type(VideoDataParameter_VideoType_VIDEO);
+    video_data_param->set_video_file(filename_);
+    video_data_param->set_skip_frames(skip_frames);
+    // Smaller than a batch, so that the capture thread has to wait for the
+    // prefetch thread.
+    video_data_param->set_frame_buffer_size(2);
+  }
+
+  // Checks that the items of the batches are the expected frames, in order,
+  // followed by zeros with a timestamp of -1 past the end of the video.
+  void TestFrames(const int batch_size, const int skip_frames) {
+    LayerParameter param;
+    FillParam(batch_size, skip_frames, &param);
+    VideoDataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), batch_size);
+    EXPECT_EQ(blob_top_data_->channels(), 3);
+    EXPECT_EQ(blob_top_data_->height(), height_);
+    EXPECT_EQ(blob_top_data_->width(), width_);
+    EXPECT_EQ(blob_top_label_->num(), batch_size);
+    // The skipped frames come before each frame read.
+    const int num_read = num_frames_ / (skip_frames + 1);
+    const int dim = blob_top_data_->count(1);
+    Dtype last_timestamp = -1;
+    int item = 0;
+    for (int iter = 0; iter < num_read / batch_size + 2; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i, ++item) {
+        const Dtype* data = blob_top_data_->cpu_data() + i * dim;
+        const Dtype timestamp = blob_top_label_->cpu_data()[i];
+        if (item < num_read) {
+          const int frame = skip_frames + item * (skip_frames + 1);
+          // MJPG is lossy, but keeps flat frames within a few levels.
+          for (int j = 0; j < dim; ++j) {
+            EXPECT_NEAR(data[j], FrameValue(frame), 4)
+                << "frame " << frame;
+          }
+          EXPECT_GE(timestamp, 0);
+          EXPECT_GT(timestamp, last_timestamp);
+          last_timestamp = timestamp;
+        } else {
+          for (int j = 0; j < dim; ++j) {
+            EXPECT_EQ(data[j], 0);
+          }
+          EXPECT_EQ(timestamp, -1);
+        }
+      }
+    }
+  }
+
+  const int num_frames_;
+  const int height_;
+  const int width_;
+  string filename_;
+  void (*old_sigint_handler_)(int);
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(VideoDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(VideoDataLayerTest, TestRead) {
+  this->TestFrames(4, 0);
+}
+
+TYPED_TEST(VideoDataLayerTest, TestReadSkipFrames) {
+  this->TestFrames(4, 2);
+}
+
+TYPED_TEST(VideoDataLayerTest, TestReadBatchOfVideo) {
+  // A batch as large as the video ends exactly with its last frame.
+  this->TestFrames(this->num_frames_, 0);
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <csignal>
+#include <cstring>
 #include <ctime>
 #include <functional>
 #include <map>
@@ -8,12 +9,20 @@
 #include <utility>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "boost/iterator/counting_iterator.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/weak_ptr.hpp"
 
 #include "caffe/util/bbox_util.hpp"
 
 namespace caffe {
 
+using boost::weak_ptr;
+
 bool SortBBoxAscend(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2) {
   return bbox1.score() < bbox2.score();
 }
@@ -46,6 +55,25 @@ template bool SortScorePairDescend(const pair<float, int>& pair1,
 template bool SortScorePairDescend(const pair<float, pair<int, int> >& pair1,
                                    const pair<float, pair<int, int> >& pair2);
 
+template <typename Dtype, typename T>
+bool SortScoreIndexDescend(const pair<Dtype, T>& pair1,
+                           const pair<Dtype, T>& pair2) {
+  return pair1.first > pair2.first ||
+      (pair1.first == pair2.first && pair1.second < pair2.second);
+}
+
+// Explicit initialization.
+template bool SortScoreIndexDescend(const pair<float, int>& pair1,
+                                    const pair<float, int>& pair2);
+template bool SortScoreIndexDescend(const pair<double, int>& pair1,
+                                    const pair<double, int>& pair2);
+template bool SortScoreIndexDescend(
+    const pair<float, pair<int, int> >& pair1,
+    const pair<float, pair<int, int> >& pair2);
+template bool SortScoreIndexDescend(
+    const pair<double, pair<int, int> >& pair1,
+    const pair<double, pair<int, int> >& pair2);
+
 NormalizedBBox UnitBBox() {
   NormalizedBBox unit_bbox;
   unit_bbox.set_xmin(0.);
@@ -581,6 +609,135 @@ void DecodeBBoxesAll(const vector<LabelBBox>& all_loc_preds,
   }
 }
 
+// Decode num_priors CENTER_SIZE bboxes. loc_data has a stride of loc_step
+// between bboxes. The loop has no branches or calls besides exp so that the
+// compiler can vectorize it.
+template <typename Dtype, bool variance_encoded_in_target>
+static void DecodeBBoxesCenterSize(const Dtype* loc_data, const int loc_step,
+    const PriorBBoxes& priors, Dtype* bbox_data) {
+  const int num_priors = priors.num_priors;
+  const float* prior_center_x = &priors.center_x[0];
+  const float* prior_center_y = &priors.center_y[0];
+  const float* prior_width = &priors.width[0];
+  const float* prior_height = &priors.height[0];
+  const float* var_data = priors.variances();
+#if defined(_OPENMP) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int p = 0; p < num_priors; ++p) {
+    const Dtype* loc = loc_data + p * loc_step;
+    const float* var = var_data + p * 4;
+    Dtype center_x, center_y, width, height;
+    if (variance_encoded_in_target) {
+      center_x = loc[0] * prior_width[p] + prior_center_x[p];
+      center_y = loc[1] * prior_height[p] + prior_center_y[p];
+      width = std::exp(loc[2]) * prior_width[p];
+      height = std::exp(loc[3]) * prior_height[p];
+    } else {
+      center_x = var[0] * loc[0] * prior_width[p] + prior_center_x[p];
+      center_y = var[1] * loc[1] * prior_height[p] + prior_center_y[p];
+      width = std::exp(var[2] * loc[2]) * prior_width[p];
+      height = std::exp(var[3] * loc[3]) * prior_height[p];
+    }
+    Dtype* bbox = bbox_data + p * 4;
+    bbox[0] = center_x - width / 2;
+    bbox[1] = center_y - height / 2;
+    bbox[2] = center_x + width / 2;
+    bbox[3] = center_y + height / 2;
+  }
+}
+
+template <typename Dtype>
+void DecodeBBoxesAll(const Dtype* loc_data, const Dtype* prior_data,
+    const int num, const int num_priors, const bool share_location,
+    const int num_loc_classes, const int background_label_id,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip, Dtype* bbox_data) {
+  DecodeBBoxesAll(loc_data, *GetPriorBBoxes(prior_data, num_priors), num,
+                  share_location, num_loc_classes, background_label_id,
+                  code_type, variance_encoded_in_target, clip, bbox_data);
+}
+
+template <typename Dtype>
+void DecodeBBoxesAll(const Dtype* loc_data, const PriorBBoxes& priors,
+    const int num, const bool share_location, const int num_loc_classes,
+    const int background_label_id, const CodeType code_type,
+    const bool variance_encoded_in_target, const bool clip, Dtype* bbox_data) {
+  const int num_priors = priors.num_priors;
+  const float* var_data = priors.variances();
+  const int loc_step = num_loc_classes * 4;
+  for (int i = 0; i < num; ++i) {
+    for (int c = 0; c < num_loc_classes; ++c) {
+      if (!share_location && c == background_label_id) {
+        // Ignore background class.
+        continue;
+      }
+      const Dtype* cur_loc_data = loc_data + i * num_priors * loc_step + c * 4;
+      Dtype* cur_bbox_data =
+          bbox_data + (i * num_loc_classes + c) * num_priors * 4;
+      if (code_type == PriorBoxParameter_CodeType_CENTER_SIZE) {
+        if (variance_encoded_in_target) {
+          DecodeBBoxesCenterSize<Dtype, true>(cur_loc_data, loc_step, priors,
+                                              cur_bbox_data);
+        } else {
+          DecodeBBoxesCenterSize<Dtype, false>(cur_loc_data, loc_step, priors,
+                                               cur_bbox_data);
+        }
+      } else if (code_type == PriorBoxParameter_CodeType_CORNER ||
+                 code_type == PriorBoxParameter_CodeType_CORNER_SIZE) {
+        const bool corner_size =
+            code_type == PriorBoxParameter_CodeType_CORNER_SIZE;
+        for (int p = 0; p < num_priors; ++p) {
+          const Dtype* loc = cur_loc_data + p * loc_step;
+          const float* prior = &priors.data[p * 4];
+          const float* var = var_data + p * 4;
+          const float prior_size[4] = {
+            corner_size ? priors.width[p] : 1.f,
+            corner_size ? priors.height[p] : 1.f,
+            corner_size ? priors.width[p] : 1.f,
+            corner_size ? priors.height[p] : 1.f };
+          for (int k = 0; k < 4; ++k) {
+            const Dtype offset = variance_encoded_in_target ?
+                loc[k] : var[k] * loc[k];
+            cur_bbox_data[p * 4 + k] = prior[k] + offset * prior_size[k];
+          }
+        }
+      } else {
+        LOG(FATAL) << "Unknown LocLossType.";
+      }
+      if (clip) {
+        for (int k = 0; k < num_priors * 4; ++k) {
+          cur_bbox_data[k] =
+              std::max(std::min(cur_bbox_data[k], Dtype(1.)), Dtype(0.));
+        }
+      }
+    }
+  }
+}
+
+// Explicit initialization.
+template void DecodeBBoxesAll(const float* loc_data, const float* prior_data,
+    const int num, const int num_priors, const bool share_location,
+    const int num_loc_classes, const int background_label_id,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip, float* bbox_data);
+template void DecodeBBoxesAll(const double* loc_data,
+    const double* prior_data, const int num, const int num_priors,
+    const bool share_location, const int num_loc_classes,
+    const int background_label_id, const CodeType code_type,
+    const bool variance_encoded_in_target, const bool clip,
+    double* bbox_data);
+template void DecodeBBoxesAll(const float* loc_data,
+    const PriorBBoxes& priors, const int num, const bool share_location,
+    const int num_loc_classes, const int background_label_id,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip, float* bbox_data);
+template void DecodeBBoxesAll(const double* loc_data,
+    const PriorBBoxes& priors, const int num, const bool share_location,
+    const int num_loc_classes, const int background_label_id,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip, double* bbox_data);
+
 void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
     const vector<NormalizedBBox>& pred_bboxes, const int label,
     const MatchType match_type, const float overlap_threshold,
@@ -817,6 +974,264 @@ void FindMatches(const vector<LabelBBox>& all_loc_preds,
   }
 }
 
+// Match the priors of one image with its num_gt ground truth bboxes, like
+// MatchBBox with label -1. prior_coords holds the xmin, ymin, xmax, ymax and
+// size of all the priors, each as num_priors contiguous values, and
+// cross_boundary flags the priors to ignore.
+static void MatchPriorBBoxes(const PriorBBoxes& priors,
+    const char* cross_boundary, const float* gt_bboxes, const int num_gt,
+    const MatchType match_type, const float overlap_threshold,
+    vector<float>* overlaps, vector<int>* match_indices,
+    vector<float>* match_overlaps) {
+  const int num_priors = priors.num_priors;
+  match_indices->assign(num_priors, -1);
+  match_overlaps->assign(num_priors, 0.);
+  int* match_index = &(*match_indices)[0];
+  float* match_overlap = &(*match_overlaps)[0];
+  if (cross_boundary != NULL) {
+    for (int p = 0; p < num_priors; ++p) {
+      if (cross_boundary[p]) {
+        match_index[p] = -2;
+      }
+    }
+  }
+  if (num_gt == 0) {
+    return;
+  }
+  const float* prior_xmin = &priors.xmin[0];
+  const float* prior_ymin = &priors.ymin[0];
+  const float* prior_xmax = &priors.xmax[0];
+  const float* prior_ymax = &priors.ymax[0];
+  const float* prior_size = &priors.size[0];
+
+  // Row j holds the overlaps of the j-th ground truth with all the priors,
+  // computed as JaccardOverlap does, with those not above 1e-6 set to 0.
+  overlaps->resize(num_gt * num_priors);
+  for (int j = 0; j < num_gt; ++j) {
+    const float* gt = gt_bboxes + j * 4;
+    const float gt_size = (gt[2] < gt[0] || gt[3] < gt[1]) ? 0.f :
+        (gt[2] - gt[0]) * (gt[3] - gt[1]);
+    float* row = &(*overlaps)[j * num_priors];
+#if defined(_OPENMP) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+    for (int p = 0; p < num_priors; ++p) {
+      const float inter_width =
+          std::min(prior_xmax[p], gt[2]) - std::max(prior_xmin[p], gt[0]);
+      const float inter_height =
+          std::min(prior_ymax[p], gt[3]) - std::max(prior_ymin[p], gt[1]);
+      const float inter_size = inter_width * inter_height;
+      const float overlap = (inter_width > 0 && inter_height > 0) ?
+          inter_size / (prior_size[p] + gt_size - inter_size) : 0.f;
+      row[p] = overlap > 1e-6 ? overlap : 0.f;
+      match_overlap[p] = std::max(match_overlap[p], row[p]);
+    }
+  }
+  if (cross_boundary != NULL) {
+    for (int p = 0; p < num_priors; ++p) {
+      if (cross_boundary[p]) {
+        match_overlap[p] = 0.;
+      }
+    }
+  }
+
+  // Bipartite matching: repeatedly match the most overlapped pair of an
+  // unmatched prior and a ground truth left in the pool, the lowest prior
+  // and then ground truth index first among equal overlaps. Each ground
+  // truth tracks its best prior, which only changes when that prior is taken.
+  vector<int> best_prior(num_gt, -1);
+  vector<float> best_overlap(num_gt, 0.);
+  vector<bool> in_pool(num_gt, true);
+  for (int j = 0; j < num_gt; ++j) {
+    const float* row = &(*overlaps)[j * num_priors];
+    for (int p = 0; p < num_priors; ++p) {
+      if (match_index[p] == -1 && row[p] > best_overlap[j]) {
+        best_prior[j] = p;
+        best_overlap[j] = row[p];
+      }
+    }
+  }
+  while (true) {
+    int max_gt_idx = -1;
+    for (int j = 0; j < num_gt; ++j) {
+      if (!in_pool[j] || best_prior[j] == -1) {
+        continue;
+      }
+      if (max_gt_idx == -1 || best_overlap[j] > best_overlap[max_gt_idx] ||
+          (best_overlap[j] == best_overlap[max_gt_idx] &&
+           best_prior[j] < best_prior[max_gt_idx])) {
+        max_gt_idx = j;
+      }
+    }
+    if (max_gt_idx == -1) {
+      // Cannot find good match.
+      break;
+    }
+    const int max_idx = best_prior[max_gt_idx];
+    match_index[max_idx] = max_gt_idx;
+    match_overlap[max_idx] = best_overlap[max_gt_idx];
+    in_pool[max_gt_idx] = false;
+    for (int j = 0; j < num_gt; ++j) {
+      if (!in_pool[j] || best_prior[j] != max_idx) {
+        continue;
+      }
+      const float* row = &(*overlaps)[j * num_priors];
+      best_prior[j] = -1;
+      best_overlap[j] = 0.;
+      for (int p = 0; p < num_priors; ++p) {
+        if (match_index[p] == -1 && row[p] > best_overlap[j]) {
+          best_prior[j] = p;
+          best_overlap[j] = row[p];
+        }
+      }
+    }
+  }
+
+  switch (match_type) {
+    case MultiBoxLossParameter_MatchType_BIPARTITE:
+      // Already done.
+      break;
+    case MultiBoxLossParameter_MatchType_PER_PREDICTION:
+      // Match the rest of the priors with their most overlapped ground
+      // truth, the first one among equal overlaps. match_overlap already
+      // holds the maximum overlap of the unmatched priors.
+      for (int j = 0; j < num_gt; ++j) {
+        const float* row = &(*overlaps)[j * num_priors];
+        for (int p = 0; p < num_priors; ++p) {
+          if (match_index[p] == -1 && match_overlap[p] > 0 &&
+              match_overlap[p] >= overlap_threshold &&
+              row[p] == match_overlap[p]) {
+            match_index[p] = j;
+          }
+        }
+      }
+      break;
+    default:
+      LOG(FATAL) << "Unknown matching type.";
+      break;
+  }
+}
+
+template <typename Dtype>
+void FindMatches(const Dtype* prior_data, const int num_priors,
+      const vector<float>& gt_bboxes, const vector<int>& gt_labels,
+      const vector<int>& gt_start,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<vector<float> >* overlaps,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices) {
+  FindMatches(*GetPriorBBoxes(prior_data, num_priors), gt_bboxes, gt_labels,
+              gt_start, multibox_loss_param, overlaps, all_match_overlaps,
+              all_match_indices);
+}
+
+template void FindMatches(const float* prior_data, const int num_priors,
+      const vector<float>& gt_bboxes, const vector<int>& gt_labels,
+      const vector<int>& gt_start,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<vector<float> >* overlaps,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices);
+template void FindMatches(const double* prior_data, const int num_priors,
+      const vector<float>& gt_bboxes, const vector<int>& gt_labels,
+      const vector<int>& gt_start,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<vector<float> >* overlaps,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices);
+
+void FindMatches(const PriorBBoxes& priors,
+      const vector<float>& gt_bboxes, const vector<int>& gt_labels,
+      const vector<int>& gt_start,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<vector<float> >* overlaps,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices) {
+  // Get parameters.
+  CHECK(multibox_loss_param.has_num_classes()) << "Must provide num_classes.";
+  const int num_classes = multibox_loss_param.num_classes();
+  CHECK_GE(num_classes, 1) << "num_classes should not be less than 1.";
+  const bool share_location = multibox_loss_param.share_location();
+  const int loc_classes = share_location ? 1 : num_classes;
+  const MatchType match_type = multibox_loss_param.match_type();
+  const float overlap_threshold = multibox_loss_param.overlap_threshold();
+  CHECK(multibox_loss_param.use_prior_for_matching())
+      << "Only matching with the prior bboxes works on flat arrays.";
+  const int background_label_id = multibox_loss_param.background_label_id();
+  const bool ignore_cross_boundary_bbox =
+      multibox_loss_param.ignore_cross_boundary_bbox();
+  const int num_priors = priors.num_priors;
+
+  vector<char> cross_boundary;
+  if (ignore_cross_boundary_bbox) {
+    cross_boundary.resize(num_priors);
+    for (int p = 0; p < num_priors; ++p) {
+      const float* coords = &priors.data[p * 4];
+      bool cross = false;
+      for (int k = 0; k < 4; ++k) {
+        cross = cross || coords[k] < 0 || coords[k] > 1;
+      }
+      cross_boundary[p] = cross;
+    }
+  }
+
+  const int num = gt_start.size() - 1;
+  int num_threads = 1;
+#ifdef _OPENMP
+  num_threads = omp_get_max_threads();
+#endif
+  overlaps->resize(num_threads);
+  all_match_overlaps->resize(num);
+  all_match_indices->resize(num);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < num; ++i) {
+    map<int, vector<int> >& match_indices = (*all_match_indices)[i];
+    map<int, vector<float> >& match_overlaps = (*all_match_overlaps)[i];
+    match_indices.clear();
+    match_overlaps.clear();
+    const int num_gt = gt_start[i + 1] - gt_start[i];
+    if (num_gt == 0) {
+      // There is no gt for current image. All predictions are negative.
+      continue;
+    }
+    int thread_id = 0;
+#ifdef _OPENMP
+    thread_id = omp_get_thread_num();
+#endif
+    const int label = -1;
+    vector<int>& temp_match_indices = match_indices[label];
+    vector<float>& temp_match_overlaps = match_overlaps[label];
+    MatchPriorBBoxes(priors,
+        cross_boundary.empty() ? NULL : &cross_boundary[0],
+        &gt_bboxes[gt_start[i] * 4], num_gt, match_type, overlap_threshold,
+        &(*overlaps)[thread_id], &temp_match_indices, &temp_match_overlaps);
+    if (share_location) {
+      continue;
+    }
+    // Distribute the matching results to different loc_class.
+    const int* labels = &gt_labels[gt_start[i]];
+    for (int c = 0; c < loc_classes; ++c) {
+      if (c == background_label_id) {
+        // Ignore background loc predictions.
+        continue;
+      }
+      vector<int>& class_match_indices = match_indices[c];
+      class_match_indices.assign(num_priors, -1);
+      match_overlaps[c] = temp_match_overlaps;
+      for (int m = 0; m < num_priors; ++m) {
+        const int gt_idx = temp_match_indices[m];
+        if (gt_idx > -1 && labels[gt_idx] == c) {
+          class_match_indices[m] = gt_idx;
+        }
+      }
+    }
+    match_indices.erase(label);
+    match_overlaps.erase(label);
+  }
+}
+
 int CountNumMatches(const vector<map<int, vector<int> > >& all_match_indices,
                     const int num) {
   int num_matches = 0;
@@ -1051,12 +1466,27 @@ template void MineHardExamples(const Blob<double>& conf_blob,
     vector<map<int, vector<int> > >* all_match_indices,
     vector<vector<int> >* all_neg_indices);
 
+template <typename Dtype>
+int SkipLabelHeader(const int num_gt, const Dtype** gt_data) {
+  if (num_gt == 0 || (*gt_data)[0] != kLabelHeaderId) {
+    return num_gt;
+  }
+  const int num_rows = (*gt_data)[1];
+  CHECK_LT(num_rows, num_gt) << "Ground truth header exceeds the blob.";
+  *gt_data += 8;
+  return num_rows;
+}
+
+template int SkipLabelHeader(const int num_gt, const float** gt_data);
+template int SkipLabelHeader(const int num_gt, const double** gt_data);
+
 template <typename Dtype>
 void GetGroundTruth(const Dtype* gt_data, const int num_gt,
       const int background_label_id, const bool use_difficult_gt,
       map<int, vector<NormalizedBBox> >* all_gt_bboxes) {
   all_gt_bboxes->clear();
-  for (int i = 0; i < num_gt; ++i) {
+  const int num_rows = SkipLabelHeader(num_gt, &gt_data);
+  for (int i = 0; i < num_rows; ++i) {
     int start_idx = i * 8;
     int item_id = gt_data[start_idx];
     if (item_id == -1) {
@@ -1096,7 +1526,8 @@ void GetGroundTruth(const Dtype* gt_data, const int num_gt,
       const int background_label_id, const bool use_difficult_gt,
       map<int, LabelBBox>* all_gt_bboxes) {
   all_gt_bboxes->clear();
-  for (int i = 0; i < num_gt; ++i) {
+  const int num_rows = SkipLabelHeader(num_gt, &gt_data);
+  for (int i = 0; i < num_rows; ++i) {
     int start_idx = i * 8;
     int item_id = gt_data[start_idx];
     if (item_id == -1) {
@@ -1130,6 +1561,61 @@ template void GetGroundTruth(const double* gt_data, const int num_gt,
       const int background_label_id, const bool use_difficult_gt,
       map<int, LabelBBox>* all_gt_bboxes);
 
+template <typename Dtype>
+void GetGroundTruth(const Dtype* gt_data, const int num_gt, const int num,
+      const int background_label_id, const bool use_difficult_gt,
+      vector<float>* gt_bboxes, vector<int>* gt_labels, vector<int>* gt_start) {
+  const int num_rows = SkipLabelHeader(num_gt, &gt_data);
+  // Count the ground truth of each image, then place them.
+  gt_start->assign(num + 1, 0);
+  for (int i = 0; i < num_rows; ++i) {
+    const Dtype* row = gt_data + i * 8;
+    const int item_id = row[0];
+    if (item_id == -1) {
+      continue;
+    }
+    CHECK_GE(item_id, 0);
+    CHECK_LT(item_id, num);
+    const int label = row[1];
+    CHECK_NE(background_label_id, label)
+        << "Found background label in the dataset.";
+    if (!use_difficult_gt && static_cast<bool>(row[7])) {
+      continue;
+    }
+    ++(*gt_start)[item_id + 1];
+  }
+  for (int n = 0; n < num; ++n) {
+    (*gt_start)[n + 1] += (*gt_start)[n];
+  }
+  const int num_kept = (*gt_start)[num];
+  gt_bboxes->resize(num_kept * 4);
+  gt_labels->resize(num_kept);
+  vector<int> next(gt_start->begin(), gt_start->end() - 1);
+  for (int i = 0; i < num_rows; ++i) {
+    const Dtype* row = gt_data + i * 8;
+    const int item_id = row[0];
+    if (item_id == -1 || (!use_difficult_gt && static_cast<bool>(row[7]))) {
+      continue;
+    }
+    const int j = next[item_id]++;
+    (*gt_labels)[j] = row[1];
+    float* bbox = &(*gt_bboxes)[j * 4];
+    bbox[0] = row[3];
+    bbox[1] = row[4];
+    bbox[2] = row[5];
+    bbox[3] = row[6];
+  }
+}
+
+template void GetGroundTruth(const float* gt_data, const int num_gt,
+      const int num, const int background_label_id,
+      const bool use_difficult_gt, vector<float>* gt_bboxes,
+      vector<int>* gt_labels, vector<int>* gt_start);
+template void GetGroundTruth(const double* gt_data, const int num_gt,
+      const int num, const int background_label_id,
+      const bool use_difficult_gt, vector<float>* gt_bboxes,
+      vector<int>* gt_labels, vector<int>* gt_start);
+
 template <typename Dtype>
 void GetLocPredictions(const Dtype* loc_data, const int num,
       const int num_preds_per_class, const int num_loc_classes,
@@ -1391,6 +1877,32 @@ template void GetConfidenceScores(const double* conf_data, const int num,
       const int num_preds_per_class, const int num_classes,
       const bool class_major, vector<map<int, vector<float> > >* conf_preds);
 
+template <typename Dtype>
+void PermuteData(const int count, const Dtype* data, const int num_classes,
+      const int num_data, const int num_dim, Dtype* new_data) {
+  const int num = count / (num_classes * num_data * num_dim);
+  for (int n = 0; n < num; ++n) {
+    for (int d = 0; d < num_data; ++d) {
+      for (int c = 0; c < num_classes; ++c) {
+        Dtype* cur_new_data = new_data + (c * num_data + d) * num_dim;
+        for (int k = 0; k < num_dim; ++k) {
+          cur_new_data[k] = data[k];
+        }
+        data += num_dim;
+      }
+    }
+    new_data += num_classes * num_data * num_dim;
+  }
+}
+
+// Explicit initialization.
+template void PermuteData(const int count, const float* data,
+      const int num_classes, const int num_data, const int num_dim,
+      float* new_data);
+template void PermuteData(const int count, const double* data,
+      const int num_classes, const int num_data, const int num_dim,
+      double* new_data);
+
 template <typename Dtype>
 void ComputeConfLoss(const Dtype* conf_data, const int num,
       const int num_preds_per_class, const int num_classes,
@@ -1536,6 +2048,145 @@ template void ComputeConfLoss(const double* conf_data, const int num,
       const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
       vector<vector<float> >* all_conf_loss);
 
+template <typename Dtype>
+void ComputeConfLossSoftmax(const Dtype* conf_data, const int num,
+      const int num_priors, const int num_classes,
+      const int background_label_id,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const vector<int>& gt_labels, const vector<int>& gt_start,
+      Dtype* prob_data, Dtype* conf_loss) {
+  CHECK_GE(background_label_id, 0);
+  CHECK_LT(background_label_id, num_classes);
+  CHECK_EQ(all_match_indices.size(), num);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < num; ++i) {
+    const map<int, vector<int> >& match_indices = all_match_indices[i];
+    const int* match_index = NULL;
+    if (!match_indices.empty()) {
+      CHECK_EQ(match_indices.size(), 1) << "Location must be shared.";
+      CHECK_EQ(match_indices.begin()->second.size(), num_priors);
+      match_index = &match_indices.begin()->second[0];
+    }
+    for (int p = 0; p < num_priors; ++p) {
+      const int offset = (i * num_priors + p) * num_classes;
+      const Dtype* conf = conf_data + offset;
+      Dtype* prob = prob_data + offset;
+      // We need to subtract the max to avoid numerical issues.
+      Dtype maxval = conf[0];
+      for (int c = 1; c < num_classes; ++c) {
+        maxval = std::max(conf[c], maxval);
+      }
+      Dtype sum = 0;
+      for (int c = 0; c < num_classes; ++c) {
+        prob[c] = std::exp(conf[c] - maxval);
+        sum += prob[c];
+      }
+      for (int c = 0; c < num_classes; ++c) {
+        prob[c] /= sum;
+      }
+      int label = background_label_id;
+      if (match_index != NULL && match_index[p] > -1) {
+        label = gt_labels[gt_start[i] + match_index[p]];
+        CHECK_GE(label, 0);
+        CHECK_LT(label, num_classes);
+      }
+      conf_loss[i * num_priors + p] = -log(std::max(prob[label],
+                                                    Dtype(FLT_MIN)));
+    }
+  }
+}
+
+template void ComputeConfLossSoftmax(const float* conf_data, const int num,
+      const int num_priors, const int num_classes,
+      const int background_label_id,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const vector<int>& gt_labels, const vector<int>& gt_start,
+      float* prob_data, float* conf_loss);
+template void ComputeConfLossSoftmax(const double* conf_data, const int num,
+      const int num_priors, const int num_classes,
+      const int background_label_id,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const vector<int>& gt_labels, const vector<int>& gt_start,
+      double* prob_data, double* conf_loss);
+
+// Orders prior indices by descending loss, and ascending index among equal
+// losses.
+template <typename Dtype>
+class LossIndexDescend {
+ public:
+  explicit LossIndexDescend(const Dtype* loss) : loss_(loss) {}
+  bool operator()(const int a, const int b) const {
+    return loss_[a] > loss_[b] || (loss_[a] == loss_[b] && a < b);
+  }
+
+ private:
+  const Dtype* loss_;
+};
+
+template <typename Dtype>
+void MineHardNegatives(const Dtype* conf_loss, const int num,
+      const int num_priors,
+      const vector<map<int, vector<float> > >& all_match_overlaps,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const MultiBoxLossParameter& multibox_loss_param, int* num_negs,
+      vector<vector<int> >* all_neg_indices) {
+  CHECK_EQ(multibox_loss_param.mining_type(),
+           MultiBoxLossParameter_MiningType_MAX_NEGATIVE);
+  const float neg_pos_ratio = multibox_loss_param.neg_pos_ratio();
+  const float neg_overlap = multibox_loss_param.neg_overlap();
+  all_neg_indices->resize(num);
+  int total_negs = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:total_negs)
+#endif
+  for (int i = 0; i < num; ++i) {
+    vector<int>& neg_indices = (*all_neg_indices)[i];
+    neg_indices.clear();
+    const map<int, vector<int> >& match_indices = all_match_indices[i];
+    if (match_indices.empty()) {
+      continue;
+    }
+    CHECK_EQ(match_indices.size(), 1) << "Location must be shared.";
+    const vector<int>& match_index = match_indices.begin()->second;
+    const vector<float>& match_overlap =
+        all_match_overlaps[i].find(match_indices.begin()->first)->second;
+    int num_pos = 0;
+    for (int p = 0; p < num_priors; ++p) {
+      if (match_index[p] > -1) {
+        ++num_pos;
+      } else if (match_index[p] == -1 && match_overlap[p] < neg_overlap) {
+        neg_indices.push_back(p);
+      }
+    }
+    const int num_sel = std::min(static_cast<int>(num_pos * neg_pos_ratio),
+                                 static_cast<int>(neg_indices.size()));
+    if (num_sel < neg_indices.size()) {
+      const Dtype* loss = conf_loss + i * num_priors;
+      std::nth_element(neg_indices.begin(), neg_indices.begin() + num_sel,
+                       neg_indices.end(), LossIndexDescend<Dtype>(loss));
+      neg_indices.resize(num_sel);
+      std::sort(neg_indices.begin(), neg_indices.end());
+    }
+    total_negs += num_sel;
+  }
+  *num_negs = total_negs;
+}
+
+template void MineHardNegatives(const float* conf_loss, const int num,
+      const int num_priors,
+      const vector<map<int, vector<float> > >& all_match_overlaps,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const MultiBoxLossParameter& multibox_loss_param, int* num_negs,
+      vector<vector<int> >* all_neg_indices);
+template void MineHardNegatives(const double* conf_loss, const int num,
+      const int num_priors,
+      const vector<map<int, vector<float> > >& all_match_overlaps,
+      const vector<map<int, vector<int> > >& all_match_indices,
+      const MultiBoxLossParameter& multibox_loss_param, int* num_negs,
+      vector<vector<int> >* all_neg_indices);
+
 template <typename Dtype>
 void EncodeConfPrediction(const Dtype* conf_data, const int num,
       const int num_priors, const MultiBoxLossParameter& multibox_loss_param,
@@ -1687,6 +2338,89 @@ template void GetPriorBBoxes(const double* prior_data, const int num_priors,
       vector<NormalizedBBox>* prior_bboxes,
       vector<vector<float> >* prior_variances);
 
+// The flat prior bboxes returned by GetPriorBBoxes, as long as a caller holds
+// them.
+static vector<weak_ptr<const PriorBBoxes> > prior_bboxes_;
+static boost::mutex prior_bboxes_mutex_;
+
+// Whether prior_data holds the data of priors.
+static bool SamePriorBBoxes(const PriorBBoxes& priors, const float* prior_data,
+      const int num_priors) {
+  return priors.num_priors == num_priors &&
+      memcmp(&priors.data[0], prior_data, num_priors * 8 * sizeof(float)) == 0;
+}
+
+static bool SamePriorBBoxes(const PriorBBoxes& priors,
+      const double* prior_data, const int num_priors) {
+  if (priors.num_priors != num_priors) {
+    return false;
+  }
+  const int count = num_priors * 8;
+  const float* data = &priors.data[0];
+  int k = 0;
+  while (k < count && data[k] == static_cast<float>(prior_data[k])) {
+    ++k;
+  }
+  return k == count;
+}
+
+template <typename Dtype>
+shared_ptr<const PriorBBoxes> GetPriorBBoxes(const Dtype* prior_data,
+      const int num_priors, const shared_ptr<const PriorBBoxes>& last) {
+  // The priors of a layer rarely change between iterations: check the ones it
+  // got last time before taking the lock and scanning the shared ones.
+  if (last && SamePriorBBoxes(*last, prior_data, num_priors)) {
+    return last;
+  }
+  const int count = num_priors * 8;
+  boost::mutex::scoped_lock lock(prior_bboxes_mutex_);
+  for (int i = 0; i < prior_bboxes_.size();) {
+    shared_ptr<const PriorBBoxes> priors = prior_bboxes_[i].lock();
+    if (!priors) {
+      prior_bboxes_.erase(prior_bboxes_.begin() + i);
+      continue;
+    }
+    if (priors != last && SamePriorBBoxes(*priors, prior_data, num_priors)) {
+      return priors;
+    }
+    ++i;
+  }
+  shared_ptr<PriorBBoxes> priors(new PriorBBoxes());
+  priors->num_priors = num_priors;
+  priors->data.assign(prior_data, prior_data + count);
+  priors->xmin.resize(num_priors);
+  priors->ymin.resize(num_priors);
+  priors->xmax.resize(num_priors);
+  priors->ymax.resize(num_priors);
+  priors->size.resize(num_priors);
+  priors->center_x.resize(num_priors);
+  priors->center_y.resize(num_priors);
+  priors->width.resize(num_priors);
+  priors->height.resize(num_priors);
+  for (int p = 0; p < num_priors; ++p) {
+    const float* bbox = &priors->data[p * 4];
+    priors->xmin[p] = bbox[0];
+    priors->ymin[p] = bbox[1];
+    priors->xmax[p] = bbox[2];
+    priors->ymax[p] = bbox[3];
+    priors->size[p] = (bbox[2] < bbox[0] || bbox[3] < bbox[1]) ? 0.f :
+        (bbox[2] - bbox[0]) * (bbox[3] - bbox[1]);
+    priors->center_x[p] = (bbox[0] + bbox[2]) / 2;
+    priors->center_y[p] = (bbox[1] + bbox[3]) / 2;
+    priors->width[p] = bbox[2] - bbox[0];
+    priors->height[p] = bbox[3] - bbox[1];
+  }
+  prior_bboxes_.push_back(weak_ptr<const PriorBBoxes>(priors));
+  return priors;
+}
+
+// Explicit initialization.
+template shared_ptr<const PriorBBoxes> GetPriorBBoxes(const float* prior_data,
+      const int num_priors, const shared_ptr<const PriorBBoxes>& last);
+template shared_ptr<const PriorBBoxes> GetPriorBBoxes(
+      const double* prior_data, const int num_priors,
+      const shared_ptr<const PriorBBoxes>& last);
+
 template <typename Dtype>
 void GetDetectionResults(const Dtype* det_data, const int num_det,
       const int background_label_id,
@@ -1769,13 +2503,16 @@ void GetMaxScoreIndex(const Dtype* scores, const int num, const float threshold,
     }
   }
 
-  // Sort the score pair according to the scores in descending order
-  std::sort(score_index_vec->begin(), score_index_vec->end(),
-            SortScorePairDescend<int>);
-
-  // Keep top_k scores if needed.
+  // Sort the score pair according to the scores in descending order, only
+  // sorting the top_k pairs if needed.
   if (top_k > -1 && top_k < score_index_vec->size()) {
+    std::partial_sort(score_index_vec->begin(),
+                      score_index_vec->begin() + top_k, score_index_vec->end(),
+                      SortScoreIndexDescend<Dtype, int>);
     score_index_vec->resize(top_k);
+  } else {
+    std::sort(score_index_vec->begin(), score_index_vec->end(),
+              SortScoreIndexDescend<Dtype, int>);
   }
 }
 
@@ -1939,29 +2676,37 @@ template <typename Dtype>
 void ApplyNMSFast(const Dtype* bboxes, const Dtype* scores, const int num,
       const float score_threshold, const float nms_threshold,
       const float eta, const int top_k, vector<int>* indices) {
-  // Get top_k scores (with corresponding indices).
   vector<pair<Dtype, int> > score_index_vec;
-  GetMaxScoreIndex(scores, num, score_threshold, top_k, &score_index_vec);
+  ApplyNMSFast(bboxes, scores, num, score_threshold, nms_threshold, eta, top_k,
+               &score_index_vec, indices);
+}
+
+template <typename Dtype>
+void ApplyNMSFast(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const float nms_threshold,
+      const float eta, const int top_k,
+      vector<pair<Dtype, int> >* score_index_vec, vector<int>* indices) {
+  // Get top_k scores (with corresponding indices).
+  score_index_vec->clear();
+  GetMaxScoreIndex(scores, num, score_threshold, top_k, score_index_vec);
 
   // Do nms.
   float adaptive_threshold = nms_threshold;
   indices->clear();
-  while (score_index_vec.size() != 0) {
-    const int idx = score_index_vec.front().second;
+  for (int i = 0; i < score_index_vec->size(); ++i) {
+    const int idx = (*score_index_vec)[i].second;
     bool keep = true;
     for (int k = 0; k < indices->size(); ++k) {
-      if (keep) {
-        const int kept_idx = (*indices)[k];
-        float overlap = JaccardOverlap(bboxes + idx * 4, bboxes + kept_idx * 4);
-        keep = overlap <= adaptive_threshold;
-      } else {
+      const int kept_idx = (*indices)[k];
+      float overlap = JaccardOverlap(bboxes + idx * 4, bboxes + kept_idx * 4);
+      if (overlap > adaptive_threshold) {
+        keep = false;
         break;
       }
     }
     if (keep) {
       indices->push_back(idx);
     }
-    score_index_vec.erase(score_index_vec.begin());
     if (keep && eta < 1 && adaptive_threshold > 0.5) {
       adaptive_threshold *= eta;
     }
@@ -1976,6 +2721,297 @@ template
 void ApplyNMSFast(const double* bboxes, const double* scores, const int num,
       const float score_threshold, const float nms_threshold,
       const float eta, const int top_k, vector<int>* indices);
+template
+void ApplyNMSFast(const float* bboxes, const float* scores, const int num,
+      const float score_threshold, const float nms_threshold,
+      const float eta, const int top_k,
+      vector<pair<float, int> >* score_index_vec, vector<int>* indices);
+template
+void ApplyNMSFast(const double* bboxes, const double* scores, const int num,
+      const float score_threshold, const float nms_threshold,
+      const float eta, const int top_k,
+      vector<pair<double, int> >* score_index_vec, vector<int>* indices);
+
+template <typename Dtype>
+void ApplyNMSBitmask(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const float nms_threshold, const int top_k,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices) {
+  // Get top_k scores (with corresponding indices).
+  vector<pair<Dtype, int> >& score_index_vec = buffer->score_index;
+  score_index_vec.clear();
+  GetMaxScoreIndex(scores, num, score_threshold, top_k, &score_index_vec);
+  const int n = score_index_vec.size();
+
+  // Gather the coordinates and sizes of the candidate bboxes in descending
+  // order of score, as separate arrays.
+  vector<Dtype>& values = buffer->values;
+  values.resize(n * 5);
+  Dtype* xmin = &values[0];
+  Dtype* ymin = xmin + n;
+  Dtype* xmax = ymin + n;
+  Dtype* ymax = xmax + n;
+  Dtype* size = ymax + n;
+  for (int i = 0; i < n; ++i) {
+    const Dtype* bbox = bboxes + score_index_vec[i].second * 4;
+    xmin[i] = bbox[0];
+    ymin[i] = bbox[1];
+    xmax[i] = bbox[2];
+    ymax[i] = bbox[3];
+    size[i] = BBoxSize(bbox);
+  }
+
+  // Bit j % 32 of mask[(j / 32) * n + i] is set if candidate i overlaps the
+  // lower scored candidate j too much. The mask is stored by blocks of 32
+  // columns, which are filled independently. The words after the mask keep
+  // track of the suppressed candidates.
+  const int num_words = (n + 31) / 32;
+  vector<uint32_t>& mask = buffer->mask;
+  mask.assign(num_words * (n + 1), 0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int b = 0; b < num_words; ++b) {
+    const int col_begin = b * 32;
+    const int col_end = std::min(n, col_begin + 32);
+    for (int i = 0; i < col_end - 1; ++i) {
+      uint32_t bits = 0;
+      for (int j = std::max(i + 1, col_begin); j < col_end; ++j) {
+        // Same as JaccardOverlap, without branches.
+        const Dtype inter_width = std::max(Dtype(0),
+            std::min(xmax[i], xmax[j]) - std::max(xmin[i], xmin[j]));
+        const Dtype inter_height = std::max(Dtype(0),
+            std::min(ymax[i], ymax[j]) - std::max(ymin[i], ymin[j]));
+        const Dtype inter_size = inter_width * inter_height;
+        const Dtype overlap = inter_size / (size[i] + size[j] - inter_size);
+        // Written so that a NaN overlap suppresses, as in ApplyNMSFast.
+        bits |= uint32_t(!(overlap <= nms_threshold)) << (j - col_begin);
+      }
+      mask[b * n + i] = bits;
+    }
+  }
+
+  // Keep each candidate not suppressed by a kept one.
+  uint32_t* suppressed = &mask[num_words * n];
+  indices->clear();
+  for (int i = 0; i < n; ++i) {
+    if ((suppressed[i / 32] >> (i % 32)) & 1) {
+      continue;
+    }
+    indices->push_back(score_index_vec[i].second);
+    for (int b = i / 32; b < num_words; ++b) {
+      suppressed[b] |= mask[b * n + i];
+    }
+  }
+}
+
+template
+void ApplyNMSBitmask(const float* bboxes, const float* scores, const int num,
+      const float score_threshold, const float nms_threshold, const int top_k,
+      NMSBuffer<float>* buffer, vector<int>* indices);
+template
+void ApplyNMSBitmask(const double* bboxes, const double* scores,
+      const int num, const float score_threshold, const float nms_threshold,
+      const int top_k, NMSBuffer<double>* buffer, vector<int>* indices);
+
+template <typename Dtype>
+void ApplySoftNMS(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const float nms_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices,
+      vector<Dtype>* new_scores) {
+  // Get top_k scores (with corresponding indices).
+  vector<pair<Dtype, int> >& score_index_vec = buffer->score_index;
+  score_index_vec.clear();
+  GetMaxScoreIndex(scores, num, score_threshold, top_k, &score_index_vec);
+
+  indices->clear();
+  new_scores->clear();
+  // The candidates not picked yet are in [begin, end).
+  int begin = 0;
+  int end = score_index_vec.size();
+  while (begin < end) {
+    // Pick the candidate with the highest (decayed) score.
+    int best = begin;
+    for (int k = begin + 1; k < end; ++k) {
+      if (SortScoreIndexDescend(score_index_vec[k], score_index_vec[best])) {
+        best = k;
+      }
+    }
+    std::swap(score_index_vec[begin], score_index_vec[best]);
+    const pair<Dtype, int> picked = score_index_vec[begin++];
+    indices->push_back(picked.second);
+    new_scores->push_back(picked.first);
+
+    // Decay the scores of the remaining candidates, dropping those which fall
+    // to the threshold.
+    const Dtype* picked_bbox = bboxes + picked.second * 4;
+    int kept = begin;
+    for (int k = begin; k < end; ++k) {
+      pair<Dtype, int> candidate = score_index_vec[k];
+      const Dtype overlap =
+          JaccardOverlap(picked_bbox, bboxes + candidate.second * 4);
+      if (decay == NonMaximumSuppressionParameter_Decay_LINEAR) {
+        if (overlap > nms_threshold) {
+          candidate.first *= 1 - overlap;
+        }
+      } else {
+        candidate.first *= std::exp(-overlap * overlap / sigma);
+      }
+      if (candidate.first > score_threshold) {
+        score_index_vec[kept++] = candidate;
+      }
+    }
+    end = kept;
+  }
+}
+
+template
+void ApplySoftNMS(const float* bboxes, const float* scores, const int num,
+      const float score_threshold, const float nms_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<float>* buffer, vector<int>* indices,
+      vector<float>* new_scores);
+template
+void ApplySoftNMS(const double* bboxes, const double* scores, const int num,
+      const float score_threshold, const float nms_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<double>* buffer, vector<int>* indices,
+      vector<double>* new_scores);
+
+template <typename Dtype>
+void ApplyMatrixNMS(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices,
+      vector<Dtype>* new_scores) {
+  // Get top_k scores (with corresponding indices).
+  vector<pair<Dtype, int> >& score_index_vec = buffer->score_index;
+  score_index_vec.clear();
+  GetMaxScoreIndex(scores, num, score_threshold, top_k, &score_index_vec);
+  const int n = score_index_vec.size();
+  const bool linear = decay == NonMaximumSuppressionParameter_Decay_LINEAR;
+
+  // The largest overlap of each candidate with a higher scored one.
+  vector<Dtype>& max_overlaps = buffer->values;
+  max_overlaps.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+  for (int j = 0; j < n; ++j) {
+    const Dtype* bbox = bboxes + score_index_vec[j].second * 4;
+    Dtype max_overlap = 0;
+    for (int i = 0; i < j; ++i) {
+      max_overlap = std::max(max_overlap,
+          JaccardOverlap(bboxes + score_index_vec[i].second * 4, bbox));
+    }
+    max_overlaps[j] = max_overlap;
+  }
+
+  // Decay each score by the overlaps with the higher scored candidates,
+  // relative to how much these were suppressed themselves.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+  for (int j = 0; j < n; ++j) {
+    const Dtype* bbox = bboxes + score_index_vec[j].second * 4;
+    Dtype decay_factor = 1;
+    for (int i = 0; i < j; ++i) {
+      const Dtype overlap =
+          JaccardOverlap(bboxes + score_index_vec[i].second * 4, bbox);
+      Dtype factor;
+      if (linear) {
+        if (max_overlaps[i] >= 1) {
+          // i is a duplicate of a higher scored candidate.
+          continue;
+        }
+        factor = (1 - overlap) / (1 - max_overlaps[i]);
+      } else {
+        factor = std::exp((max_overlaps[i] * max_overlaps[i] -
+                           overlap * overlap) / sigma);
+      }
+      decay_factor = std::min(decay_factor, factor);
+    }
+    score_index_vec[j].first *= decay_factor;
+  }
+
+  // Keep the candidates above the threshold by descending new score.
+  int kept = 0;
+  for (int j = 0; j < n; ++j) {
+    if (score_index_vec[j].first > score_threshold) {
+      score_index_vec[kept++] = score_index_vec[j];
+    }
+  }
+  score_index_vec.resize(kept);
+  std::sort(score_index_vec.begin(), score_index_vec.end(),
+            SortScoreIndexDescend<Dtype, int>);
+  indices->resize(kept);
+  new_scores->resize(kept);
+  for (int j = 0; j < kept; ++j) {
+    (*indices)[j] = score_index_vec[j].second;
+    (*new_scores)[j] = score_index_vec[j].first;
+  }
+}
+
+template
+void ApplyMatrixNMS(const float* bboxes, const float* scores, const int num,
+      const float score_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<float>* buffer, vector<int>* indices,
+      vector<float>* new_scores);
+template
+void ApplyMatrixNMS(const double* bboxes, const double* scores,
+      const int num, const float score_threshold, const int top_k,
+      const NonMaximumSuppressionParameter_Decay decay, const float sigma,
+      NMSBuffer<double>* buffer, vector<int>* indices,
+      vector<double>* new_scores);
+
+template <typename Dtype>
+void ApplyNMS(const Dtype* bboxes, const Dtype* scores, const int num,
+      const float score_threshold,
+      const NonMaximumSuppressionParameter& nms_param,
+      NMSBuffer<Dtype>* buffer, vector<int>* indices,
+      vector<Dtype>* new_scores) {
+  const int top_k = nms_param.has_top_k() ? nms_param.top_k() : -1;
+  switch (nms_param.algorithm()) {
+    case NonMaximumSuppressionParameter_Algorithm_GREEDY:
+      ApplyNMSFast(bboxes, scores, num, score_threshold,
+          nms_param.nms_threshold(), nms_param.eta(), top_k,
+          &(buffer->score_index), indices);
+      break;
+    case NonMaximumSuppressionParameter_Algorithm_BITMASK:
+      ApplyNMSBitmask(bboxes, scores, num, score_threshold,
+          nms_param.nms_threshold(), top_k, buffer, indices);
+      break;
+    case NonMaximumSuppressionParameter_Algorithm_SOFT:
+      ApplySoftNMS(bboxes, scores, num, score_threshold,
+          nms_param.nms_threshold(), top_k, nms_param.decay(),
+          nms_param.sigma(), buffer, indices, new_scores);
+      return;
+    case NonMaximumSuppressionParameter_Algorithm_MATRIX:
+      ApplyMatrixNMS(bboxes, scores, num, score_threshold, top_k,
+          nms_param.decay(), nms_param.sigma(), buffer, indices, new_scores);
+      return;
+    default:
+      LOG(FATAL) << "Unknown nms algorithm: " << nms_param.algorithm();
+  }
+  new_scores->resize(indices->size());
+  for (int i = 0; i < indices->size(); ++i) {
+    (*new_scores)[i] = scores[(*indices)[i]];
+  }
+}
+
+template
+void ApplyNMS(const float* bboxes, const float* scores, const int num,
+      const float score_threshold,
+      const NonMaximumSuppressionParameter& nms_param,
+      NMSBuffer<float>* buffer, vector<int>* indices,
+      vector<float>* new_scores);
+template
+void ApplyNMS(const double* bboxes, const double* scores, const int num,
+      const float score_threshold,
+      const NonMaximumSuppressionParameter& nms_param,
+      NMSBuffer<double>* buffer, vector<int>* indices,
+      vector<double>* new_scores);
 
 void CumSum(const vector<pair<float, int> >& pairs, vector<int>* cumsum) {
   // Sort the pairs based on first item of the pair.
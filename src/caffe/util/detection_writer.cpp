@@ -0,0 +1,246 @@
+#include <cctype>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+
+#include "caffe/util/detection_writer.hpp"
+
+namespace caffe {
+
+// Number of batches that can be in flight between the caller and the thread.
+static const int kNumBatches = 4;
+
+// Round a box (xmin, ymin, xmax, ymax) to (x, y, width, height) with two
+// decimals.
+static void RoundBBox(const float* bbox, float* rounded) {
+  rounded[0] = round(bbox[0] * 100) / 100.;
+  rounded[1] = round(bbox[1] * 100) / 100.;
+  rounded[2] = round((bbox[2] - bbox[0]) * 100) / 100.;
+  rounded[3] = round((bbox[3] - bbox[1]) * 100) / 100.;
+}
+
+// Values that are written to json without quotes.
+static bool IsJsonLiteral(const string& value) {
+  if (value == "null" || value == "true" || value == "false") {
+    return true;
+  }
+  size_t i = (!value.empty() && value[0] == '-') ? 1 : 0;
+  size_t digits = 0;
+  while (i < value.size() && isdigit(value[i])) {
+    ++i;
+    ++digits;
+  }
+  if (digits == 0) {
+    return false;
+  }
+  if (i < value.size() && value[i] == '.') {
+    digits = 0;
+    for (++i; i < value.size() && isdigit(value[i]); ++i) {
+      ++digits;
+    }
+    if (digits == 0) {
+      return false;
+    }
+  }
+  return i == value.size();
+}
+
+static void WriteJsonValue(const string& value, std::ostream* out) {
+  if (IsJsonLiteral(value)) {
+    *out << value;
+    return;
+  }
+  *out << '"';
+  for (int i = 0; i < value.size(); ++i) {
+    if (value[i] == '"' || value[i] == '\\') {
+      *out << '\\';
+    }
+    *out << value[i];
+  }
+  *out << '"';
+}
+
+DetectionWriter::DetectionWriter(const string& output_directory,
+    const string& output_name_prefix, const string& output_format,
+    const map<int, string>& label_to_name, int num_classes,
+    int background_label_id)
+    : output_directory_(output_directory),
+      output_name_prefix_(output_name_prefix),
+      output_format_(output_format),
+      label_to_name_(label_to_name),
+      num_classes_(num_classes),
+      background_label_id_(background_label_id),
+      is_open_(false),
+      num_written_(0) {
+  CHECK(output_format_ == "VOC" || output_format_ == "COCO" ||
+        output_format_ == "ILSVRC")
+      << "Unknown output format: " << output_format_;
+  for (int i = 0; i < kNumBatches; ++i) {
+    free_.push(new Batch());
+  }
+  batch_ = free_.pop();
+  batch_->end_of_pass = false;
+  batch_->stop = false;
+  StartInternalThread();
+}
+
+DetectionWriter::~DetectionWriter() {
+  batch_->stop = true;
+  full_.push(batch_);
+  // All the batches are back once the thread has written the stop batch, so
+  // it is not interrupted while it still has something to write.
+  vector<Batch*> batches;
+  for (int i = 0; i < kNumBatches; ++i) {
+    batches.push_back(free_.pop());
+  }
+  StopInternalThread();
+  for (int i = 0; i < batches.size(); ++i) {
+    delete batches[i];
+  }
+}
+
+void DetectionWriter::AddImage(const string& name) {
+  batch_->images.push_back(name);
+}
+
+void DetectionWriter::AddDetection(int label, float score, float xmin,
+    float ymin, float xmax, float ymax) {
+  CHECK(!batch_->images.empty()) << "AddImage must be called first.";
+  Detection detection;
+  detection.image = batch_->images.size() - 1;
+  detection.label = label;
+  detection.score = score;
+  detection.bbox[0] = xmin;
+  detection.bbox[1] = ymin;
+  detection.bbox[2] = xmax;
+  detection.bbox[3] = ymax;
+  batch_->detections.push_back(detection);
+}
+
+void DetectionWriter::Commit(bool end_of_pass) {
+  if (batch_->images.empty() && !end_of_pass) {
+    return;
+  }
+  batch_->end_of_pass = end_of_pass;
+  full_.push(batch_);
+  batch_ = free_.pop("Waiting for detections to be written");
+  batch_->images.clear();
+  batch_->detections.clear();
+  batch_->end_of_pass = false;
+  batch_->stop = false;
+}
+
+void DetectionWriter::InternalThreadEntry() {
+  bool stop = false;
+  while (!stop) {
+    Batch* batch = full_.pop();
+    if (!batch->images.empty() || batch->end_of_pass) {
+      if (!is_open_) {
+        Open();
+      }
+      Write(*batch);
+    }
+    if (batch->end_of_pass || batch->stop) {
+      Close();
+    }
+    stop = batch->stop;
+    free_.push(batch);
+  }
+}
+
+void DetectionWriter::Open() {
+  boost::filesystem::path output_directory(output_directory_);
+  outfiles_.clear();
+  if (output_format_ == "VOC") {
+    outfiles_.resize(num_classes_);
+    for (int c = 0; c < num_classes_; ++c) {
+      if (c == background_label_id_ ||
+          label_to_name_.find(c) == label_to_name_.end()) {
+        continue;
+      }
+      boost::filesystem::path file(
+          output_name_prefix_ + label_to_name_[c] + ".txt");
+      boost::filesystem::path out_file = output_directory / file;
+      outfiles_[c].reset(new std::ofstream(out_file.string().c_str(),
+          std::ofstream::out));
+    }
+  } else {
+    boost::filesystem::path file(output_name_prefix_ +
+        (output_format_ == "COCO" ? ".json" : ".txt"));
+    boost::filesystem::path out_file = output_directory / file;
+    outfiles_.push_back(shared_ptr<std::ofstream>(
+        new std::ofstream(out_file.string().c_str(), std::ofstream::out)));
+    if (output_format_ == "COCO") {
+      *outfiles_[0] << "[";
+    }
+  }
+  for (int i = 0; i < outfiles_.size(); ++i) {
+    if (outfiles_[i]) {
+      CHECK(outfiles_[i]->good()) << "Failed to open output file in "
+          << output_directory_;
+    }
+  }
+  num_written_ = 0;
+  is_open_ = true;
+}
+
+void DetectionWriter::Write(const Batch& batch) {
+  for (int i = 0; i < batch.detections.size(); ++i) {
+    const Detection& det = batch.detections[i];
+    const string& image_name = batch.images[det.image];
+    float bbox[4];
+    RoundBBox(det.bbox, bbox);
+    if (output_format_ == "COCO") {
+      std::ofstream& outfile = *outfiles_[0];
+      outfile << (num_written_ > 0 ? ",\n" : "\n");
+      outfile << "{\"image_id\": ";
+      WriteJsonValue(image_name, &outfile);
+      outfile << ", \"category_id\": ";
+      WriteJsonValue(label_to_name_[det.label], &outfile);
+      outfile << ", \"bbox\": [" << bbox[0] << ", " << bbox[1] << ", "
+          << bbox[2] << ", " << bbox[3] << "], \"score\": " << det.score
+          << "}";
+    } else {
+      std::ofstream* outfile;
+      if (output_format_ == "VOC") {
+        if (det.label < 0 || det.label >= num_classes_ ||
+            !outfiles_[det.label]) {
+          LOG(WARNING) << "Cannot find output file of label " << det.label;
+          continue;
+        }
+        outfile = outfiles_[det.label].get();
+        *outfile << image_name;
+      } else {
+        outfile = outfiles_[0].get();
+        *outfile << image_name << " " << det.label;
+      }
+      const int xmin = static_cast<int>(bbox[0]);
+      const int ymin = static_cast<int>(bbox[1]);
+      *outfile << " " << det.score << " " << xmin << " " << ymin << " "
+          << xmin + static_cast<int>(bbox[2]) << " "
+          << ymin + static_cast<int>(bbox[3]) << "\n";
+    }
+    ++num_written_;
+  }
+}
+
+void DetectionWriter::Close() {
+  if (!is_open_) {
+    return;
+  }
+  if (output_format_ == "COCO") {
+    *outfiles_[0] << "\n]\n";
+  }
+  for (int i = 0; i < outfiles_.size(); ++i) {
+    if (outfiles_[i]) {
+      outfiles_[i]->close();
+    }
+  }
+  outfiles_.clear();
+  is_open_ = false;
+}
+
+}  // namespace caffe
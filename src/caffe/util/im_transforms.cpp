@@ -20,6 +20,7 @@
 
 #include "caffe/util/im_transforms.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
@@ -676,56 +677,139 @@ void RandomOrderChannels(const cv::Mat& in_img, cv::Mat* out_img,
     CHECK_EQ(channels.size(), 3);
 
     // Shuffle the channels.
-    std::random_shuffle(channels.begin(), channels.end());
+    shuffle(channels.begin(), channels.end(), caffe_rng());
     cv::merge(channels, *out_img);
   } else {
     *out_img = in_img;
   }
 }
 
-cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
-  cv::Mat out_img = in_img;
-  float prob;
-  caffe_rng_uniform(1, 0.f, 1.f, &prob);
-
-  if (prob > 0.5) {
-    // Do random brightness distortion.
-    RandomBrightness(out_img, &out_img, param.brightness_prob(),
-                     param.brightness_delta());
-
-    // Do random contrast distortion.
-    RandomContrast(out_img, &out_img, param.contrast_prob(),
-                   param.contrast_lower(), param.contrast_upper());
-
-    // Do random saturation distortion.
-    RandomSaturation(out_img, &out_img, param.saturation_prob(),
-                     param.saturation_lower(), param.saturation_upper());
-
-    // Do random hue distortion.
-    RandomHue(out_img, &out_img, param.hue_prob(), param.hue_delta());
-
-    // Do random reordering of the channels.
-    RandomOrderChannels(out_img, &out_img, param.random_order_prob());
-  } else {
-    // Do random brightness distortion.
-    RandomBrightness(out_img, &out_img, param.brightness_prob(),
-                     param.brightness_delta());
+// Draws whether a random distortion is applied with probability prob, and
+// its amount within [lower, upper], as the Random* functions do.
+static bool RandomDistortion(const float prob, const float lower,
+                             const float upper, float* delta) {
+  float p;
+  caffe_rng_uniform(1, 0.f, 1.f, &p);
+  if (p < prob) {
+    CHECK_GE(upper, lower) << "upper must be >= lower.";
+    caffe_rng_uniform(1, lower, upper, delta);
+    return true;
+  }
+  return false;
+}
 
-    // Do random saturation distortion.
-    RandomSaturation(out_img, &out_img, param.saturation_prob(),
-                     param.saturation_lower(), param.saturation_upper());
+// Composes the lookup table with v -> alpha * v + beta, saturated as
+// cv::Mat::convertTo does. stride steps over the channels of the table.
+static void ComposeAffineLUT(const float alpha, const float beta,
+                             const int stride, uchar* lut) {
+  for (int i = 0; i < 256; ++i) {
+    lut[i * stride] = cv::saturate_cast<uchar>(lut[i * stride] * alpha + beta);
+  }
+}
 
-    // Do random hue distortion.
-    RandomHue(out_img, &out_img, param.hue_prob(), param.hue_delta());
+static cv::Mat IdentityLUT(const int channels) {
+  cv::Mat lut(1, 256, CV_8UC(channels));
+  uchar* data = lut.ptr<uchar>();
+  for (int i = 0; i < 256; ++i) {
+    for (int c = 0; c < channels; ++c) {
+      data[i * channels + c] = i;
+    }
+  }
+  return lut;
+}
 
-    // Do random contrast distortion.
-    RandomContrast(out_img, &out_img, param.contrast_prob(),
-                   param.contrast_lower(), param.contrast_upper());
+// Draws the random contrast distortion into lut. Returns whether lut changed.
+static bool RandomContrastLUT(const DistortionParameter& param,
+                              cv::Mat* lut) {
+  float delta;
+  if (RandomDistortion(param.contrast_prob(), param.contrast_lower(),
+                       param.contrast_upper(), &delta)) {
+    CHECK_GE(param.contrast_lower(), 0)
+        << "contrast lower must be non-negative.";
+    if (fabs(delta - 1.f) > 1e-3) {
+      ComposeAffineLUT(delta, 0, 1, lut->ptr<uchar>());
+      return true;
+    }
+  }
+  return false;
+}
 
-    // Do random reordering of the channels.
-    RandomOrderChannels(out_img, &out_img, param.random_order_prob());
+cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
+  // Draw the distortions in the same order as the Random* functions. Then
+  // apply brightness and contrast as one lookup table, and saturation and
+  // hue in a single trip through HSV, instead of a new image per step.
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool contrast_first = prob > 0.5;
+
+  // Lookup tables applied before and after HSV, and in HSV.
+  cv::Mat pre_lut = IdentityLUT(1);
+  cv::Mat post_lut = IdentityLUT(1);
+  cv::Mat hsv_lut = IdentityLUT(3);
+  bool has_pre_lut = false;
+  bool has_post_lut = false;
+  bool has_hsv_lut = false;
+  float delta;
+
+  // Do random brightness distortion.
+  if (RandomDistortion(param.brightness_prob(), -param.brightness_delta(),
+                       param.brightness_delta(), &delta) && fabs(delta) > 0) {
+    ComposeAffineLUT(1, delta, 1, pre_lut.ptr<uchar>());
+    has_pre_lut = true;
+  }
+  if (contrast_first) {
+    has_pre_lut |= RandomContrastLUT(param, &pre_lut);
+  }
+  // Do random saturation distortion.
+  if (RandomDistortion(param.saturation_prob(), param.saturation_lower(),
+                       param.saturation_upper(), &delta)) {
+    CHECK_GE(param.saturation_lower(), 0)
+        << "saturation lower must be non-negative.";
+    ComposeAffineLUT(delta, 0, 3, hsv_lut.ptr<uchar>() + 1);
+    has_hsv_lut = true;
+  }
+  // Do random hue distortion.
+  if (RandomDistortion(param.hue_prob(), -param.hue_delta(),
+                       param.hue_delta(), &delta) && fabs(delta) > 0) {
+    ComposeAffineLUT(1, delta, 3, hsv_lut.ptr<uchar>());
+    has_hsv_lut = true;
+  }
+  if (!contrast_first) {
+    has_post_lut = RandomContrastLUT(param, &post_lut);
+  }
+  // Do random reordering of the channels.
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool order_channels = prob < param.random_order_prob();
+  int order[] = {0, 1, 2};
+  if (order_channels) {
+    CHECK_EQ(in_img.channels(), 3);
+    shuffle(order, order + 3, caffe_rng());
   }
 
+  // Only write in place once out_img no longer shares in_img.
+  cv::Mat out_img = in_img;
+  if (has_pre_lut) {
+    out_img = cv::Mat();
+    cv::LUT(in_img, pre_lut, out_img);
+  }
+  if (has_hsv_lut) {
+    cv::Mat hsv_img;
+    cv::cvtColor(out_img, hsv_img, CV_BGR2HSV);
+    cv::LUT(hsv_img, hsv_lut, hsv_img);
+    cv::cvtColor(hsv_img, hsv_img, CV_HSV2BGR);
+    out_img = hsv_img;
+  }
+  if (has_post_lut) {
+    cv::Mat post_img = out_img.data == in_img.data ? cv::Mat() : out_img;
+    cv::LUT(out_img, post_lut, post_img);
+    out_img = post_img;
+  }
+  if (order_channels) {
+    cv::Mat ordered_img(out_img.size(), out_img.type());
+    const int from_to[] = {order[0], 0, order[1], 1, order[2], 2};
+    cv::mixChannels(&out_img, 1, &ordered_img, 1, from_to, 3);
+    out_img = ordered_img;
+  }
   return out_img;
 }
 #endif  // USE_OPENCV
@@ -1,6 +1,7 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -373,4 +374,222 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+template <typename Dtype>
+void caffe_cpu_csrmv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+    const Dtype alpha, const Dtype* csrval, const int* csrrowptr,
+    const int* csrcolind, const int nnz, const Dtype* x, const Dtype beta,
+    Dtype* y) {
+  CHECK_EQ(csrrowptr[M], nnz);
+  if (TransA == CblasNoTrans) {
+    // y = alpha * A * x + beta * y: one sparse dot product per row.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 32)
+#endif
+    for (int i = 0; i < M; ++i) {
+      Dtype sum = 0;
+      for (int j = csrrowptr[i]; j < csrrowptr[i + 1]; ++j) {
+        sum += csrval[j] * x[csrcolind[j]];
+      }
+      y[i] = (beta == 0) ? alpha * sum : alpha * sum + beta * y[i];
+    }
+  } else {
+    // y = alpha * A^T * x + beta * y: row i of A scatters alpha * x[i].
+    if (beta == 0) {
+      caffe_set(N, Dtype(0), y);
+    } else if (beta != 1) {
+      caffe_scal(N, beta, y);
+    }
+    for (int i = 0; i < M; ++i) {
+      const Dtype a = alpha * x[i];
+      for (int j = csrrowptr[i]; j < csrrowptr[i + 1]; ++j) {
+        y[csrcolind[j]] += a * csrval[j];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_csrmv<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const float alpha, const float* csrval,
+    const int* csrrowptr, const int* csrcolind, const int nnz,
+    const float* x, const float beta, float* y);
+template void caffe_cpu_csrmv<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const double alpha, const double* csrval,
+    const int* csrrowptr, const int* csrcolind, const int nnz,
+    const double* x, const double beta, double* y);
+
+template <typename Dtype>
+void caffe_cpu_csrmm(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+    const int K, const Dtype alpha, const Dtype* csrval, const int* csrrowptr,
+    const int* csrcolind, const Dtype* B, const Dtype beta, Dtype* C) {
+  if (beta == 0) {
+    caffe_set(M * N, Dtype(0), C);
+  } else if (beta != 1) {
+    caffe_scal(M * N, beta, C);
+  }
+  if (TransA == CblasNoTrans) {
+    // A is M x K. Row i of C accumulates the rows of B picked out by the
+    // non-zeros of row i of A; the inner loop is a contiguous axpy over N.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (int i = 0; i < M; ++i) {
+      Dtype* c = C + i * N;
+      for (int j = csrrowptr[i]; j < csrrowptr[i + 1]; ++j) {
+        const Dtype a = alpha * csrval[j];
+        const Dtype* b = B + csrcolind[j] * N;
+        for (int n = 0; n < N; ++n) {
+          c[n] += a * b[n];
+        }
+      }
+    }
+  } else {
+    // A is K x M. Row k of A scatters row k of B into the rows of C named by
+    // its column indices, so threads own disjoint column panels of C.
+    const int kPanel = 256;
+    const int num_panels = (N + kPanel - 1) / kPanel;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int p = 0; p < num_panels; ++p) {
+      const int n_begin = p * kPanel;
+      const int n_end = std::min(N, n_begin + kPanel);
+      for (int k = 0; k < K; ++k) {
+        const Dtype* b = B + k * N;
+        for (int j = csrrowptr[k]; j < csrrowptr[k + 1]; ++j) {
+          const Dtype a = alpha * csrval[j];
+          Dtype* c = C + csrcolind[j] * N;
+          for (int n = n_begin; n < n_end; ++n) {
+            c[n] += a * b[n];
+          }
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_csrmm<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const int K, const float alpha,
+    const float* csrval, const int* csrrowptr, const int* csrcolind,
+    const float* B, const float beta, float* C);
+template void caffe_cpu_csrmm<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const int K, const double alpha,
+    const double* csrval, const int* csrrowptr, const int* csrcolind,
+    const double* B, const double beta, double* C);
+
+template <typename Dtype>
+int caffe_cpu_dense2csr(const int M, const int N, const Dtype* A,
+    Dtype* csrval, int* csrrowptr, int* csrcolind) {
+  csrrowptr[0] = 0;
+  for (int i = 0; i < M; ++i) {
+    const Dtype* a = A + i * N;
+    int row_nnz = 0;
+    for (int j = 0; j < N; ++j) {
+      row_nnz += (a[j] != 0);
+    }
+    csrrowptr[i + 1] = csrrowptr[i] + row_nnz;
+  }
+  if (csrval && csrcolind) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < M; ++i) {
+      const Dtype* a = A + i * N;
+      int k = csrrowptr[i];
+      for (int j = 0; j < N; ++j) {
+        if (a[j] != 0) {
+          csrval[k] = a[j];
+          csrcolind[k] = j;
+          ++k;
+        }
+      }
+    }
+  }
+  return csrrowptr[M];
+}
+
+template int caffe_cpu_dense2csr<float>(const int M, const int N,
+    const float* A, float* csrval, int* csrrowptr, int* csrcolind);
+template int caffe_cpu_dense2csr<double>(const int M, const int N,
+    const double* A, double* csrval, int* csrrowptr, int* csrcolind);
+
+template <typename Dtype>
+void caffe_cpu_transpose(const int rows, const int cols, const Dtype* A,
+    Dtype* B) {
+  caffe_cpu_batch_transpose(1, rows, cols, A, B);
+}
+
+template void caffe_cpu_transpose<float>(const int rows, const int cols,
+    const float* A, float* B);
+template void caffe_cpu_transpose<double>(const int rows, const int cols,
+    const double* A, double* B);
+
+template <typename Dtype>
+void caffe_cpu_batch_transpose(const int num, const int rows, const int cols,
+    const Dtype* A, Dtype* B) {
+  // Square tiles keep both the reads and the strided writes in cache.
+  const int kTile = 32;
+  const int row_tiles = (rows + kTile - 1) / kTile;
+  const int col_tiles = (cols + kTile - 1) / kTile;
+  const int dim = rows * cols;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int t = 0; t < num * row_tiles * col_tiles; ++t) {
+    const int n = t / (row_tiles * col_tiles);
+    const int r0 = (t / col_tiles) % row_tiles * kTile;
+    const int r1 = std::min(rows, r0 + kTile);
+    const int c0 = t % col_tiles * kTile;
+    const int c1 = std::min(cols, c0 + kTile);
+    const Dtype* a = A + n * dim;
+    Dtype* b = B + n * dim;
+    // Write the rows of the tile of B contiguously.
+    for (int c = c0; c < c1; ++c) {
+#if defined(_OPENMP) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+      for (int r = r0; r < r1; ++r) {
+        b[c * rows + r] = a[r * cols + c];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_batch_transpose<float>(const int num, const int rows,
+    const int cols, const float* A, float* B);
+template void caffe_cpu_batch_transpose<double>(const int num,
+    const int rows, const int cols, const double* A, double* B);
+
+template <typename Dtype>
+void caffe_cpu_bitmask_axpy(const int N, const Dtype alpha, const Dtype* X,
+    const uint32_t* mask, Dtype* Y) {
+  const int words = (N + 31) / 32;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int w = 0; w < words; ++w) {
+    const int begin = w * 32;
+    const int end = std::min(N, begin + 32);
+    const uint32_t bits = mask[w];
+    if (bits == 0) {
+      // Fully pruned word: nothing to read.
+      for (int i = begin; i < end; ++i) {
+        Y[i] = 0;
+      }
+    } else if (bits == 0xFFFFFFFFu) {
+      for (int i = begin; i < end; ++i) {
+        Y[i] += alpha * X[i];
+      }
+    } else {
+      for (int i = begin; i < end; ++i) {
+        Y[i] = ((bits >> (i - begin)) & 1u) ? Y[i] + alpha * X[i] : Dtype(0);
+      }
+    }
+  }
+}
+
+template void caffe_cpu_bitmask_axpy<float>(const int N, const float alpha,
+    const float* X, const uint32_t* mask, float* Y);
+template void caffe_cpu_bitmask_axpy<double>(const int N, const double alpha,
+    const double* X, const uint32_t* mask, double* Y);
+
 }  // namespace caffe
@@ -272,6 +272,31 @@ void caffe_gpu_mul<double>(const int N, const double* a,
       N, a, b, y);
 }
 
+template <typename Dtype>
+__global__ void bitmask_axpy_kernel(const int n, const Dtype alpha,
+    const Dtype* x, const uint32_t* mask, Dtype* y) {
+  CUDA_KERNEL_LOOP(index, n) {
+    y[index] = ((mask[index >> 5] >> (index & 31)) & 1) ?
+        y[index] + alpha * x[index] : Dtype(0);
+  }
+}
+
+template <>
+void caffe_gpu_bitmask_axpy<float>(const int N, const float alpha,
+    const float* X, const uint32_t* mask, float* Y) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  bitmask_axpy_kernel<float><<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, alpha, X, mask, Y);
+}
+
+template <>
+void caffe_gpu_bitmask_axpy<double>(const int N, const double alpha,
+    const double* X, const uint32_t* mask, double* Y) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  bitmask_axpy_kernel<double><<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, alpha, X, mask, Y);
+}
+
 template <typename Dtype>
 __global__ void div_kernel(const int n, const Dtype* a,
     const Dtype* b, Dtype* y) {
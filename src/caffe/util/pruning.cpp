@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/pruning.hpp"
+
+namespace caffe {
+
+bool IsPruningIter(const PruningParameter& param, const int iter) {
+  if (iter < param.start_iter() || iter > param.end_iter()) {
+    return false;
+  }
+  return (iter - param.start_iter()) % param.frequency() == 0 ||
+      iter == param.end_iter();
+}
+
+float PruningSparsity(const PruningParameter& param, const int iter) {
+  if (iter <= param.start_iter()) {
+    return param.initial_sparsity();
+  }
+  if (iter >= param.end_iter()) {
+    return param.target_sparsity();
+  }
+  // The mask only changes at pruning iterations.
+  const int last_iter = iter - (iter - param.start_iter()) % param.frequency();
+  const float progress = static_cast<float>(last_iter - param.start_iter()) /
+      (param.end_iter() - param.start_iter());
+  return param.target_sparsity() +
+      (param.initial_sparsity() - param.target_sparsity()) *
+      std::pow(1.f - progress, param.power());
+}
+
+// Number of the n items to prune for the given sparsity.
+static int NumPruned(const float sparsity, const int n) {
+  const int num = static_cast<int>(static_cast<double>(sparsity) * n + 0.5);
+  return std::max(0, std::min(n, num));
+}
+
+template <typename Dtype>
+int PruneBlob(const PruningParameter::Criterion criterion,
+              const float sparsity, Blob<Dtype>* blob) {
+  CHECK_EQ(blob->sparsity_mode(), SparsityParameter::PRUNE)
+      << "Only blobs in PRUNE mode have a mask to update.";
+  const int count = blob->count();
+  Dtype* data = blob->mutable_cpu_data();
+  uint32_t* mask = blob->mutable_cpu_mask();
+  switch (criterion) {
+  case PruningParameter_Criterion_MAGNITUDE: {
+    // The mask is rebuilt from scratch. Weights pruned earlier are zero, so
+    // they stay pruned as long as the schedule does not decrease.
+    const int num_pruned = NumPruned(sparsity, count);
+    Dtype threshold = 0;
+    int num_ties = 0;
+    if (num_pruned > 0) {
+      vector<Dtype> magnitude(count);
+      for (int i = 0; i < count; ++i) {
+        magnitude[i] = std::fabs(data[i]);
+      }
+      std::nth_element(magnitude.begin(), magnitude.begin() + num_pruned - 1,
+                       magnitude.end());
+      threshold = magnitude[num_pruned - 1];
+      // Everything below the threshold is pruned; weights equal to it are
+      // pruned in index order until num_pruned is reached.
+      num_ties = num_pruned;
+      for (int i = 0; i < num_pruned; ++i) {
+        num_ties -= (magnitude[i] < threshold);
+      }
+    }
+    caffe_memset(blob->mask_words() * sizeof(uint32_t), 0, mask);
+    for (int i = 0; i < count; ++i) {
+      const Dtype value = std::fabs(data[i]);
+      if (num_pruned > 0 && (value < threshold ||
+          (value == threshold && num_ties-- > 0))) {
+        data[i] = 0;
+      } else {
+        mask[i >> 5] |= 1u << (i & 31);
+      }
+    }
+    break;
+  }
+  case PruningParameter_Criterion_CHANNEL_L1: {
+    // Rows are output channels (InnerProduct outputs, convolution filters).
+    // Only rows are pruned; the mask bits of the kept rows are left as is.
+    const int rows = blob->shape(0);
+    const int cols = count / rows;
+    vector<std::pair<Dtype, int> > l1(rows);
+    for (int r = 0; r < rows; ++r) {
+      l1[r] = std::make_pair(caffe_cpu_asum(cols, data + r * cols), r);
+    }
+    std::sort(l1.begin(), l1.end());
+    const int num_pruned = NumPruned(sparsity, rows);
+    for (int k = 0; k < num_pruned; ++k) {
+      const int r = l1[k].second;
+      caffe_set(cols, Dtype(0), data + r * cols);
+      for (int i = r * cols; i < (r + 1) * cols; ++i) {
+        mask[i >> 5] &= ~(1u << (i & 31));
+      }
+    }
+    break;
+  }
+  case PruningParameter_Criterion_INPUT_CHANNEL_L1: {
+    // Axis 1 holds the input channels; each spans the trailing axes of
+    // every row.
+    const int rows = blob->shape(0);
+    const int channels = blob->shape(1);
+    const int inner = blob->count(2);
+    vector<std::pair<Dtype, int> > l1(channels);
+    for (int c = 0; c < channels; ++c) {
+      Dtype sum = 0;
+      for (int r = 0; r < rows; ++r) {
+        sum += caffe_cpu_asum(inner, data + (r * channels + c) * inner);
+      }
+      l1[c] = std::make_pair(sum, c);
+    }
+    std::sort(l1.begin(), l1.end());
+    const int num_pruned = NumPruned(sparsity, channels);
+    for (int k = 0; k < num_pruned; ++k) {
+      const int c = l1[k].second;
+      for (int r = 0; r < rows; ++r) {
+        const int offset = (r * channels + c) * inner;
+        caffe_set(inner, Dtype(0), data + offset);
+        for (int i = offset; i < offset + inner; ++i) {
+          mask[i >> 5] &= ~(1u << (i & 31));
+        }
+      }
+    }
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown pruning criterion: " << criterion;
+  }
+  return blob->mask_nnz();
+}
+
+template int PruneBlob(const PruningParameter::Criterion criterion,
+                       const float sparsity, Blob<float>* blob);
+template int PruneBlob(const PruningParameter::Criterion criterion,
+                       const float sparsity, Blob<double>* blob);
+
+}  // namespace caffe
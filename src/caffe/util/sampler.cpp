@@ -8,9 +8,14 @@ namespace caffe {
 
 void GroupObjectBBoxes(const AnnotatedDatum& anno_datum,
                        vector<NormalizedBBox>* object_bboxes) {
+  GroupObjectBBoxes(anno_datum.annotation_group(), object_bboxes);
+}
+
+void GroupObjectBBoxes(const RepeatedPtrField<AnnotationGroup>& anno_groups,
+                       vector<NormalizedBBox>* object_bboxes) {
   object_bboxes->clear();
-  for (int i = 0; i < anno_datum.annotation_group_size(); ++i) {
-    const AnnotationGroup& anno_group = anno_datum.annotation_group(i);
+  for (int i = 0; i < anno_groups.size(); ++i) {
+    const AnnotationGroup& anno_group = anno_groups.Get(i);
     for (int j = 0; j < anno_group.annotation_size(); ++j) {
       const Annotation& anno = anno_group.annotation(j);
       object_bboxes->push_back(anno.bbox());
@@ -83,7 +88,120 @@ bool SatisfySampleConstraint(const NormalizedBBox& sampled_bbox,
   return found;
 }
 
+SampleConstraintChecker::SampleConstraintChecker(
+    const vector<NormalizedBBox>& object_bboxes) {
+  const int num = object_bboxes.size();
+  xmin_.resize(num);
+  ymin_.resize(num);
+  xmax_.resize(num);
+  ymax_.resize(num);
+  size_.resize(num);
+  intersect_size_.resize(num);
+  for (int i = 0; i < num; ++i) {
+    const NormalizedBBox& bbox = object_bboxes[i];
+    xmin_[i] = bbox.xmin();
+    ymin_[i] = bbox.ymin();
+    xmax_[i] = bbox.xmax();
+    ymax_[i] = bbox.ymax();
+    size_[i] = BBoxSize(bbox);
+  }
+}
+
+bool SampleConstraintChecker::Satisfy(const float* sampled_bbox,
+    const SampleConstraint& sample_constraint) {
+  bool has_jaccard_overlap = sample_constraint.has_min_jaccard_overlap() ||
+      sample_constraint.has_max_jaccard_overlap();
+  bool has_sample_coverage = sample_constraint.has_min_sample_coverage() ||
+      sample_constraint.has_max_sample_coverage();
+  bool has_object_coverage = sample_constraint.has_min_object_coverage() ||
+      sample_constraint.has_max_object_coverage();
+  if (!has_jaccard_overlap && !has_sample_coverage && !has_object_coverage) {
+    // By default, the sampled_bbox is "positive" if no constraints are defined.
+    return true;
+  }
+  const int num = size_.size();
+  if (num == 0) {
+    return false;
+  }
+  const float sampled_xmin = sampled_bbox[0];
+  const float sampled_ymin = sampled_bbox[1];
+  const float sampled_xmax = sampled_bbox[2];
+  const float sampled_ymax = sampled_bbox[3];
+  const float sampled_size = BBoxSize(sampled_bbox);
+  // Intersect with all the object bboxes at once.
+  const float* xmin = &xmin_[0];
+  const float* ymin = &ymin_[0];
+  const float* xmax = &xmax_[0];
+  const float* ymax = &ymax_[0];
+  float* intersect_size = &intersect_size_[0];
+  for (int i = 0; i < num; ++i) {
+    const float width = std::min(sampled_xmax, xmax[i]) -
+        std::max(sampled_xmin, xmin[i]);
+    const float height = std::min(sampled_ymax, ymax[i]) -
+        std::max(sampled_ymin, ymin[i]);
+    intersect_size[i] = (width > 0 && height > 0) ? width * height : 0.f;
+  }
+  // Check constraints, the same way as SatisfySampleConstraint.
+  bool found = false;
+  for (int i = 0; i < num; ++i) {
+    const float inter = intersect_size[i];
+    // Test jaccard overlap.
+    if (has_jaccard_overlap) {
+      const float jaccard_overlap = inter > 0 ?
+          inter / (sampled_size + size_[i] - inter) : 0.f;
+      if (sample_constraint.has_min_jaccard_overlap() &&
+          jaccard_overlap < sample_constraint.min_jaccard_overlap()) {
+        continue;
+      }
+      if (sample_constraint.has_max_jaccard_overlap() &&
+          jaccard_overlap > sample_constraint.max_jaccard_overlap()) {
+        continue;
+      }
+      found = true;
+    }
+    // Test sample coverage.
+    if (has_sample_coverage) {
+      const float sample_coverage = inter > 0 ? inter / sampled_size : 0.f;
+      if (sample_constraint.has_min_sample_coverage() &&
+          sample_coverage < sample_constraint.min_sample_coverage()) {
+        continue;
+      }
+      if (sample_constraint.has_max_sample_coverage() &&
+          sample_coverage > sample_constraint.max_sample_coverage()) {
+        continue;
+      }
+      found = true;
+    }
+    // Test object coverage.
+    if (has_object_coverage) {
+      const float object_coverage = inter > 0 ? inter / size_[i] : 0.f;
+      if (sample_constraint.has_min_object_coverage() &&
+          object_coverage < sample_constraint.min_object_coverage()) {
+        continue;
+      }
+      if (sample_constraint.has_max_object_coverage() &&
+          object_coverage > sample_constraint.max_object_coverage()) {
+        continue;
+      }
+      found = true;
+    }
+    if (found) {
+      return true;
+    }
+  }
+  return found;
+}
+
 void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox) {
+  float bbox[4];
+  SampleBBox(sampler, bbox);
+  sampled_bbox->set_xmin(bbox[0]);
+  sampled_bbox->set_ymin(bbox[1]);
+  sampled_bbox->set_xmax(bbox[2]);
+  sampled_bbox->set_ymax(bbox[3]);
+}
+
+void SampleBBox(const Sampler& sampler, float* sampled_bbox) {
   // Get random scale.
   CHECK_GE(sampler.max_scale(), sampler.min_scale());
   CHECK_GT(sampler.min_scale(), 0.);
@@ -102,25 +220,38 @@ void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox) {
   aspect_ratio = std::max<float>(aspect_ratio, std::pow(scale, 2.));
   aspect_ratio = std::min<float>(aspect_ratio, 1 / std::pow(scale, 2.));
 
-  // Figure out bbox dimension.
-  float bbox_width = scale * sqrt(aspect_ratio);
-  float bbox_height = scale / sqrt(aspect_ratio);
+  // Figure out bbox dimension. Rounding may push a side of a bbox with the
+  // largest aspect ratio allowed by its scale slightly above 1.
+  float bbox_width = std::min<float>(scale * sqrt(aspect_ratio), 1);
+  float bbox_height = std::min<float>(scale / sqrt(aspect_ratio), 1);
 
   // Figure out top left coordinates.
   float w_off, h_off;
   caffe_rng_uniform(1, 0.f, 1 - bbox_width, &w_off);
   caffe_rng_uniform(1, 0.f, 1 - bbox_height, &h_off);
 
-  sampled_bbox->set_xmin(w_off);
-  sampled_bbox->set_ymin(h_off);
-  sampled_bbox->set_xmax(w_off + bbox_width);
-  sampled_bbox->set_ymax(h_off + bbox_height);
+  sampled_bbox[0] = w_off;
+  sampled_bbox[1] = h_off;
+  sampled_bbox[2] = w_off + bbox_width;
+  sampled_bbox[3] = h_off + bbox_height;
 }
 
 void GenerateSamples(const NormalizedBBox& source_bbox,
                      const vector<NormalizedBBox>& object_bboxes,
                      const BatchSampler& batch_sampler,
                      vector<NormalizedBBox>* sampled_bboxes) {
+  SampleConstraintChecker checker(object_bboxes);
+  GenerateSamples(source_bbox, &checker, batch_sampler, sampled_bboxes);
+}
+
+void GenerateSamples(const NormalizedBBox& source_bbox,
+                     SampleConstraintChecker* checker,
+                     const BatchSampler& batch_sampler,
+                     vector<NormalizedBBox>* sampled_bboxes) {
+  const float src_xmin = source_bbox.xmin();
+  const float src_ymin = source_bbox.ymin();
+  const float src_width = source_bbox.xmax() - source_bbox.xmin();
+  const float src_height = source_bbox.ymax() - source_bbox.ymin();
   int found = 0;
   for (int i = 0; i < batch_sampler.max_trials(); ++i) {
     if (batch_sampler.has_max_sample() &&
@@ -128,15 +259,24 @@ void GenerateSamples(const NormalizedBBox& source_bbox,
       break;
     }
     // Generate sampled_bbox in the normalized space [0, 1].
-    NormalizedBBox sampled_bbox;
-    SampleBBox(batch_sampler.sampler(), &sampled_bbox);
-    // Transform the sampled_bbox w.r.t. source_bbox.
-    LocateBBox(source_bbox, sampled_bbox, &sampled_bbox);
+    float sampled_bbox[4];
+    SampleBBox(batch_sampler.sampler(), sampled_bbox);
+    // Transform the sampled_bbox w.r.t. source_bbox, as LocateBBox does.
+    float loc_bbox[4];
+    loc_bbox[0] = src_xmin + sampled_bbox[0] * src_width;
+    loc_bbox[1] = src_ymin + sampled_bbox[1] * src_height;
+    loc_bbox[2] = src_xmin + sampled_bbox[2] * src_width;
+    loc_bbox[3] = src_ymin + sampled_bbox[3] * src_height;
     // Determine if the sampled bbox is positive or negative by the constraint.
-    if (SatisfySampleConstraint(sampled_bbox, object_bboxes,
-                                batch_sampler.sample_constraint())) {
+    if (checker->Satisfy(loc_bbox, batch_sampler.sample_constraint())) {
       ++found;
-      sampled_bboxes->push_back(sampled_bbox);
+      NormalizedBBox unit_bbox;
+      unit_bbox.set_xmin(sampled_bbox[0]);
+      unit_bbox.set_ymin(sampled_bbox[1]);
+      unit_bbox.set_xmax(sampled_bbox[2]);
+      unit_bbox.set_ymax(sampled_bbox[3]);
+      sampled_bboxes->push_back(NormalizedBBox());
+      LocateBBox(source_bbox, unit_bbox, &sampled_bboxes->back());
     }
   }
 }
@@ -144,9 +284,17 @@ void GenerateSamples(const NormalizedBBox& source_bbox,
 void GenerateBatchSamples(const AnnotatedDatum& anno_datum,
                           const vector<BatchSampler>& batch_samplers,
                           vector<NormalizedBBox>* sampled_bboxes) {
+  GenerateBatchSamples(anno_datum.annotation_group(), batch_samplers,
+                       sampled_bboxes);
+}
+
+void GenerateBatchSamples(const RepeatedPtrField<AnnotationGroup>& anno_groups,
+                          const vector<BatchSampler>& batch_samplers,
+                          vector<NormalizedBBox>* sampled_bboxes) {
   sampled_bboxes->clear();
   vector<NormalizedBBox> object_bboxes;
-  GroupObjectBBoxes(anno_datum, &object_bboxes);
+  GroupObjectBBoxes(anno_groups, &object_bboxes);
+  SampleConstraintChecker checker(object_bboxes);
   for (int i = 0; i < batch_samplers.size(); ++i) {
     if (batch_samplers[i].use_original_image()) {
       NormalizedBBox unit_bbox;
@@ -154,8 +302,7 @@ void GenerateBatchSamples(const AnnotatedDatum& anno_datum,
       unit_bbox.set_ymin(0);
       unit_bbox.set_xmax(1);
       unit_bbox.set_ymax(1);
-      GenerateSamples(unit_bbox, object_bboxes, batch_samplers[i],
-                      sampled_bboxes);
+      GenerateSamples(unit_bbox, &checker, batch_samplers[i], sampled_bboxes);
     }
   }
 }
@@ -0,0 +1,400 @@
+#include <cmath>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/shrink_net.hpp"
+
+namespace caffe {
+
+typedef vector<shared_ptr<Blob<float> > > BlobVec;
+
+// A layer reading the output of the layer being shrunk, directly or through
+// channel-wise layers, and the value a channel of constant output has there.
+struct ChannelUse {
+  int layer_id;
+  vector<float> value;
+};
+
+// Check if the layer computes a weighted sum over all input channels, i.e.
+// its output channels can be removed and its input channels sliced.
+static bool IsChannelLayer(const LayerParameter& layer) {
+  if (layer.type() == "Convolution") {
+    return layer.convolution_param().group() == 1;
+  }
+  if (layer.type() == "InnerProduct") {
+    return !layer.inner_product_param().transpose() &&
+        layer.inner_product_param().axis() == 1;
+  }
+  return false;
+}
+
+// Check if the layer only uses the shape of its inputs, not their values,
+// e.g. PriorBox which reads the size of the feature map.
+static bool IsShapeOnlyLayer(const LayerParameter& layer) {
+  return layer.type() == "PriorBox" || layer.type() == "Silence";
+}
+
+// Check if the layer is a padded Convolution or AVE Pooling, whose borders
+// see zeros instead of the constant value of a removed channel.
+static bool HasPadding(const LayerParameter& layer) {
+  if (layer.type() == "Pooling") {
+    const PoolingParameter& pool_param = layer.pooling_param();
+    return pool_param.pool() == PoolingParameter_PoolMethod_AVE &&
+        (pool_param.pad() > 0 || pool_param.pad_h() > 0 ||
+         pool_param.pad_w() > 0);
+  }
+  if (layer.type() != "Convolution") {
+    return false;
+  }
+  const ConvolutionParameter& conv_param = layer.convolution_param();
+  bool padded = conv_param.pad_h() > 0 || conv_param.pad_w() > 0;
+  for (int i = 0; i < conv_param.pad_size(); ++i) {
+    padded |= conv_param.pad(i) > 0;
+  }
+  return padded;
+}
+
+// Legacy 4D blobs pad their shape with leading ones, e.g. 1 x 1 x 1 x N
+// biases; drop them down to num_axes.
+static void SqueezeLegacyShape(const int num_axes, Blob<float>* blob) {
+  vector<int> shape = blob->shape();
+  while (shape.size() > num_axes && shape[0] == 1) {
+    shape.erase(shape.begin());
+  }
+  blob->Reshape(shape);
+}
+
+// Keep the given indices along one axis of the blob.
+static void KeepIndices(const int axis, const vector<int>& keep,
+                        Blob<float>* blob) {
+  vector<int> shape = blob->shape();
+  const int outer = blob->count(0, axis);
+  const int dim = shape[axis];
+  const int inner = blob->count(axis + 1);
+  shape[axis] = keep.size();
+  Blob<float> kept(shape);
+  const float* src = blob->cpu_data();
+  float* dst = kept.mutable_cpu_data();
+  for (int i = 0; i < outer; ++i) {
+    for (int k = 0; k < keep.size(); ++k) {
+      caffe_copy(inner, src + (i * dim + keep[k]) * inner,
+                 dst + (i * keep.size() + k) * inner);
+    }
+  }
+  blob->Reshape(shape);
+  caffe_copy(kept.count(), kept.cpu_data(), blob->mutable_cpu_data());
+}
+
+// Check if channel c of the input of a Convolution/InnerProduct layer with
+// the given weights is multiplied by zeros only.
+static bool InputChannelIsZero(const Blob<float>& weights, const int channels,
+                               const int c) {
+  const int outputs = weights.shape(0);
+  const int inner = weights.count() / (outputs * channels);
+  const float* data = weights.cpu_data();
+  for (int o = 0; o < outputs; ++o) {
+    const float* slice = data + (o * channels + c) * inner;
+    for (int i = 0; i < inner; ++i) {
+      if (slice[i] != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Compute the output value of a channel-wise layer for channels of constant
+// input value (TEST phase). Returns false for other layers.
+static bool PropagateValue(const LayerParameter& layer, const BlobVec& blobs,
+                           vector<float>* value) {
+  const string& type = layer.type();
+  const int channels = value->size();
+  if (type == "ReLU") {
+    const float slope = layer.relu_param().negative_slope();
+    for (int c = 0; c < channels; ++c) {
+      (*value)[c] = (*value)[c] > 0 ? (*value)[c] : (*value)[c] * slope;
+    }
+    return true;
+  }
+  if (type == "Dropout" || type == "Pooling" || type == "Normalize") {
+    // Normalize only passes channels whose value is zero; see ShrinkNet.
+    return true;
+  }
+  if (type == "BatchNorm") {
+    if (blobs.size() != 3 || blobs[0]->count() != channels) {
+      return false;
+    }
+    const float factor = blobs[2]->cpu_data()[0] == 0 ?
+        0 : 1 / blobs[2]->cpu_data()[0];
+    const float eps = layer.batch_norm_param().eps();
+    for (int c = 0; c < channels; ++c) {
+      const float mean = blobs[0]->cpu_data()[c] * factor;
+      const float variance = blobs[1]->cpu_data()[c] * factor;
+      (*value)[c] = ((*value)[c] - mean) / std::sqrt(variance + eps);
+    }
+    return true;
+  }
+  if (type == "Scale") {
+    if (blobs.empty() || blobs[0]->count() != channels) {
+      return false;
+    }
+    for (int c = 0; c < channels; ++c) {
+      (*value)[c] = (*value)[c] * blobs[0]->cpu_data()[c] +
+          (blobs.size() > 1 ? blobs[1]->cpu_data()[c] : 0);
+    }
+    return true;
+  }
+  return false;
+}
+
+// Slice the per-channel parameters of a channel-wise layer.
+static void KeepChannels(const LayerParameter& layer, const vector<int>& keep,
+                         BlobVec* blobs) {
+  if (layer.type() == "BatchNorm") {
+    KeepIndices(0, keep, (*blobs)[0].get());
+    KeepIndices(0, keep, (*blobs)[1].get());
+  } else if (layer.type() == "Scale") {
+    for (int i = 0; i < blobs->size(); ++i) {
+      KeepIndices(0, keep, (*blobs)[i].get());
+    }
+  } else if (layer.type() == "Normalize" &&
+             !layer.norm_param().channel_shared()) {
+    KeepIndices(0, keep, (*blobs)[0].get());
+  }
+}
+
+// Fold the contribution of the removed input channels of constant value into
+// the bias of a Convolution/InnerProduct layer, and slice its weights.
+static void KeepInputChannels(const vector<float>& value,
+                              const vector<int>& keep, LayerParameter* layer,
+                              BlobVec* blobs) {
+  Blob<float>* weights = (*blobs)[0].get();
+  const int outputs = weights->shape(0);
+  const int channels = value.size();
+  const int inner = weights->count() / (outputs * channels);
+  vector<bool> kept(channels, false);
+  for (int k = 0; k < keep.size(); ++k) {
+    kept[keep[k]] = true;
+  }
+  vector<float> shift(outputs, 0);
+  bool has_shift = false;
+  const float* data = weights->cpu_data();
+  for (int o = 0; o < outputs; ++o) {
+    for (int c = 0; c < channels; ++c) {
+      if (kept[c] || value[c] == 0) {
+        continue;
+      }
+      float sum = 0;
+      for (int i = 0; i < inner; ++i) {
+        sum += data[(o * channels + c) * inner + i];
+      }
+      shift[o] += value[c] * sum;
+      has_shift |= (shift[o] != 0);
+    }
+  }
+  if (has_shift) {
+    if (blobs->size() < 2) {
+      blobs->push_back(shared_ptr<Blob<float> >(
+          new Blob<float>(vector<int>(1, outputs))));
+      caffe_set(outputs, 0.f, (*blobs)[1]->mutable_cpu_data());
+      if (layer->type() == "Convolution") {
+        layer->mutable_convolution_param()->set_bias_term(true);
+      } else {
+        layer->mutable_inner_product_param()->set_bias_term(true);
+      }
+    }
+    caffe_axpy(outputs, 1.f, &shift[0], (*blobs)[1]->mutable_cpu_data());
+  }
+  if (weights->shape(1) == channels) {
+    KeepIndices(1, keep, weights);
+  } else {
+    // InnerProduct over flattened channels: each spans inner columns.
+    vector<int> columns;
+    for (int k = 0; k < keep.size(); ++k) {
+      for (int i = 0; i < inner; ++i) {
+        columns.push_back(keep[k] * inner + i);
+      }
+    }
+    KeepIndices(1, columns, weights);
+  }
+}
+
+int ShrinkNet(const NetParameter& param, const NetParameter& weights,
+              NetParameter* shrunk_param, NetParameter* shrunk_weights) {
+  shrunk_param->CopyFrom(param);
+  map<string, BlobVec> blobs;
+  for (int i = 0; i < weights.layer_size(); ++i) {
+    const LayerParameter& layer = weights.layer(i);
+    BlobVec& layer_blobs = blobs[layer.name()];
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& proto = layer.blobs(j);
+      shared_ptr<Blob<float> > blob(new Blob<float>());
+      blob->FromProto(proto);
+      if (proto.has_num() || proto.has_channels() ||
+          proto.has_height() || proto.has_width()) {
+        int num_axes = 1;
+        if (j == 0 && layer.type() == "Convolution") {
+          num_axes = 4;
+        } else if (j == 0 && layer.type() == "InnerProduct") {
+          num_axes = 2;
+        }
+        SqueezeLegacyShape(num_axes, blob.get());
+      }
+      // Keep CSR-stored blobs sparse when writing them back.
+      if (proto.storage() == BlobProto::CSR) {
+        blob->set_sparsity_mode(SparsityParameter::PRUNE);
+      }
+      layer_blobs.push_back(blob);
+    }
+  }
+
+  set<string> modified;
+  int removed = 0;
+  for (int p = 0; p < shrunk_param->layer_size(); ++p) {
+    LayerParameter* producer = shrunk_param->mutable_layer(p);
+    if (!IsChannelLayer(*producer) || producer->top_size() != 1 ||
+        blobs[producer->name()].empty()) {
+      continue;
+    }
+    BlobVec& producer_blobs = blobs[producer->name()];
+    const int channels = producer_blobs[0]->shape(0);
+    vector<float> value(channels, 0);
+    if (producer_blobs.size() > 1) {
+      caffe_copy(channels, producer_blobs[1]->cpu_data(), &value[0]);
+    }
+    // Follow the output through channel-wise layers to every layer reading
+    // it. Blobs still pending at the end are net outputs.
+    map<string, vector<float> > tracked;
+    set<string> pending;
+    tracked[producer->top(0)] = value;
+    pending.insert(producer->top(0));
+    vector<ChannelUse> uses;
+    bool supported = true;
+    for (int l = p + 1; l < shrunk_param->layer_size() && supported; ++l) {
+      const LayerParameter& layer = shrunk_param->layer(l);
+      bool reads_tracked = false;
+      for (int b = 0; b < layer.bottom_size(); ++b) {
+        reads_tracked |= tracked.count(layer.bottom(b)) > 0;
+      }
+      if (!reads_tracked) {
+        for (int t = 0; t < layer.top_size(); ++t) {
+          tracked.erase(layer.top(t));
+          pending.erase(layer.top(t));
+        }
+        continue;
+      }
+      if (IsShapeOnlyLayer(layer)) {
+        // Removing channels does not change what it computes.
+        for (int t = 0; t < layer.top_size(); ++t) {
+          tracked.erase(layer.top(t));
+          pending.erase(layer.top(t));
+        }
+        continue;
+      }
+      if (layer.bottom_size() != 1 || layer.top_size() != 1) {
+        supported = false;
+        break;
+      }
+      ChannelUse use;
+      use.layer_id = l;
+      use.value = tracked[layer.bottom(0)];
+      uses.push_back(use);
+      pending.erase(layer.bottom(0));
+      if (IsChannelLayer(layer)) {
+        supported = !blobs[layer.name()].empty();
+        tracked.erase(layer.top(0));
+        continue;
+      }
+      vector<float> next = use.value;
+      supported = PropagateValue(layer, blobs[layer.name()], &next);
+      tracked[layer.top(0)] = next;
+      pending.insert(layer.top(0));
+    }
+    if (!supported || uses.empty() || !pending.empty()) {
+      continue;
+    }
+
+    // A channel goes if its filter is zero and its constant output can be
+    // folded downstream (Normalize mixes channels and padding sees zeros, so
+    // only zeros pass them), or if every layer reading it multiplies it by
+    // zeros.
+    const Blob<float>& producer_weights = *producer_blobs[0];
+    const int dim = producer_weights.count() / channels;
+    vector<int> keep;
+    for (int c = 0; c < channels; ++c) {
+      bool foldable = true;
+      const float* filter = producer_weights.cpu_data() + c * dim;
+      for (int i = 0; i < dim && foldable; ++i) {
+        foldable = filter[i] == 0;
+      }
+      bool ignored = true;
+      for (int u = 0; u < uses.size(); ++u) {
+        const LayerParameter& layer = shrunk_param->layer(uses[u].layer_id);
+        if (layer.type() == "Normalize") {
+          foldable = foldable && uses[u].value[c] == 0;
+          ignored = false;
+        } else if (IsChannelLayer(layer)) {
+          foldable = foldable && (!HasPadding(layer) || uses[u].value[c] == 0);
+          ignored = ignored &&
+              InputChannelIsZero(*blobs[layer.name()][0], channels, c);
+        } else if (HasPadding(layer)) {
+          foldable = foldable && uses[u].value[c] == 0;
+        }
+      }
+      if (!foldable && !ignored) {
+        keep.push_back(c);
+      }
+    }
+    if (keep.empty()) {
+      keep.push_back(0);
+    }
+    if (keep.size() == channels) {
+      continue;
+    }
+
+    LOG(INFO) << "Shrinking " << producer->name() << " from " << channels
+        << " to " << keep.size() << " channels";
+    for (int i = 0; i < producer_blobs.size(); ++i) {
+      KeepIndices(0, keep, producer_blobs[i].get());
+    }
+    if (producer->type() == "Convolution") {
+      producer->mutable_convolution_param()->set_num_output(keep.size());
+    } else {
+      producer->mutable_inner_product_param()->set_num_output(keep.size());
+    }
+    modified.insert(producer->name());
+    for (int u = 0; u < uses.size(); ++u) {
+      LayerParameter* layer = shrunk_param->mutable_layer(uses[u].layer_id);
+      BlobVec* layer_blobs = &blobs[layer->name()];
+      if (IsChannelLayer(*layer)) {
+        KeepInputChannels(uses[u].value, keep, layer, layer_blobs);
+      } else {
+        KeepChannels(*layer, keep, layer_blobs);
+      }
+      if (!layer_blobs->empty()) {
+        modified.insert(layer->name());
+      }
+    }
+    removed += channels - keep.size();
+  }
+
+  shrunk_weights->CopyFrom(weights);
+  for (int i = 0; i < shrunk_weights->layer_size(); ++i) {
+    LayerParameter* layer = shrunk_weights->mutable_layer(i);
+    if (modified.count(layer->name()) == 0) {
+      continue;
+    }
+    const BlobVec& layer_blobs = blobs[layer->name()];
+    layer->clear_blobs();
+    for (int j = 0; j < layer_blobs.size(); ++j) {
+      layer_blobs[j]->ToProto(layer->add_blobs());
+    }
+  }
+  return removed;
+}
+
+}  // namespace caffe
@@ -54,9 +54,6 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -21,9 +21,6 @@ using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
         "The backend {leveldb, lmdb} containing the images");
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -53,7 +50,7 @@ int main(int argc, char** argv) {
   int count = 0;
   // load first datum
   Datum datum;
-  datum.ParseFromString(cursor->value());
+  cursor->ParseValue(&datum);
 
   if (DecodeDatumNative(&datum)) {
     LOG(INFO) << "Decoding Datum";
@@ -72,7 +69,7 @@ int main(int argc, char** argv) {
   LOG(INFO) << "Starting Iteration";
   while (cursor->valid()) {
     Datum datum;
-    datum.ParseFromString(cursor->value());
+    cursor->ParseValue(&datum);
     DecodeDatumNative(&datum);
 
     const std::string& data = datum.data();
@@ -19,10 +19,6 @@ using caffe::Net;
 using std::string;
 namespace db = caffe::db;
 
-DEFINE_string(step,"one",
-        "optional;choose the type of proto:"
-        "one,two or three");
-
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
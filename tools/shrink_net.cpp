@@ -0,0 +1,41 @@
+// This program removes the channels that structured pruning zeroed out from
+// a net, so that the dense layers get smaller.
+// Usage:
+//    shrink_net net_proto_file_in weights_file_in \
+//        net_proto_file_out weights_file_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/shrink_net.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: shrink_net net_proto_file_in weights_file_in "
+        << "net_proto_file_out weights_file_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(string(argv[1]), &net_param);
+  NetParameter weights;
+  ReadNetParamsFromBinaryFileOrDie(string(argv[2]), &weights);
+
+  NetParameter shrunk_net_param;
+  NetParameter shrunk_weights;
+  const int removed = ShrinkNet(net_param, weights, &shrunk_net_param,
+                                &shrunk_weights);
+  LOG(INFO) << "Removed " << removed << " channels.";
+
+  WriteProtoToTextFile(shrunk_net_param, argv[3]);
+  WriteProtoToBinaryFile(shrunk_weights, argv[4]);
+  LOG(INFO) << "Wrote shrunk net to " << argv[3] << " and its weights to "
+      << argv[4];
+  return 0;
+}